@@ -0,0 +1,423 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+/*
+// brief CPU topology and thread placement
+*/
+
+#include "cputopology.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#define SYSFS_CPU  "/sys/devices/system/cpu"
+#define SYSFS_NODE "/sys/devices/system/node"
+
+static bool ReadLine(const std::string &path, std::string &line)
+{
+    std::ifstream file(path.c_str());
+    if (!file.is_open())
+    {
+        return false;
+    }
+    std::getline(file, line);
+    return true;
+}
+
+static int ReadInt(const std::string &path, int fallback)
+{
+    std::string line;
+    if (!ReadLine(path, line) || line.empty())
+    {
+        return fallback;
+    }
+    return atoi(line.c_str());
+}
+
+static bool CoreLess(int nodeA, int packageA, int coreA, int nodeB, int packageB, int coreB)
+{
+    if (nodeA != nodeB)
+    {
+        return nodeA < nodeB;
+    }
+    if (packageA != packageB)
+    {
+        return packageA < packageB;
+    }
+    return coreA < coreB;
+}
+
+VaCpuTopology::VaCpuTopology():
+    m_nodes(1)
+{
+    for (int i = 0; i < ROLE_NUM; i ++)
+    {
+        m_roleCores[i] = 0;
+    }
+}
+
+std::vector<int> VaCpuTopology::ParseList(const std::string &list)
+{
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ','))
+    {
+        if (range.empty())
+        {
+            continue;
+        }
+        int first = 0, last = 0;
+        if (sscanf(range.c_str(), "%d-%d", &first, &last) == 2)
+        {
+            for (int cpu = first; cpu <= last; cpu ++)
+            {
+                cpus.push_back(cpu);
+            }
+        }
+        else if (sscanf(range.c_str(), "%d", &first) == 1)
+        {
+            cpus.push_back(first);
+        }
+    }
+    return cpus;
+}
+
+int VaCpuTopology::Load()
+{
+    std::string line;
+    if (!ReadLine(SYSFS_CPU "/online", line))
+    {
+        return -1;
+    }
+    // only the cpus the process may run on, taskset and the cpuset of a
+    // container both narrow its affinity mask
+    std::vector<int> online = ParseList(line);
+    cpu_set_t allowed;
+    bool masked = (sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+    m_allCpus.clear();
+    for (size_t i = 0; i < online.size(); i ++)
+    {
+        if (!masked || (online[i] < CPU_SETSIZE && CPU_ISSET(online[i], &allowed)))
+        {
+            m_allCpus.push_back(online[i]);
+        }
+    }
+    if (m_allCpus.empty())
+    {
+        return -1;
+    }
+
+    int maxCpu = *std::max_element(m_allCpus.begin(), m_allCpus.end());
+    m_cpuNode.assign(maxCpu + 1, 0);
+    m_nodes = 1;
+    if (ReadLine(SYSFS_NODE "/online", line))
+    {
+        std::vector<int> nodes = ParseList(line);
+        for (size_t i = 0; i < nodes.size(); i ++)
+        {
+            std::stringstream path;
+            path << SYSFS_NODE "/node" << nodes[i] << "/cpulist";
+            if (!ReadLine(path.str(), line))
+            {
+                continue;
+            }
+            std::vector<int> cpus = ParseList(line);
+            for (size_t j = 0; j < cpus.size(); j ++)
+            {
+                if (cpus[j] <= maxCpu)
+                {
+                    m_cpuNode[cpus[j]] = nodes[i];
+                }
+            }
+            m_nodes = std::max(m_nodes, nodes[i] + 1);
+        }
+    }
+
+    // group the SMT siblings of each physical core
+    m_cores.clear();
+    for (size_t i = 0; i < m_allCpus.size(); i ++)
+    {
+        int cpu = m_allCpus[i];
+        std::stringstream path;
+        path << SYSFS_CPU "/cpu" << cpu << "/topology/";
+        int package = ReadInt(path.str() + "physical_package_id", 0);
+        int coreId = ReadInt(path.str() + "core_id", cpu);
+        size_t c = 0;
+        for (; c < m_cores.size(); c ++)
+        {
+            if (m_cores[c].package == package && m_cores[c].coreId == coreId)
+            {
+                break;
+            }
+        }
+        if (c == m_cores.size())
+        {
+            Core core;
+            core.node = m_cpuNode[cpu];
+            core.package = package;
+            core.coreId = coreId;
+            m_cores.push_back(core);
+        }
+        m_cores[c].cpus.push_back(cpu);
+    }
+    std::sort(m_cores.begin(), m_cores.end(), [](const Core &a, const Core &b) {
+        return CoreLess(a.node, a.package, a.coreId, b.node, b.package, b.coreId);
+    });
+
+    // until Partition() every role runs anywhere
+    for (int i = 0; i < ROLE_NUM; i ++)
+    {
+        m_roleCpus[i] = m_allCpus;
+        m_roleCores[i] = (int)m_cores.size();
+    }
+    return 0;
+}
+
+void VaCpuTopology::Partition(const int *weights)
+{
+    int nCores = (int)m_cores.size();
+    int nRoles = 0;
+    int total = 0;
+    for (int i = 0; i < ROLE_NUM; i ++)
+    {
+        if (weights[i] > 0)
+        {
+            nRoles ++;
+            total += weights[i];
+        }
+        m_roleCpus[i] = m_allCpus;
+        m_roleCores[i] = nCores;
+    }
+    if (nRoles == 0 || nCores < nRoles)
+    {
+        return;
+    }
+
+    // every weighted role gets at least one core, the rest is split by weight
+    int count[ROLE_NUM] = {0};
+    int assigned = 0;
+    for (int i = 0; i < ROLE_NUM; i ++)
+    {
+        if (weights[i] > 0)
+        {
+            count[i] = std::max(1, nCores * weights[i] / total);
+            assigned += count[i];
+        }
+    }
+    while (assigned != nCores)
+    {
+        // grow or shrink the role that is furthest from its share
+        int pick = -1;
+        double pickError = 0;
+        for (int i = 0; i < ROLE_NUM; i ++)
+        {
+            if (weights[i] <= 0 || (assigned > nCores && count[i] <= 1))
+            {
+                continue;
+            }
+            double error = (double)nCores * weights[i] / total - count[i];
+            if (assigned > nCores)
+            {
+                error = -error;
+            }
+            if (pick < 0 || error > pickError)
+            {
+                pick = i;
+                pickError = error;
+            }
+        }
+        if (pick < 0)
+        {
+            break;
+        }
+        int step = (assigned < nCores) ? 1 : -1;
+        count[pick] += step;
+        assigned += step;
+    }
+
+    int next = 0;
+    for (int i = 0; i < ROLE_NUM; i ++)
+    {
+        if (weights[i] <= 0)
+        {
+            continue;
+        }
+        // first thread of every core before the SMT siblings, so the n-th
+        // cpu of a role is on its own physical core as long as there are any
+        m_roleCpus[i].clear();
+        for (size_t smt = 0; (int)m_roleCpus[i].size() < CpuCount(next, count[i]); smt ++)
+        {
+            for (int c = next; c < next + count[i]; c ++)
+            {
+                if (smt < m_cores[c].cpus.size())
+                {
+                    m_roleCpus[i].push_back(m_cores[c].cpus[smt]);
+                }
+            }
+        }
+        m_roleCores[i] = count[i];
+        next += count[i];
+    }
+}
+
+int VaCpuTopology::CpuCount(int first, int count) const
+{
+    int cpus = 0;
+    for (int c = first; c < first + count; c ++)
+    {
+        cpus += (int)m_cores[c].cpus.size();
+    }
+    return cpus;
+}
+
+const std::vector<int> &VaCpuTopology::GetCpus(Role role) const
+{
+    return m_roleCpus[role];
+}
+
+int VaCpuTopology::GetCoreCount(Role role) const
+{
+    return m_roleCores[role];
+}
+
+int VaCpuTopology::GetCpuNode(int cpu) const
+{
+    if (cpu < 0 || cpu >= (int)m_cpuNode.size())
+    {
+        return 0;
+    }
+    return m_cpuNode[cpu];
+}
+
+std::vector<int> VaCpuTopology::GetNodes(Role role) const
+{
+    std::vector<int> nodes;
+    const std::vector<int> &cpus = m_roleCpus[role];
+    for (size_t i = 0; i < cpus.size(); i ++)
+    {
+        int node = GetCpuNode(cpus[i]);
+        if (std::find(nodes.begin(), nodes.end(), node) == nodes.end())
+        {
+            nodes.push_back(node);
+        }
+    }
+    return nodes;
+}
+
+int VaCpuTopology::BindCpus(const std::vector<int> &cpus)
+{
+    if (cpus.empty())
+    {
+        return -1;
+    }
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (size_t i = 0; i < cpus.size(); i ++)
+    {
+        CPU_SET(cpus[i], &mask);
+    }
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+    if (ret != 0)
+    {
+        std::cout << " [warning] failed to pin a thread to cpus";
+        for (size_t i = 0; i < cpus.size(); i ++)
+        {
+            std::cout << (i ? "," : " ") << cpus[i];
+        }
+        std::cout << ", error " << ret << std::endl;
+    }
+    return ret;
+}
+
+int VaCpuTopology::BindThread(Role role, int index) const
+{
+    const std::vector<int> &cpus = m_roleCpus[role];
+    if (cpus.empty() || index < 0)
+    {
+        return -1;
+    }
+    return BindCpus(std::vector<int>(1, cpus[index % cpus.size()]));
+}
+
+int VaCpuTopology::BindThreadOnNode(Role role, int node) const
+{
+    std::vector<int> cpus;
+    const std::vector<int> &roleCpus = m_roleCpus[role];
+    for (size_t i = 0; i < roleCpus.size(); i ++)
+    {
+        if (GetCpuNode(roleCpus[i]) == node)
+        {
+            cpus.push_back(roleCpus[i]);
+        }
+    }
+    return BindCpus(cpus.empty() ? roleCpus : cpus);
+}
+
+void VaCpuTopology::RunBound(const std::vector<int> &cpus, const std::function<void()> &func) const
+{
+    cpu_set_t saved;
+    bool restore = (pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved) == 0);
+    if (restore && BindCpus(cpus) != 0)
+    {
+        restore = false;
+    }
+    func();
+    if (restore)
+    {
+        pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+    }
+}
+
+void VaCpuTopology::RunOnNode(int node, const std::function<void()> &func) const
+{
+    std::vector<int> cpus;
+    for (size_t i = 0; i < m_allCpus.size(); i ++)
+    {
+        if (GetCpuNode(m_allCpus[i]) == node)
+        {
+            cpus.push_back(m_allCpus[i]);
+        }
+    }
+    RunBound(cpus, func);
+}
+
+const char *VaCpuTopology::RoleName(Role role)
+{
+    static const char *names[ROLE_NUM] = {"decode", "preprocess", "infer", "track"};
+    return names[role];
+}
+
+void VaCpuTopology::Print() const
+{
+    std::cout << " cpu topology: " << m_allCpus.size() << " cpus, " << m_cores.size()
+              << " cores, " << m_nodes << " nodes" << std::endl;
+    for (int i = 0; i < ROLE_NUM; i ++)
+    {
+        std::cout << "   " << RoleName((Role)i) << ": " << m_roleCores[i] << " cores, cpus";
+        const std::vector<int> &cpus = m_roleCpus[i];
+        for (size_t j = 0; j < cpus.size(); j ++)
+        {
+            std::cout << (j ? "," : " ") << cpus[j];
+        }
+        std::cout << std::endl;
+    }
+}
@@ -0,0 +1,98 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+/*
+// brief CPU topology and thread placement
+*/
+
+#ifndef _CPUTOPOLOGY_H_
+#define _CPUTOPOLOGY_H_
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Reads the core, package and NUMA node of every online cpu the process may
+// run on from sysfs and splits the physical cores between the pipeline
+// stages. SMT siblings always stay with their core, and every stage gets a
+// contiguous range of cores in node order, so a small stage does not
+// straddle two sockets.
+class VaCpuTopology
+{
+public:
+    enum Role
+    {
+        ROLE_DECODE     = 0,
+        ROLE_PREPROCESS = 1,
+        ROLE_INFER      = 2,
+        ROLE_TRACK      = 3,
+        ROLE_NUM        = 4
+    };
+
+    VaCpuTopology();
+    // Read /sys/devices/system/cpu and /sys/devices/system/node, -1 if unavailable
+    int Load();
+    // Split the physical cores proportionally to weights[ROLE_NUM]. A role of
+    // weight 0, or every role when there are fewer cores than roles, gets no
+    // own cores and may run on any cpu
+    void Partition(const int *weights);
+
+    // Logical cpus of a role in node order
+    const std::vector<int> &GetCpus(Role role) const;
+    int GetCoreCount(Role role) const;
+    int GetNodeCount() const { return m_nodes; }
+    int GetCpuNode(int cpu) const;
+    // Nodes the cpus of a role are on, in order
+    std::vector<int> GetNodes(Role role) const;
+
+    // Pin the calling thread to the index-th logical cpu of a role. The Bind
+    // functions warn on failure, the thread then runs where it did
+    int BindThread(Role role, int index) const;
+    // Pin the calling thread to the cpus of a role on one node, the whole role if it has none there
+    int BindThreadOnNode(Role role, int node) const;
+    // Run func with the calling thread bound to cpus and restore its affinity
+    // afterwards. Memory func touches first lands on the node of those cpus
+    void RunBound(const std::vector<int> &cpus, const std::function<void()> &func) const;
+    void RunOnNode(int node, const std::function<void()> &func) const;
+
+    void Print() const;
+
+    static const char *RoleName(Role role);
+    // Parse a sysfs cpu list like "0-3,8-11"
+    static std::vector<int> ParseList(const std::string &list);
+
+protected:
+    struct Core
+    {
+        int node;
+        int package;
+        int coreId;
+        std::vector<int> cpus;
+    };
+
+    static int BindCpus(const std::vector<int> &cpus);
+    // logical cpus of count cores from first on
+    int CpuCount(int first, int count) const;
+
+    std::vector<Core> m_cores;
+    std::vector<int> m_cpuNode;
+    std::vector<int> m_allCpus;
+    std::vector<int> m_roleCpus[ROLE_NUM];
+    int m_roleCores[ROLE_NUM];
+    int m_nodes;
+};
+
+#endif
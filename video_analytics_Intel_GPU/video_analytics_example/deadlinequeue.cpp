@@ -0,0 +1,167 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+
+/*
+// brief Earliest deadline first queue of decoded frames
+*/
+
+#include "deadlinequeue.h"
+#include <stdlib.h>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+VaDeadlineQueue::VaDeadlineQueue():
+    m_counters(NULL),
+    m_channels(0),
+    m_service(Clock::duration::zero())
+{
+}
+
+VaDeadlineQueue::~VaDeadlineQueue()
+{
+    delete [] m_counters;
+}
+
+bool VaDeadlineQueue::ParseBudgets(const std::string &list, int nchannels, std::vector<int> &budgets)
+{
+    budgets.clear();
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        int ms = atoi(item.c_str());
+        if (ms <= 0)
+        {
+            return false;
+        }
+        budgets.push_back(ms);
+    }
+    if (budgets.empty())
+    {
+        return false;
+    }
+    budgets.resize(std::max(nchannels, (int)budgets.size()), budgets.back());
+    return true;
+}
+
+void VaDeadlineQueue::Initialize(const std::vector<int> &budgets)
+{
+    m_channels = (int)budgets.size();
+    m_budgets.clear();
+    for (int i = 0; i < m_channels; i ++)
+    {
+        m_budgets.push_back(std::chrono::milliseconds(budgets[i]));
+    }
+    delete [] m_counters;
+    m_counters = new Counters[m_channels];
+    for (int i = 0; i < m_channels; i ++)
+    {
+        m_counters[i].scheduled.store(0, std::memory_order_relaxed);
+        m_counters[i].skipped.store(0, std::memory_order_relaxed);
+    }
+}
+
+void VaDeadlineQueue::Push(int channel, Clock::time_point capture, VaFrameHandle &&frame)
+{
+    Entry entry;
+    entry.deadline = capture + m_budgets[channel];
+    entry.channel = channel;
+    entry.frame = std::move(frame);
+    m_heap.push_back(std::move(entry));
+    std::push_heap(m_heap.begin(), m_heap.end(), Later);
+}
+
+bool VaDeadlineQueue::IsLate(const Entry &entry, Clock::time_point now) const
+{
+    return now + m_service > entry.deadline;
+}
+
+void VaDeadlineQueue::Skip(int channel)
+{
+    std::atomic<uint64_t> &skipped = m_counters[channel].skipped;
+    skipped.store(skipped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+bool VaDeadlineQueue::Pop(VaFrameHandle &frame, int &channel, Clock::time_point now, bool idle)
+{
+    while (!m_heap.empty())
+    {
+        std::pop_heap(m_heap.begin(), m_heap.end(), Later);
+        Entry &entry = m_heap.back();
+        channel = entry.channel;
+        if (!idle && IsLate(entry, now))
+        {
+            // releases the frame back to its pipe
+            Skip(channel);
+            m_heap.pop_back();
+            continue;
+        }
+        frame = std::move(entry.frame);
+        m_heap.pop_back();
+        std::atomic<uint64_t> &scheduled = m_counters[channel].scheduled;
+        scheduled.store(scheduled.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void VaDeadlineQueue::DropLate(Clock::time_point now)
+{
+    // the head has the earliest deadline, once it is in time all the others are
+    while (!m_heap.empty() && IsLate(m_heap.front(), now))
+    {
+        std::pop_heap(m_heap.begin(), m_heap.end(), Later);
+        Skip(m_heap.back().channel);
+        m_heap.pop_back();
+    }
+}
+
+void VaDeadlineQueue::RecordServiceTime(Clock::duration duration)
+{
+    // 1/8 of the new sample, the same smoothing TCP uses for its RTT
+    if (m_service == Clock::duration::zero())
+    {
+        m_service = duration;
+    }
+    else
+    {
+        m_service += (duration - m_service) / 8;
+    }
+}
+
+uint64_t VaDeadlineQueue::GetScheduled(int channel) const
+{
+    return m_counters[channel].scheduled.load(std::memory_order_relaxed);
+}
+
+uint64_t VaDeadlineQueue::GetSkipped(int channel) const
+{
+    return m_counters[channel].skipped.load(std::memory_order_relaxed);
+}
+
+void VaDeadlineQueue::Print() const
+{
+    std::cout << " deadline scheduling, inference takes "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(m_service).count() << " ms" << std::endl;
+    for (int i = 0; i < m_channels; i ++)
+    {
+        std::cout << "   channel(" << i << ") budget "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(m_budgets[i]).count()
+                  << " ms: scheduled " << GetScheduled(i) << ", skipped " << GetSkipped(i) << " late frames" << std::endl;
+    }
+}
@@ -0,0 +1,92 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+
+/*
+// brief Earliest deadline first queue of decoded frames
+*/
+
+#ifndef _DEADLINEQUEUE_H_
+#define _DEADLINEQUEUE_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "dualpipe.h"
+
+// Ready queue of the scheduler. A frame is due at its capture time plus the
+// latency budget of its channel and frames leave earliest deadline first, so
+// a late or bursty channel can not hold up the frames of the others. Frames
+// that can not make their deadline any more, given how long inference takes
+// right now, are dropped instead of spending batch slots on them.
+// Meant for one thread, only the counters may be read from others.
+class VaDeadlineQueue
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    VaDeadlineQueue();
+    ~VaDeadlineQueue();
+    // budgets in ms, one per channel
+    void Initialize(const std::vector<int> &budgets);
+    void Push(int channel, Clock::time_point capture, VaFrameHandle &&frame);
+    // Earliest deadline frame that can still make it, late frames ahead of it are
+    // dropped. idle, the detector has nothing in flight: the head frame is taken
+    // even when late, so that a service time estimate pushed up by one slow
+    // batch gets a new sample and can come down again
+    bool Pop(VaFrameHandle &frame, int &channel, Clock::time_point now, bool idle = false);
+    // Drop the late frames only, e.g. while inference is busy
+    void DropLate(Clock::time_point now);
+    bool Empty() const { return m_heap.empty(); }
+
+    // Time from submitting a batch to its result, a moving average
+    void RecordServiceTime(Clock::duration duration);
+    Clock::duration GetServiceTime() const { return m_service; }
+
+    uint64_t GetScheduled(int channel) const;
+    uint64_t GetSkipped(int channel) const;
+    void Print() const;
+
+    // "100" for every channel or "100,200,..." per channel, the last one repeats
+    static bool ParseBudgets(const std::string &list, int nchannels, std::vector<int> &budgets);
+
+protected:
+    struct Entry
+    {
+        Clock::time_point deadline;
+        int channel;
+        VaFrameHandle frame;
+    };
+    struct Counters
+    {
+        std::atomic<uint64_t> scheduled;
+        std::atomic<uint64_t> skipped;
+    };
+
+    static bool Later(const Entry &a, const Entry &b) { return a.deadline > b.deadline; }
+    bool IsLate(const Entry &entry, Clock::time_point now) const;
+    void Skip(int channel);
+
+    std::vector<Entry> m_heap;
+    std::vector<Clock::duration> m_budgets;
+    Counters *m_counters;
+    int m_channels;
+    Clock::duration m_service;
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "detector.hpp"
+#include "tracing.h"
 #pragma once
 #include <ie_plugin_config.hpp>
 #include <ie_plugin_ptr.hpp>
@@ -12,18 +13,21 @@
 #include <cpp/ie_infer_request.hpp>
 #include <ie_device.hpp>
 Detector::Detector() :
-    nbatch_index_(0),
     num_channels_(0),
     num_batch_(0),
     maxProposalCount(0),
     objectSize(0),
     bisASync(false),
-    bLoad(false)
+    bLoad(false),
+    dyn_batch_(false),
+    batch_timeout_(Clock::duration::zero()),
+    filling_(NULL),
+    batch_seq_(0)
 {
 	bLoad = false;
 }
 
-int Detector::Load(string& device, const string& model_file,const string& weights_file, int bn) {
+int Detector::Load(string& device, const string& model_file,const string& weights_file, int bn, int nireq) {
 	if (bLoad)
 		return 0;
 	err_msg = "";
@@ -91,52 +95,72 @@ int Detector::Load(string& device, const string& model_file,const string& weight
 	}
 // -------------------------Loading model to the plugin-------------------------------------------------
 	//InferenceEngine::ExecutableNetwork exenet;
-	try {
-		exenet = enginePtr.LoadNetwork(network_, {});
+	if (dyn_batch_) {
+		try {
+			std::map<std::string, std::string> config = plugin_config_;
+			config[PluginConfigParams::KEY_DYN_BATCH_ENABLED] = PluginConfigParams::YES;
+			exenet = enginePtr.LoadNetwork(network_, config);
+		}
+		catch (InferenceEngineException e) {
+			std::cout<<"   dynamic batch is not supported on device:"<<device<<", pad partial batches"<<std::endl;
+			dyn_batch_ = false;
+		}
 	}
-	catch (InferenceEngineException e) {
-		std::cout<<"   Input Model file"<< model_file<<" doesn't support by current device:"<<device<<std::endl;
-		return -1;
+	if (!dyn_batch_) {
+		try {
+			exenet = enginePtr.LoadNetwork(network_, plugin_config_);
+		}
+		catch (InferenceEngineException e) {
+			std::cout<<"   Input Model file"<< model_file<<" doesn't support by current device:"<<device<<std::endl;
+			return -1;
+		}
+	}
+	if (nireq < 1)
+		nireq = 1;
+	slots_.resize(nireq);
+	for (int i = 0; i < nireq; i++) {
+		InferSlot* slot = &slots_[i];
+		slot->request = exenet.CreateInferRequestPtr();
+		slot->infos.reserve(num_batch_);  // reserved images must not move
+		slot->writers = 0;
+		slot->done = false;
+		slot->request->SetCompletionCallback(std::function<void()>([this, slot]() {
+			OnInferDone(slot, true);
+		}));
+		free_slots_.push_back(slot);
 	}
-	infer_request_curr_ = exenet.CreateInferRequestPtr();
-	infer_request_next_ = exenet.CreateInferRequestPtr();
-	Blob::Ptr imageInput = infer_request_curr_->GetBlob(inputname);
+        std::cout<<">  infer requests: "<<nireq<< std::endl;
+	Blob::Ptr imageInput = slots_[0].request->GetBlob(inputname);
 	num_channels_ = (int)imageInput->dims()[2];
 
 	if(!(num_channels_ == 3 || num_channels_ == 1))
 		throw std::logic_error("Input layer should have 1 or 3 channels");
 	input_geometry_ = cv::Size((int)imageInput->dims()[0], (int)imageInput->dims()[1]);	
 	CreateMean();	
-	nbatch_index_ = 0;
+	filling_ = NULL;
 	bisASync = true;
 	bLoad = true;
         return 0;
 }
 
 Detector::~Detector() {
-	EmptyQueue(imginfoque_);
-}
-
-void Detector::EmptyQueue(queue<Detector::ImageInfo>& que)
-{
-	while (!que.empty()) {
-		que.pop();
-	}
+	// callbacks still in flight would touch a dead object
+	WaitIdle();
 }
 
-/* Wrap the input layer of the network in separate cv::Mat objects
+/* Wrap one image of the input layer of the network in separate cv::Mat objects
 * (one per channel). This way we save one memcpy operation */
-void Detector::WrapInputLayer(IDtype* input_data) {
-	input_channels.clear();
+void Detector::WrapInputLayer(IDtype* input_data, std::vector<cv::Mat>& channels) {
+	channels.clear();
 	int width = input_geometry_.width;
 	int height = input_geometry_.height;
-	for (int i = 0; i < num_batch_*num_channels_; ++i) {
+	for (int i = 0; i < num_channels_; ++i) {
 #ifdef INPUT_U8
 		cv::Mat channel(height, width, CV_8UC1, input_data);
 #else
 		cv::Mat channel(height, width, CV_32FC1, input_data);
 #endif
-		input_channels.push_back(channel);
+		channels.push_back(channel);
 		input_data += width * height;
 	}
 }
@@ -166,91 +190,344 @@ void Detector::CreateMean() {
 }
 
 /*
-	InsertImage will fill a blob until blob full, if full return the blob point
+	InsertImage will fill the blob of a free request until it is full, then start it.
+	Results finished by the pool so far are returned, no inference is waited for
 */
-Detector::InsertImgStatus Detector::InsertImage(const cv::Mat& orgimg, vector<DetctorResult>& objects, int inputid, int frameno, int channelid) {
-	InsertImgStatus retvalue=INSERTIMG_INSERTED;
+Detector::InsertImgStatus Detector::InsertImage(const cv::Mat& orgimg, vector<DetctorResult>& objects, int inputid, int frameno, int channelid, const VaFrameHandle& frame, Clock::time_point origin) {
 	if(orgimg.cols==0 || orgimg.rows==0 ||!bLoad)
 		return INSERTIMG_NULL;
-	if(nbatch_index_==0){  //Wrap a blob
-		WrapInputLayer(static_cast<IDtype*>((bisASync ? infer_request_next_ : infer_request_curr_)->GetBlob(inputname)->buffer()));
-	}
+	objects.clear();
 	ImageInfo is;
 	is.isize = orgimg.size();
 	is.inputid = inputid;
 	is.orgimg = orgimg;
     is.frameno = frameno;
     is.channelid = channelid;
-	imginfoque_.push(is);
+	is.frame = frame;
+	is.origin = origin;
+	PlanarSlot planar;
+	std::vector<cv::Mat> channels;
+	WrapInputLayer(ReserveImage(is, planar), channels);
         // No need to process it due to VPP output is already scaled.
 	//cv::Mat img = PreProcess(orgimg);		
-	//cv::split(img, &input_channels[num_channels_*nbatch_index_]);
+	//cv::split(img, &channels[0]);
 #ifdef INPUT_U8
-        cv::split(orgimg, &input_channels[num_channels_*nbatch_index_]);
+        cv::split(orgimg, &channels[0]);
 #else
 	cv::Mat img = PreProcess(orgimg);		
-	cv::split(img, &input_channels[num_channels_*nbatch_index_]);
+	cv::split(img, &channels[0]);
 
 #endif
-	//if get return INSERTIMG_GET
-	if(++nbatch_index_>=num_batch_){
-		nbatch_index_=0;
-		(bisASync ? infer_request_next_ : infer_request_curr_)->StartAsync();
-		if (InferenceEngine::OK == infer_request_curr_->Wait(IInferRequest::WaitMode::RESULT_READY)) {
-			/* get the result */
-			//objects.clear();
-			objects.resize(num_batch_);
-			for (int i = 0; i<num_batch_; i++) {
-				if (!imginfoque_.empty()) {
-					objects[i].imgsize = imginfoque_.front().isize;
-					objects[i].inputid = imginfoque_.front().inputid;
-					objects[i].orgimg  = imginfoque_.front().orgimg;
-                    objects[i].frameno = imginfoque_.front().frameno;
-				    objects[i].channelid = imginfoque_.front().channelid;
-					imginfoque_.pop();
-					objects[i].boxs.clear();
-				}
-				else
-					throw std::logic_error("InsertImage queue fail");
-			}
-			retvalue = INSERTIMG_PROCESSED;
+	CommitPlanar(planar);
+	return FetchResults(objects);
+}
+
+IDtype* Detector::InsertPlanar(PlanarSlot& planar, int inputid, int frameno, int channelid, const VaFrameHandle& frame, Clock::time_point origin) {
+	if (!bLoad)
+		return NULL;
+	ImageInfo is;
+	is.isize = input_geometry_;
+	is.inputid = inputid;
+	is.frameno = frameno;
+	is.channelid = channelid;
+	is.frame = frame;
+	is.origin = origin;
+	return ReserveImage(is, planar);
+}
+
+/*
+	Reserve the next image of the batch being filled, a full batch is closed right away
+*/
+IDtype* Detector::ReserveImage(const ImageInfo& is, PlanarSlot& planar) {
+	std::unique_lock<std::mutex> lock(fill_mutex_);
+	while (filling_ == NULL) {
+		// wait for a request without fill_mutex_, the writers of a closed batch
+		// need it to start the batch, which may be what frees a request
+		lock.unlock();
+		InferSlot* acquired = AcquireSlot();
+		lock.lock();
+		if (filling_ != NULL) {
+			// another writer installed one first
+			ReleaseSlot(acquired);
+			break;
+		}
+		filling_ = acquired;
+		filling_->start = Clock::now();
+		filling_->batchid = batch_seq_++;
+	}
+	InferSlot* slot = filling_;
+	planar.request = (int)(slot - &slots_[0]);
+	planar.index = (int)slot->infos.size();
+	planar.batch = slot->batchid;
+	slot->infos.push_back(is);
+	slot->infos.back().inserted = Clock::now();
+	slot->writers++;
+	if ((int)slot->infos.size() >= num_batch_)
+		CloseBatch();
+	IDtype* data = static_cast<IDtype*>(slot->request->GetBlob(inputname)->buffer());
+	return data + (size_t)planar.index * num_channels_ * input_geometry_.area();
+}
+
+void Detector::CommitPlanar(const PlanarSlot& planar) {
+	InferSlot* slot = &slots_[planar.request];
+	bool start;
+	{
+		std::lock_guard<std::mutex> lock(fill_mutex_);
+		start = (--slot->writers == 0 && slot != filling_);
+	}
+	if (start)
+		StartBatch(slot);
+}
+
+/*
+	Take a free request, waiting for a completion when the whole pool is in flight
+*/
+Detector::InferSlot* Detector::AcquireSlot() {
+	std::unique_lock<std::mutex> lock(pool_mutex_);
+	pool_cond_.wait(lock, [this]() { return !free_slots_.empty(); });
+	InferSlot* slot = free_slots_.front();
+	free_slots_.pop_front();
+	return slot;
+}
+
+/*
+	Give back a request taken by AcquireSlot() and not used
+*/
+void Detector::ReleaseSlot(InferSlot* slot) {
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex_);
+		free_slots_.push_front(slot);
+	}
+	pool_cond_.notify_all();
+}
+
+/*
+	Called with fill_mutex_ held. The batch being filled takes its place in the
+	result order now, it is started by whoever commits its last image
+*/
+void Detector::CloseBatch() {
+	InferSlot* slot = filling_;
+	filling_ = NULL;
+	std::lock_guard<std::mutex> lock(pool_mutex_);
+	slot->done = false;
+	inflight_.push_back(slot);
+}
+
+/*
+	Start a closed batch. With the sync mode the caller waits until it completed
+*/
+void Detector::StartBatch(InferSlot* slot) {
+	SetRequestBatch(slot->request, (int)slot->infos.size());
+	slot->submitted = Clock::now();
+	try {
+		slot->request->StartAsync();
+	}
+	catch (InferenceEngineException e) {
+		std::cout<<"   failed to start inference: "<<e.what()<<std::endl;
+		OnInferDone(slot, false);
+	}
+	if (!bisASync)
+		WaitIdle();
+}
+
+/*
+	Requests may complete in any order. A completed slot only hands its results
+	to the result queue once every slot submitted before it did, so the order of
+	the frames is kept for each channel
+*/
+void Detector::OnInferDone(InferSlot* slot, bool ok) {
+	slot->completed = Clock::now();
+	if (VaTracer::IsEnabled())
+		VaTracer::Record("infer", slot->submitted, slot->completed, -1, -1, slot->batchid);
+	if (ok)
+		ParseResult(slot);
+	else
+		slot->results.clear();
 
-                        const float *result = infer_request_curr_->GetBlob(outputname)->buffer().as<PrecisionTrait<Precision::FP32>::value_type*>();
-			for (int k = 0; k < maxProposalCount; k++) {
-				resultbox object;
-				int imgid = (int)result[0];
-				if (imgid < 0 || result[2] == 0 || imgid > num_batch_) {
-					result += objectSize;
-					break;
-				}
-				int w = objects[imgid].imgsize.width;
-				int h = objects[imgid].imgsize.height;
-				object.classid = (int)result[1];
-				object.confidence = result[2];
-				object.left = (int)(result[3] * w);
-				object.top = (int)(result[4] * h);
-				object.right = (int)(result[5] * w);
-				object.bottom = (int)(result[6] * h);
-				if (object.left < 0) object.left = 0;
-				if (object.top < 0) object.top = 0;
-				if (object.right >= w) object.right = w - 1;
-				if (object.bottom >= h) object.bottom = h - 1;
-				objects[imgid].boxs.push_back(object);
-				result += objectSize;
-				retvalue = INSERTIMG_GET;
-			}
+	bool notify = false;
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex_);
+		slot->done = true;
+		while (!inflight_.empty() && inflight_.front()->done) {
+			InferSlot* front = inflight_.front();
+			inflight_.pop_front();
+			for (size_t i = 0; i < front->results.size(); i++)
+				resultque_.push_back(front->results[i]);
+			front->results.clear();
+			front->infos.clear();
+			free_slots_.push_back(front);
+			notify = true;
 		}
-		if(bisASync)
-			infer_request_curr_.swap(infer_request_next_);
+	}
+	if (notify) {
+		pool_cond_.notify_all();
+		if (result_callback_)
+			result_callback_();
+	}
+}
+
+/*
+	Convert the SSD output of a completed slot. Blob entries behind the images
+	of the slot only hold padding, their boxes are dropped
+*/
+void Detector::ParseResult(InferSlot* slot) {
+	int count = (int)slot->infos.size();
+	vector<DetctorResult>& objects = slot->results;
+	objects.resize(count);
+	for (int i = 0; i<count; i++) {
+		DetctorResult& obj = objects[i];
+		obj.imgsize = slot->infos[i].isize;
+		obj.inputid = slot->infos[i].inputid;
+		obj.orgimg  = slot->infos[i].orgimg;
+		obj.frameno = slot->infos[i].frameno;
+		obj.channelid = slot->infos[i].channelid;
+		obj.frame = slot->infos[i].frame;
+		obj.origin = slot->infos[i].origin;
+		obj.inserted = slot->infos[i].inserted;
+		obj.submitted = slot->submitted;
+		obj.completed = slot->completed;
+		obj.batchid = slot->batchid;
+		obj.boxs.clear();
+	}
+
+	const float *result = slot->request->GetBlob(outputname)->buffer().as<PrecisionTrait<Precision::FP32>::value_type*>();
+	for (int k = 0; k < maxProposalCount; k++, result += objectSize) {
+		resultbox object;
+		int imgid = (int)result[0];
+		if (imgid < 0 || result[2] == 0 || imgid > num_batch_) {
+			break;
+		}
+		if (imgid >= count)
+			continue;
+		int w = objects[imgid].imgsize.width;
+		int h = objects[imgid].imgsize.height;
+		object.classid = (int)result[1];
+		object.confidence = result[2];
+		object.left = (int)(result[3] * w);
+		object.top = (int)(result[4] * h);
+		object.right = (int)(result[5] * w);
+		object.bottom = (int)(result[6] * h);
+		object.trackid = 0;
+		if (object.left < 0) object.left = 0;
+		if (object.top < 0) object.top = 0;
+		if (object.right >= w) object.right = w - 1;
+		if (object.bottom >= h) object.bottom = h - 1;
+		objects[imgid].boxs.push_back(object);
+	}
+}
+
+Detector::InsertImgStatus Detector::FetchResults(vector<DetctorResult>& objects) {
+	objects.clear();
+	InsertImgStatus retvalue = INSERTIMG_INSERTED;
+	std::lock_guard<std::mutex> lock(pool_mutex_);
+	while (!resultque_.empty()) {
+		objects.push_back(resultque_.front());
+		resultque_.pop_front();
+		if (retvalue == INSERTIMG_INSERTED)
+			retvalue = INSERTIMG_PROCESSED;
+		if (!objects.back().boxs.empty())
+			retvalue = INSERTIMG_GET;
 	}
 	return retvalue;
 }
 
+void Detector::WaitIdle() {
+	std::unique_lock<std::mutex> lock(pool_mutex_);
+	pool_cond_.wait(lock, [this]() { return inflight_.empty(); });
+}
+
+void Detector::SetRequestBatch(InferRequest::Ptr& request, int count) {
+	if (!dyn_batch_)
+		return;
+	try {
+		request->SetBatch(count);
+	}
+	catch (InferenceEngineException e) {
+		std::cout<<"   dynamic batch rejected, pad partial batches"<<std::endl;
+		dyn_batch_ = false;
+	}
+}
+
+bool Detector::GetBatchDeadline(timespec& abstime) {
+	if (!bLoad || batch_timeout_ == Clock::duration::zero())
+		return false;
+	Clock::time_point oldest;
+	{
+		std::lock_guard<std::mutex> lock(fill_mutex_);
+		if (filling_ == NULL)
+			return false;
+		oldest = filling_->start;
+	}
+
+	Clock::duration remain = oldest + batch_timeout_ - Clock::now();
+	if (remain < Clock::duration::zero())
+		remain = Clock::duration::zero();
+	long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(remain).count();
+	clock_gettime(CLOCK_REALTIME, &abstime);
+	ns += abstime.tv_nsec;
+	abstime.tv_sec += ns / 1000000000LL;
+	abstime.tv_nsec = ns % 1000000000LL;
+	return true;
+}
+
+bool Detector::BatchExpired() {
+	if (!bLoad || batch_timeout_ == Clock::duration::zero())
+		return false;
+	std::lock_guard<std::mutex> lock(fill_mutex_);
+	return filling_ != NULL && Clock::now() - filling_->start >= batch_timeout_;
+}
+
+bool Detector::CanInsert() {
+	if (!bLoad)
+		return false;
+	std::lock_guard<std::mutex> lock(fill_mutex_);
+	if (filling_ != NULL)
+		return true;
+	std::lock_guard<std::mutex> pool_lock(pool_mutex_);
+	return !free_slots_.empty();
+}
+
+bool Detector::IsIdle() {
+	if (!bLoad)
+		return false;
+	std::lock_guard<std::mutex> lock(fill_mutex_);
+	if (filling_ != NULL)
+		return false;
+	std::lock_guard<std::mutex> pool_lock(pool_mutex_);
+	return inflight_.empty();
+}
+
+Detector::InsertImgStatus Detector::FlushBatch(vector<DetctorResult>& objects) {
+	objects.clear();
+	if (!bLoad)
+		return INSERTIMG_NULL;
+	InferSlot* slot = NULL;
+	{
+		std::lock_guard<std::mutex> lock(fill_mutex_);
+		if (filling_ != NULL) {
+			slot = filling_;
+			CloseBatch();
+			// images still being written, the last CommitPlanar() starts it
+			if (slot->writers > 0)
+				slot = NULL;
+		}
+	}
+	if (slot != NULL)
+		StartBatch(slot);
+	return FetchResults(objects);
+}
+
 void Detector::SetMode(bool isSync)
 {
-	infer_request_curr_->Wait(IInferRequest::WaitMode::RESULT_READY);
-	infer_request_next_->Wait(IInferRequest::WaitMode::RESULT_READY);
-	EmptyQueue(imginfoque_);
-	nbatch_index_ = 0;
+	WaitIdle();
+	std::lock_guard<std::mutex> fill_lock(fill_mutex_);
+	std::lock_guard<std::mutex> lock(pool_mutex_);
+	if (filling_ != NULL) {
+		filling_->infos.clear();
+		filling_->writers = 0;
+		free_slots_.push_back(filling_);
+		filling_ = NULL;
+	}
+	resultque_.clear();
 	bisASync = isSync;
 }
@@ -9,10 +9,18 @@
 
 #include <vector>
 #include <queue>
+#include <deque>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <time.h>
 #include <ie_plugin_config.hpp>
 #include <ie_plugin_ptr.hpp>
 #include <cpp/ie_cnn_net_reader.h>
 #include <inference_engine.hpp>
+#include "dualpipe.h"
 
 
 /**************************************************************************************************
@@ -42,6 +50,8 @@ using namespace InferenceEngine;
 
 class Detector {
 public:
+	typedef std::chrono::steady_clock Clock;
+
 	typedef enum {
 		INSERTIMG_NULL=-1,
 		INSERTIMG_INSERTED=0,
@@ -55,6 +65,9 @@ public:
         int frameno;
         int channelid;
 		cv::Mat orgimg;
+		VaFrameHandle frame;
+		Clock::time_point origin;     // the caller's, e.g. when decoding of the frame started
+		Clock::time_point inserted;
 	}ImageInfo;
 
 	typedef struct __resultbox {
@@ -64,6 +77,7 @@ public:
 		int right;
 		int top;
 		int bottom;
+		int trackid;    // stable id of a tracked object, 0 for a detection
 	}resultbox;
 
 	typedef struct __Result {
@@ -73,27 +87,88 @@ public:
 		int inputid;
         int frameno;
         int channelid;
+		VaFrameHandle frame;    // source frame, held until the result is consumed
+		// when the image went through each step, for latency accounting
+		Clock::time_point origin;
+		Clock::time_point inserted;
+		Clock::time_point submitted;
+		Clock::time_point completed;
+		int batchid;
 	}DetctorResult;
+
+	// An image of the batch being filled, reserved by InsertPlanar()
+	typedef struct __PlanarSlot {
+		int request;    // index in the request pool
+		int index;      // image in the batch
+		int batch;      // sequence number of the batch
+	}PlanarSlot;
 	
 	Detector();
-	int Load(string& device, const string& model_file,const string& weights_file, int bn=1);
+	// nireq infer requests are created from the network, up to nireq batches are in flight
+	int Load(string& device, const string& model_file,const string& weights_file, int bn=1, int nireq=2);
 	~Detector();
 
 	inline int GetCurBatch(){return  num_batch_;}
+	inline int GetRequestNum(){return  (int)slots_.size();}
 	inline cv::Size GetNetSize(){return input_geometry_;}
-	InsertImgStatus InsertImage(const cv::Mat& orgimg, vector<DetctorResult>& objects, int inputid = 0, int frameno=0, int channelid=0);
+	// Never waits for inference: objects gets the results completed so far. Blocks only
+	// when every request of the pool is in flight
+	InsertImgStatus InsertImage(const cv::Mat& orgimg, vector<DetctorResult>& objects, int inputid = 0, int frameno=0, int channelid=0, const VaFrameHandle& frame = VaFrameHandle(), Clock::time_point origin = Clock::time_point());
+	// Reserve the next image of the batch and return its place in the input blob: num channels
+	// planes of GetNetSize(), in the channel order InsertImage() writes. Hand it back with
+	// CommitPlanar() once written. Several threads may fill images of a batch concurrently
+	IDtype* InsertPlanar(PlanarSlot& planar, int inputid = 0, int frameno=0, int channelid=0, const VaFrameHandle& frame = VaFrameHandle(), Clock::time_point origin = Clock::time_point());
+	// The batch is started once it is closed and every image of it was committed
+	void CommitPlanar(const PlanarSlot& planar);
+	// Take the results completed so far, in submission order
+	InsertImgStatus FetchResults(vector<DetctorResult>& objects);
+	// Called from the IE completion thread whenever new results can be fetched
+	inline void SetResultCallback(std::function<void()> callback){result_callback_ = callback;}
 	void SetMode(bool isSync);
+	// A partial batch is submitted once its oldest image waited timeout_ms, 0 disables it
+	inline void SetBatchTimeout(int timeout_ms){batch_timeout_ = std::chrono::milliseconds(timeout_ms);}
+	// Use IE dynamic batch for partial batches instead of padding, call before Load()
+	inline void EnableDynamicBatch(bool enable){dyn_batch_ = enable;}
+	// Extra plugin config for LoadNetwork(), e.g. the CPU thread count, call before Load()
+	inline void AddPluginConfig(const std::string& key, const std::string& value){plugin_config_[key] = value;}
+	// Absolute CLOCK_REALTIME time the oldest pending image must be flushed at, false if nothing pending
+	bool GetBatchDeadline(timespec& abstime);
+	bool BatchExpired();
+	// True if an image can be inserted right away, without waiting for a request to complete
+	bool CanInsert();
+	// True if no batch is being filled or in flight
+	bool IsIdle();
+	// Submit the partial batch and fetch the results completed so far
+	InsertImgStatus FlushBatch(vector<DetctorResult>& objects);
 	std::string err_msg;
 
 private:
-	void WrapInputLayer(IDtype* input_data);
+	// One infer request of the pool with the images blobbed into it
+	typedef struct __InferSlot {
+		InferRequest::Ptr request;
+		vector<ImageInfo> infos;
+		vector<DetctorResult> results;
+		Clock::time_point start;   // first image blobbed
+		int batchid;
+		Clock::time_point submitted;
+		Clock::time_point completed;
+		int writers;               // images reserved but not committed yet
+		bool done;
+	}InferSlot;
+
+	IDtype* ReserveImage(const ImageInfo& is, PlanarSlot& planar);
+	InferSlot* AcquireSlot();
+	void ReleaseSlot(InferSlot* slot);
+	void CloseBatch();
+	void StartBatch(InferSlot* slot);
+	void OnInferDone(InferSlot* slot, bool ok);
+	void ParseResult(InferSlot* slot);
+	void WaitIdle();
+	void SetRequestBatch(InferRequest::Ptr& request, int count);
+	void WrapInputLayer(IDtype* input_data, std::vector<cv::Mat>& channels);
 	cv::Mat PreProcess(const cv::Mat& img);
 	void CreateMean();
-	void EmptyQueue(queue<ImageInfo>& que);
-	std::vector<cv::Mat> input_channels;
 	cv::Size input_geometry_;
-	queue<ImageInfo> imginfoque_;
-	int nbatch_index_;
 	int num_channels_;
 	int num_batch_;
 	cv::Mat mean_;
@@ -103,12 +178,26 @@ private:
 	int objectSize;
 	bool bisASync;
 	bool bLoad;
+	bool dyn_batch_;
+	std::map<std::string, std::string> plugin_config_;
+	Clock::duration batch_timeout_;
 	//-- must be global, else it will release... !!! note the sequence is important
 	InferenceEngine::InferencePlugin enginePtr;
 	InferenceEngine::CNNNetwork network_;
 	InferenceEngine::ExecutableNetwork exenet;
-	InferRequest::Ptr infer_request_curr_;
-	InferRequest::Ptr infer_request_next_;
+	// the request pool, sized once in Load() so slot pointers stay valid
+	vector<InferSlot> slots_;
+	// guards the batch being filled
+	std::mutex fill_mutex_;
+	InferSlot* filling_;
+	int batch_seq_;
+	// guards everything below, the completion callbacks run on IE threads
+	std::mutex pool_mutex_;
+	std::condition_variable pool_cond_;
+	std::deque<InferSlot*> free_slots_;
+	std::deque<InferSlot*> inflight_;  // submission order, results leave from the front
+	std::deque<DetctorResult> resultque_;
+	std::function<void()> result_callback_;
 };
 
 
@@ -19,10 +19,15 @@
 */
 
 #include "dualpipe.h"
+#include "framearena.h"
 #include <malloc.h>
 #include <unistd.h>
+#include <new>
 
-VaDualPipe::VaDualPipe()
+VaDualPipe::VaDualPipe():
+    m_policy(OVERFLOW_BLOCK),
+    m_nDropped(0),
+    m_arena(NULL)
 {
     pthread_mutex_init(&m_mutex, NULL);
     pthread_cond_init(&m_cond, NULL);
@@ -32,34 +37,72 @@ int VaDualPipe::Initialize(int nframe, int maxframesize, bufferInitFunc init)
 {
     for (int i = 0; i < nframe; i ++)
     {
-        void *data = memalign(16, maxframesize);
+        void *data = AllocBuffer(maxframesize, init);
         if (data == NULL)
         {
-            fprintf(stderr, "Error in buffer allocation\n");
             return -1;
         }
-        if (init != NULL)
-        {
-            init(data);
-        }
         m_inPipe.push_front(data);
     }
     return 0;
 }
 
+size_t VaDualPipe::BufferFootprint(int maxframesize)
+{
+    // round up, so the next buffer of an arena starts on its own cache line
+    return (VA_BUFFER_HEADER_SIZE + maxframesize + VA_BUFFER_HEADER_SIZE - 1) & ~(size_t)(VA_BUFFER_HEADER_SIZE - 1);
+}
+
+void *VaDualPipe::AllocBuffer(int maxframesize, bufferInitFunc init)
+{
+    char *base = NULL;
+    if (m_arena != NULL)
+    {
+        base = (char *)m_arena->Alloc(BufferFootprint(maxframesize), VA_BUFFER_HEADER_SIZE);
+    }
+    else
+    {
+        base = (char *)memalign(VA_BUFFER_HEADER_SIZE, VA_BUFFER_HEADER_SIZE + maxframesize);
+    }
+    if (base == NULL)
+    {
+        fprintf(stderr, "Error in buffer allocation\n");
+        return NULL;
+    }
+    void *data = base + VA_BUFFER_HEADER_SIZE;
+    BufferHeader *header = new (base) BufferHeader;
+    header->refs.store(0, std::memory_order_relaxed);
+    header->owner = this;
+    header->inArena = (m_arena != NULL);
+    if (init != NULL)
+    {
+        init(data);
+    }
+    return data;
+}
+
+void VaDualPipe::FreeBuffer(void *buffer)
+{
+    // arena memory goes with the arena
+    if (!Header(buffer)->inArena)
+    {
+        free(Header(buffer));
+    }
+}
+
 VaDualPipe::~VaDualPipe()
 {
     while(m_inPipe.size() > 0)
     {
         void *data = m_inPipe.front();
-        free(data);
+        FreeBuffer(data);
         m_inPipe.pop_front();
     }
 
     while(m_outPipe.size() > 0)
     {
         void *data = m_outPipe.front();
-        free(data);
+        FreeBuffer(data);
         m_outPipe.pop_front();
     }
     pthread_mutex_destroy(&m_mutex);
@@ -67,6 +110,54 @@ VaDualPipe::~VaDualPipe()
 }
 
 void *VaDualPipe::Get()
+{
+    void *buffer = GetFree(m_policy == OVERFLOW_BLOCK);
+
+    if (buffer == NULL && m_policy == OVERFLOW_DROP_NEWEST)
+    {
+        m_nDropped.fetch_add(1, std::memory_order_relaxed);
+        return NULL;
+    }
+
+    if (buffer == NULL)
+    {
+        // OVERFLOW_DROP_OLDEST: the consumer is behind, recycle the stalest
+        // frame. A queued frame holds the only reference, so it can be reused
+        buffer = LoadNoWait();
+        if (buffer != NULL)
+        {
+            m_nDropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            // all buffers are held by the consumer, nothing to drop
+            buffer = GetFree(true);
+        }
+    }
+    Header(buffer)->refs.store(1, std::memory_order_relaxed);
+    return buffer;
+}
+
+void VaDualPipe::AddRef(void *buffer)
+{
+    Header(buffer)->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void VaDualPipe::Release(void *buffer)
+{
+    Header(buffer)->owner->Put(buffer);
+}
+
+void VaDualPipe::Put(void *buffer)
+{
+    // the last consumer must see every write of the others before recycling
+    if (Header(buffer)->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        Recycle(buffer);
+    }
+}
+
+void *VaDualPipe::GetFree(bool wait)
 {
     void *buffer = NULL;
     do
@@ -80,6 +171,10 @@ void *VaDualPipe::Get()
         else
         {
             pthread_mutex_unlock(&m_mutex);
+            if (!wait)
+            {
+                return NULL;
+            }
             usleep(500);
         }
     } while (buffer == NULL);
@@ -87,7 +182,7 @@ void *VaDualPipe::Get()
     return buffer;
 }
 
-void VaDualPipe::Put(void *buffer)
+void VaDualPipe::Recycle(void *buffer)
 {
     pthread_mutex_lock(&m_mutex);
     m_inPipe.push_front(buffer);
@@ -23,22 +23,82 @@
 
 #include <pthread.h>
 #include <list>
+#include <atomic>
 #include <stdio.h>
+#include <stddef.h>
 
+class VaFrameArena;
+
+// Every buffer is preceded by a header of this size, so buffers stay aligned
+#define VA_BUFFER_HEADER_SIZE 64
+
+// Buffers are reference counted: Get() hands out a buffer with one reference,
+// Store() and Load() pass that reference on and Put() drops it. The buffer
+// returns to the free list with the last reference, so a consumer may AddRef()
+// a frame to share it with further stages instead of copying it.
 class VaDualPipe
 {
-typedef void (*bufferInitFunc)(void *);
 public:
+    typedef void (*bufferInitFunc)(void *);
+
+    // What Get() does when every buffer is queued and none is free:
+    // BLOCK waits for the consumer, DROP_OLDEST recycles the oldest queued
+    // frame and DROP_NEWEST returns NULL so the caller skips the new frame.
+    enum OverflowPolicy
+    {
+        OVERFLOW_BLOCK       = 0,
+        OVERFLOW_DROP_OLDEST = 1,
+        OVERFLOW_DROP_NEWEST = 2
+    };
+
     VaDualPipe();
-    ~VaDualPipe();
-    int Initialize(int nframe, int maxframesize, bufferInitFunc init = NULL);
+    virtual ~VaDualPipe();
+    // Carve the buffers of Initialize() from arena instead of the heap. The
+    // arena has to outlive the pipe
+    void SetArena(VaFrameArena *arena) { m_arena = arena; }
+    virtual int Initialize(int nframe, int maxframesize, bufferInitFunc init = NULL);
     void *Get();
     void Put(void *buffer);
-    void *Load(const timespec *abstime);
-    void *LoadNoWait();
-    void Store(void *buffer);
+    virtual void *Load(const timespec *abstime);
+    virtual void *LoadNoWait();
+    virtual void Store(void *buffer);
+
+    void SetOverflowPolicy(OverflowPolicy policy) { m_policy = policy; }
+    OverflowPolicy GetOverflowPolicy() const { return m_policy; }
+    // Number of frames dropped by the overflow policy so far
+    unsigned long GetDroppedFrames() const { return m_nDropped.load(std::memory_order_relaxed); }
+
+    // Take one more reference of a buffer from any pipe
+    static void AddRef(void *buffer);
+    // Drop a reference of a buffer from any pipe, like Put() on its owner
+    static void Release(void *buffer);
+    // Bytes one buffer of maxframesize takes in an arena, header included
+    static size_t BufferFootprint(int maxframesize);
 
 protected:
+    struct BufferHeader
+    {
+        std::atomic<int> refs;
+        VaDualPipe *owner;
+        bool inArena;
+    };
+
+    static BufferHeader *Header(void *buffer)
+    {
+        return (BufferHeader *)((char *)buffer - VA_BUFFER_HEADER_SIZE);
+    }
+    void *AllocBuffer(int maxframesize, bufferInitFunc init);
+    static void FreeBuffer(void *buffer);
+
+    // Take a free buffer, waits for one when wait is true
+    virtual void *GetFree(bool wait);
+    // Return a buffer without references to the free list
+    virtual void Recycle(void *buffer);
+
+    OverflowPolicy m_policy;
+    std::atomic<unsigned long> m_nDropped;
+    VaFrameArena *m_arena;
+
     std::list<void *> m_inPipe;
     std::list<void *> m_outPipe;
 
@@ -46,4 +106,55 @@ protected:
     pthread_cond_t m_cond;
 };
 
+// Shared reference to a pipe buffer, the buffer returns to its pipe when the
+// last handle lets go of it
+class VaFrameHandle
+{
+public:
+    VaFrameHandle(): m_buffer(NULL) {}
+    // Adopts the reference the caller holds, e.g. the one from Load()
+    explicit VaFrameHandle(void *buffer): m_buffer(buffer) {}
+    VaFrameHandle(const VaFrameHandle &other): m_buffer(other.m_buffer)
+    {
+        if (m_buffer != NULL)
+        {
+            VaDualPipe::AddRef(m_buffer);
+        }
+    }
+    VaFrameHandle(VaFrameHandle &&other): m_buffer(other.m_buffer)
+    {
+        other.m_buffer = NULL;
+    }
+    ~VaFrameHandle() { Reset(); }
+
+    VaFrameHandle &operator=(VaFrameHandle other)
+    {
+        void *buffer = m_buffer;
+        m_buffer = other.m_buffer;
+        other.m_buffer = buffer;
+        return *this;
+    }
+
+    void Reset()
+    {
+        if (m_buffer != NULL)
+        {
+            VaDualPipe::Release(m_buffer);
+            m_buffer = NULL;
+        }
+    }
+    // Hands the reference back to the caller, e.g. to Store() the buffer
+    void *Detach()
+    {
+        void *buffer = m_buffer;
+        m_buffer = NULL;
+        return buffer;
+    }
+    void *Get() const { return m_buffer; }
+    explicit operator bool() const { return m_buffer != NULL; }
+
+protected:
+    void *m_buffer;
+};
+
 #endif
@@ -0,0 +1,140 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+/*
+// brief Micro benchmark of the VaDualPipe backends
+//
+// A producer thread plays the decoder (Get -> Store) and a consumer thread
+// plays the scheduler (Load -> Put). Reports throughput and the hand-off
+// latency from Store() to Load().
+//
+// usage: dualpipe_bench [frames] [pipe depth]
+*/
+
+#include "dualpipe.h"
+#include "ringpipe.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+struct bench_frame_t
+{
+    uint64_t storeTs;
+    int frameno;
+};
+
+struct BenchConfig
+{
+    VaDualPipe *pipe;
+    int nFrames;
+    std::vector<uint64_t> latency;
+};
+
+static uint64_t now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *producer(void *arg)
+{
+    BenchConfig *config = (BenchConfig *)arg;
+    for (int i = 0; i < config->nFrames; i ++)
+    {
+        bench_frame_t *frame = (bench_frame_t *)config->pipe->Get();
+        frame->frameno = i;
+        frame->storeTs = now_ns();
+        config->pipe->Store(frame);
+    }
+    return NULL;
+}
+
+static void *consumer(void *arg)
+{
+    BenchConfig *config = (BenchConfig *)arg;
+    for (int i = 0; i < config->nFrames; i ++)
+    {
+        bench_frame_t *frame = (bench_frame_t *)config->pipe->Load(NULL);
+        config->latency[i] = now_ns() - frame->storeTs;
+        if (frame->frameno != i)
+        {
+            fprintf(stderr, "out of order frame %d, expected %d\n", frame->frameno, i);
+            exit(1);
+        }
+        config->pipe->Put(frame);
+    }
+    return NULL;
+}
+
+static void run(const char *name, VaDualPipe *pipe, int nFrames, int depth)
+{
+    BenchConfig config;
+    config.pipe = pipe;
+    config.nFrames = nFrames;
+    config.latency.resize(nFrames);
+
+    if (pipe->Initialize(depth, sizeof(bench_frame_t)) != 0)
+    {
+        fprintf(stderr, "%s: pipe initialization failed\n", name);
+        return;
+    }
+
+    pthread_t prod, cons;
+    uint64_t start = now_ns();
+    pthread_create(&cons, NULL, consumer, &config);
+    pthread_create(&prod, NULL, producer, &config);
+    pthread_join(prod, NULL);
+    pthread_join(cons, NULL);
+    uint64_t elapsed = now_ns() - start;
+
+    std::sort(config.latency.begin(), config.latency.end());
+    printf("%-12s %10.1f Kframes/s   latency p50 %8.2f us  p99 %8.2f us  max %10.2f us\n",
+           name, nFrames * 1000000.0 / elapsed,
+           config.latency[nFrames / 2] / 1000.0,
+           config.latency[(size_t)(nFrames * 0.99)] / 1000.0,
+           config.latency[nFrames - 1] / 1000.0);
+}
+
+int main(int argc, char **argv)
+{
+    int nFrames = (argc > 1) ? atoi(argv[1]) : 1000000;
+    int depth = (argc > 2) ? atoi(argv[2]) : 100;
+    if (nFrames <= 0 || depth <= 0)
+    {
+        fprintf(stderr, "usage: %s [frames] [pipe depth]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%d frames, pipe depth %d\n", nFrames, depth);
+
+    VaDualPipe *mutexPipe = new VaDualPipe();
+    run("mutex+list", mutexPipe, nFrames, depth);
+    delete mutexPipe;
+
+    VaDualPipe *spscPipe = new VaRingPipe(VaRingPipe::RING_SPSC);
+    run("ring spsc", spscPipe, nFrames, depth);
+    delete spscPipe;
+
+    VaDualPipe *mpmcPipe = new VaRingPipe(VaRingPipe::RING_MPMC);
+    run("ring mpmc", mpmcPipe, nFrames, depth);
+    delete mpmcPipe;
+
+    return 0;
+}
@@ -61,6 +61,9 @@ using namespace std;
 #endif
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/opencv.hpp>
+#if defined(HAVE_AVX2) || defined(HAVE_AVX512F)
+#include <immintrin.h>
+#endif
 #ifndef max
 #define max(a,b)            (((a) > (b)) ? (a) : (b))
 #endif
@@ -74,47 +77,185 @@ using namespace std;
 // Getting feature map for the selected subimage
 //
 // API
-// int getFeatureMaps(const IplImage * image, const int k, featureMap **map);
+// int getFeatureMaps(const IplImage * image, const int k, featureMap **map,
+//                    CvLSVMFeatureScratch *scratch);
 // INPUT
 // image             - selected subimage
 // k                 - size of cells
+// scratch           - per pixel buffers kept between calls, NULL for temporary ones
 // OUTPUT
 // map               - feature map
 // RESULT
 // Error status
 */
 
-static unsigned int nframes=0;
-static unsigned int bCapture = false;
-int getFeatureMaps(const IplImage* image, const int k, CvLSVMFeatureMapCaskade **map)
+// Gradient of the channel with the largest magnitude, the magnitude and the
+// two orientation bins of the pixels 1 .. width - 2 of row j. The sector is
+// the one whose boundary has the largest dot product with the gradient, of
+// either sign; the vector paths make the NUM_SECTOR comparisons for a whole
+// register of pixels at once, in the order of the scalar code, so they pick
+// the same bins
+static void gradientRow(const float *planes, int width, int height, int numChannels, int j,
+                        const float *boundary_x, const float *boundary_y,
+                        float *r, int *alfa0, int *alfa1)
+{
+    int planeSize = width * height;
+    int i = 1;
+#if defined(HAVE_AVX512F)
+    const __m512i sign = _mm512_set1_epi32(0x80000000);
+    for (; i + 16 <= width - 1; i += 16)
+    {
+        __m512 x, y, best;
+        for (int ch = 0; ch < numChannels; ch++)
+        {
+            const float *p = planes + ch * planeSize + j * width + i;
+            __m512 tx = _mm512_sub_ps(_mm512_loadu_ps(p + 1), _mm512_loadu_ps(p - 1));
+            __m512 ty = _mm512_sub_ps(_mm512_loadu_ps(p + width), _mm512_loadu_ps(p - width));
+            __m512 magnitude = _mm512_sqrt_ps(_mm512_add_ps(_mm512_mul_ps(tx, tx), _mm512_mul_ps(ty, ty)));
+            if (ch == 0)
+            {
+                best = magnitude;
+                x = tx;
+                y = ty;
+                continue;
+            }
+            __mmask16 gt = _mm512_cmp_ps_mask(magnitude, best, _CMP_GT_OQ);
+            best = _mm512_mask_blend_ps(gt, best, magnitude);
+            x = _mm512_mask_blend_ps(gt, x, tx);
+            y = _mm512_mask_blend_ps(gt, y, ty);
+        }
+
+        __m512 max = _mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(boundary_x[0]), x),
+                                   _mm512_mul_ps(_mm512_set1_ps(boundary_y[0]), y));
+        __m512i maxi = _mm512_setzero_si512();
+        for (int kk = 0; kk < NUM_SECTOR; kk++)
+        {
+            __m512 dotProd = _mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(boundary_x[kk]), x),
+                                           _mm512_mul_ps(_mm512_set1_ps(boundary_y[kk]), y));
+            __m512 negProd = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(dotProd), sign));
+            __mmask16 gt = _mm512_cmp_ps_mask(dotProd, max, _CMP_GT_OQ);
+            __mmask16 ngt = _mm512_kandn(gt, _mm512_cmp_ps_mask(negProd, max, _CMP_GT_OQ));
+            max = _mm512_mask_blend_ps(gt, max, dotProd);
+            max = _mm512_mask_blend_ps(ngt, max, negProd);
+            maxi = _mm512_mask_blend_epi32(gt, maxi, _mm512_set1_epi32(kk));
+            maxi = _mm512_mask_blend_epi32(ngt, maxi, _mm512_set1_epi32(kk + NUM_SECTOR));
+        }
+        __mmask16 upper = _mm512_cmp_epi32_mask(maxi, _mm512_set1_epi32(NUM_SECTOR - 1), _MM_CMPINT_NLE);
+        _mm512_storeu_ps(r + j * width + i, best);
+        _mm512_storeu_si512((void *)(alfa0 + j * width + i),
+                            _mm512_mask_sub_epi32(maxi, upper, maxi, _mm512_set1_epi32(NUM_SECTOR)));
+        _mm512_storeu_si512((void *)(alfa1 + j * width + i), maxi);
+    }
+#elif defined(HAVE_AVX2)
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    for (; i + 8 <= width - 1; i += 8)
+    {
+        __m256 x, y, best;
+        for (int ch = 0; ch < numChannels; ch++)
+        {
+            const float *p = planes + ch * planeSize + j * width + i;
+            __m256 tx = _mm256_sub_ps(_mm256_loadu_ps(p + 1), _mm256_loadu_ps(p - 1));
+            __m256 ty = _mm256_sub_ps(_mm256_loadu_ps(p + width), _mm256_loadu_ps(p - width));
+            __m256 magnitude = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(tx, tx), _mm256_mul_ps(ty, ty)));
+            if (ch == 0)
+            {
+                best = magnitude;
+                x = tx;
+                y = ty;
+                continue;
+            }
+            __m256 gt = _mm256_cmp_ps(magnitude, best, _CMP_GT_OQ);
+            best = _mm256_blendv_ps(best, magnitude, gt);
+            x = _mm256_blendv_ps(x, tx, gt);
+            y = _mm256_blendv_ps(y, ty, gt);
+        }
+
+        // the bins are small integers, exact as floats
+        __m256 max = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(boundary_x[0]), x),
+                                   _mm256_mul_ps(_mm256_set1_ps(boundary_y[0]), y));
+        __m256 maxi = _mm256_setzero_ps();
+        for (int kk = 0; kk < NUM_SECTOR; kk++)
+        {
+            __m256 dotProd = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(boundary_x[kk]), x),
+                                           _mm256_mul_ps(_mm256_set1_ps(boundary_y[kk]), y));
+            __m256 negProd = _mm256_xor_ps(dotProd, sign);
+            __m256 gt = _mm256_cmp_ps(dotProd, max, _CMP_GT_OQ);
+            __m256 ngt = _mm256_andnot_ps(gt, _mm256_cmp_ps(negProd, max, _CMP_GT_OQ));
+            max = _mm256_blendv_ps(max, dotProd, gt);
+            max = _mm256_blendv_ps(max, negProd, ngt);
+            maxi = _mm256_blendv_ps(maxi, _mm256_set1_ps((float)kk), gt);
+            maxi = _mm256_blendv_ps(maxi, _mm256_set1_ps((float)(kk + NUM_SECTOR)), ngt);
+        }
+        __m256 upper = _mm256_cmp_ps(maxi, _mm256_set1_ps((float)NUM_SECTOR), _CMP_GE_OQ);
+        __m256 folded = _mm256_sub_ps(maxi, _mm256_and_ps(upper, _mm256_set1_ps((float)NUM_SECTOR)));
+        _mm256_storeu_ps(r + j * width + i, best);
+        _mm256_storeu_si256((__m256i *)(alfa0 + j * width + i), _mm256_cvttps_epi32(folded));
+        _mm256_storeu_si256((__m256i *)(alfa1 + j * width + i), _mm256_cvttps_epi32(maxi));
+    }
+#endif
+    for (; i < width - 1; i++)
+    {
+        const float *p = planes + j * width + i;
+        float x = p[1] - p[-1];
+        float y = p[width] - p[-width];
+        float best = sqrtf(x * x + y * y);
+        for (int ch = 1; ch < numChannels; ch++)
+        {
+            p = planes + ch * planeSize + j * width + i;
+            float tx = p[1] - p[-1];
+            float ty = p[width] - p[-width];
+            float magnitude = sqrtf(tx * tx + ty * ty);
+            if (magnitude > best)
+            {
+                best = magnitude;
+                x = tx;
+                y = ty;
+            }
+        }
+
+        float max = boundary_x[0] * x + boundary_y[0] * y;
+        int maxi = 0;
+        for (int kk = 0; kk < NUM_SECTOR; kk++)
+        {
+            float dotProd = boundary_x[kk] * x + boundary_y[kk] * y;
+            if (dotProd > max)
+            {
+                max  = dotProd;
+                maxi = kk;
+            }
+            else if (-dotProd > max)
+            {
+                max  = -dotProd;
+                maxi = kk + NUM_SECTOR;
+            }
+        }
+        r[j * width + i] = best;
+        alfa0[j * width + i] = maxi % NUM_SECTOR;
+        alfa1[j * width + i] = maxi;
+    }
+}
+
+int getFeatureMaps(const IplImage* image, const int k, CvLSVMFeatureMapCaskade **map,
+                   CvLSVMFeatureScratch *scratch)
 {
     int sizeX, sizeY;
-    int p, px, stringSize;
+    int p, stringSize;
     int height, width, numChannels;
-    int i, j, kk, c, ii, jj, d;
-    float  * datadx, * datady;
-    
-    int   ch; 
-    float magnitude, x, y, tx, ty;
-    
-    IplImage * dx, * dy;
-    int *nearest;
-    float *w, a_x, b_x;
-
-    float kernel[3] = {-1.f, 0.f, 1.f};
-    CvMat kernel_dx = cvMat(1, 3, CV_32F, kernel);
-    CvMat kernel_dy = cvMat(3, 1, CV_32F, kernel);
+    int i, j, ii, jj, d;
+    float a_x, b_x;
 
-    float * r;
-    int   * alfa;
-    
     float boundary_x[NUM_SECTOR + 1];
     float boundary_y[NUM_SECTOR + 1];
-    float max, dotProd;
-    int   maxi;
+
+    CvLSVMFeatureScratch temporary;
+    if (scratch == NULL)
+    {
+        scratch = &temporary;
+    }
 
     height = image->height;
     width  = image->width ;
+    numChannels = image->nChannels;
     float arg_vector;
     for(i = 0; i <= NUM_SECTOR; i++)
     {
@@ -123,10 +264,19 @@ int getFeatureMaps(const IplImage* image, const int k, CvLSVMFeatureMapCaskade *
         boundary_y[i] = sinf(arg_vector);
     }/*for(i = 0; i <= NUM_SECTOR; i++) */
 
-    r    = (float *)malloc( sizeof(float) * (width * height));
-    alfa = (int   *)malloc( sizeof(int  ) * (width * height * 2));
-    nearest = (int  *)malloc(sizeof(int  ) *  k);
-    w       = (float*)malloc(sizeof(float) * (k * 2));
+    // the buffers only grow, a tracker keeps its template size
+    scratch->planes.resize(width * height * numChannels);
+    scratch->r.resize(width * height);
+    scratch->alfa.resize(width * height * 2);
+    scratch->nearest.resize(k);
+    scratch->w.resize(k * 2);
+    float *planes = &scratch->planes[0];
+    float *r      = &scratch->r[0];
+    int   *alfa0  = &scratch->alfa[0];
+    int   *alfa1  = alfa0 + width * height;
+    int   *nearest = &scratch->nearest[0];
+    float *w       = &scratch->w[0];
+
     for(i = 0; i < k / 2; i++)
     {
         nearest[i] = -1;
@@ -151,539 +301,85 @@ int getFeatureMaps(const IplImage* image, const int k, CvLSVMFeatureMapCaskade *
         w[j * 2 + 1] = 1.0f/b_x * ((a_x * b_x) / ( a_x + b_x));  
     }/*for(j = k / 2; j < k; j++)*/
 
-
-    	
-#if 1
-    IplImage *blue_img = cvCreateImage( cvGetSize(image),IPL_DEPTH_32F,1 );
-    IplImage *green_img = cvCreateImage( cvGetSize(image),IPL_DEPTH_32F,1 );
-    IplImage *red_img = cvCreateImage(cvGetSize(image),IPL_DEPTH_32F,1 );
-    IplImage *all_img = cvCreateImage( cvGetSize(image),IPL_DEPTH_32F,3 );
-
-
-    IplImage *blue_img0 = cvCreateImage( cvGetSize(image),IPL_DEPTH_8U,1 );
-    IplImage *green_img0 = cvCreateImage( cvGetSize(image),IPL_DEPTH_8U,1 );
-    IplImage *red_img0 = cvCreateImage(cvGetSize(image),IPL_DEPTH_8U,1 );
- #endif
-        CvSize size(height+2, width+2);
-#if 1
-    // three channels
-    nframes++;
-    if(nframes == 300){
-       bCapture = true;
-    }
-    if(nframes > 300){
-       bCapture = false;
-    }
-    std::cout<<" num of channels:"<< image->nChannels << "  kernel size="<< k <<std::endl;
-    std::cout<<" height: "<< height << "  width="<< width <<std::endl;
-
-    if(bCapture){
-        char szBuffer[250]={0}; 
-        sprintf(szBuffer, "width=%d, height=%d", width, height);
-	FILE *fpTemp = fopen("./dump.info", "w+t");
-	if(NULL!= fpTemp)
-	{
-	       fwrite(szBuffer, 1, strlen(szBuffer), fpTemp);
-	       fclose(fpTemp);
-	}
-    }
-    //DUMP INPUT
-    unsigned char * img_origR = new unsigned char[height * width];
-    unsigned char * img_origG = new unsigned char[height * width];
-    unsigned char * img_origB = new unsigned char[height * width];
-    unsigned char *pRawImage;
-    for (int x = 0; x < height; ++x) {
-        pRawImage = (unsigned char*)(image->imageData + image->widthStep * (x));
-        for (int y = 0; y < width; ++y) {
-           img_origR[x*width + y] = pRawImage[(y)*3 + 0];
-           img_origG[x*width + y] = pRawImage[(y)*3 + 1]; 
-           img_origB[x*width + y] = pRawImage[(y)*3 + 2];
-        }
-    }
-    if(bCapture){
-	    FILE *fpR = fopen("./R.data", "w+b");
-	    if(NULL!= fpR)
-	    {
-	       fwrite(img_origR, 1, height*width, fpR);
-	       fclose(fpR);
-	    }
-	    FILE *fpG = fopen("./G.data", "w+b");
-	    if(NULL!= fpG)
-	    {
-	       fwrite(img_origG, 1, height*width, fpG);
-	       fclose(fpG);
-	    }
-	    FILE *fpB = fopen("./B.data", "w+b");
-	    if(NULL!= fpB)
-	    {
-	       fwrite(img_origB, 1, height*width, fpB);
-	       fclose(fpB);
-	    }
-    }
-    //END OF DUMP INPUT
-    float * img_origR1 = new float[(height+2)*(width+2)];
-    float * img_origG1 = new float[(height+2)*(width+2)];
-    float * img_origB1 = new float[(height+2)*(width+2)];
- 
-    for (int x = 1; x < height+1; ++x) {
-        pRawImage = (unsigned char*)(image->imageData + image->widthStep * (x-1));
-        for (int y = 1; y < width+1; ++y) {
-           //img_origR1[x*(width+2) + y] = image->imageData[(x-1)*(width*3) + 3*(y-1)];
-           //img_origG1[x*(width+2) + y] = image->imageData[(x-1)*(width*3) + 3*(y-1) + 1]; 
-           //img_origB1[x*(width+2) + y] = image->imageData[(x-1)*(width*3) + 3*(y-1) + 2];
-           img_origR1[x*(width+2) + y] = pRawImage[(y-1)*3 + 0];
-           img_origG1[x*(width+2) + y] = pRawImage[(y-1)*3 + 1]; 
-           img_origB1[x*(width+2) + y] = pRawImage[(y-1)*3 + 2];
-        }
-    }
-
-
-    // Padding
-    for (int x = 0; x < 1; ++x) {
-        for (int y = 1; y < width+1; ++y) {
-           img_origR1[ y] = img_origR1[(x+1)*(width+2) + y];
-           img_origG1[ y] = img_origG1[(x+1)*(width+2) + y]; 
-           img_origB1[ y] = img_origB1[(x+1)*(width+2) + y];
-        }
-    }
-    for (int x = height+1; x < height+2; ++x) {
-        for (int y = 0; y < width+1; ++y) {
-           img_origR1[x*(width+2) + y] = img_origR1[(x-1)*(width+2) + y];
-           img_origG1[x*(width+2) + y] = img_origG1[(x-1)*(width+2) + y]; 
-           img_origB1[x*(width+2) + y] = img_origB1[(x-1)*(width+2) + y];
-        }
-    }
-
-    for (int x = 0; x < height+1; ++x) {
-        for (int y = 0; y < 1; ++y) {
-           img_origR1[x*(width+2) + y] = img_origR1[x*(width+2) + y+1];
-           img_origG1[x*(width+2) + y] = img_origG1[x*(width+2) + y+1]; 
-           img_origB1[x*(width+2) + y] = img_origB1[x*(width+2) + y+1];
-        }
-    }
-    for (int x = 0; x < height+1; ++x) {
-        for (int y = width+1; y < width+2; ++y) {
-           img_origR1[x*(width+2) + y] = img_origR1[x*(width+2) + y-1];
-           img_origG1[x*(width+2) + y] = img_origG1[x*(width+2) + y-1]; 
-           img_origB1[x*(width+2) + y] = img_origB1[x*(width+2) + y-1];
-        }
-    }
-
-    img_origR1[0] = img_origR1[width+2 + 1];
-    img_origG1[0] = img_origG1[width+2 + 1];
-    img_origB1[0] = img_origB1[width+2 + 1];
-
-    img_origR1[width+1] = img_origR1[2*(width+2) -2];
-    img_origG1[width+1] = img_origG1[2*(width+2) -2];
-    img_origB1[width+1] = img_origB1[2*(width+2) -2];
-
-    img_origR1[(width+2)*(height+1)] = img_origR1[(width+2)*(height) + 1];
-    img_origG1[(width+2)*(height+1)] = img_origG1[(width+2)*(height) + 1];
-    img_origB1[(width+2)*(height+1)] = img_origB1[(width+2)*(height) + 1];
-
-    img_origR1[(width+2)*(height+1) + width+1] = img_origR1[(width+2)*(height) + width];
-    img_origG1[(width+2)*(height+1) + width+1] = img_origG1[(width+2)*(height) + width];
-    img_origB1[(width+2)*(height+1) + width+1] = img_origB1[(width+2)*(height) + width];
-    std::chrono::high_resolution_clock::time_point tmStart;
-    std::chrono::high_resolution_clock::time_point tmEnd;
-    tmStart = std::chrono::high_resolution_clock::now();
-    vector<float> R;
-    for(int row=1; row< height+1; row++)
-      for(int col=1; col< width+1; col++)
-       {
-             float a=0.0f;
-             for(int m=0; m< 3; m++) 
-              {
-                  a+=kernel[m]*img_origR1[row*(width+2)+col + m -1];
-              }
-             R.push_back(a);
-       }
-    vector<float> G;
-    for(int row=1; row< height+1; row++)
-      for(int col=1; col< width+1; col++)
-       {
-             float a=0.0f;
-             for(int m=0; m< 3; m++) 
-              {
-                  a+=kernel[m]*img_origG1[row*(width+2)+col + m -1];
-              }
-             G.push_back(a);
-       }
-    vector<float> B;
-    for(int row=1; row< height+1; row++){
-      for(int col=1; col< width+1; col++)
-       {
-             float a=0.0f;
-             for(int m=0; m< 3; m++) 
-              { 
-                  a+=kernel[m]*img_origB1[row*(width+2)+col + m -1];
-              }
- //printf("ddd%f, %f, %f,  a=%f ", img_origB1[row*(width+2)+col  -1],img_origB1[row*(width+2)+col  ],img_origB1[row*(width+2)+col  +1],a);
-
-             B.push_back(a);
-       }
-     //  printf("\r\n");
-    }
-
- 
-
-    vector<float> R1;
-    for(int row=1; row< height+1; row++)
-      for(int col=1; col< width+1; col++)
-       {
-             float a=0.0f;
-             for(int m=0; m< 3; m++) 
-              {
-                  a+=kernel[m]*img_origR1[(row+m-1)*(width+2)+col ];
-              }
-             R1.push_back(a);
-       }
-    vector<float> G1;
-    for(int row=1; row< height+1; row++)
-      for(int col=1; col< width+1; col++)
-       {
-             float a=0.0f;
-             for(int m=0; m< 3; m++) 
-              {
-                  a+=kernel[m]*img_origG1[(row+m-1)*(width+2)+col ];
-              }
-             G1.push_back(a);
-       }
-    vector<float> B1;
-    for(int row=1; row< height+1; row++)
-      for(int col=1; col< width+1; col++)
-       {
-             float a=0.0f;
-             for(int m=0; m< 3; m++) 
-              {
-                  a+=kernel[m]*img_origB1[(row+m-1)*(width+2)+col];
-              }
-             B1.push_back(a);
-       }
-
-#endif
-
-    numChannels = image->nChannels;
-
-    dx    = cvCreateImage(cvSize(image->width, image->height), 
-                          IPL_DEPTH_32F, 3);
-
-    dy    = cvCreateImage(cvSize(image->width, image->height), 
-                          IPL_DEPTH_32F, 3);
-
-    sizeX = width  / k;
-    sizeY = height / k;
-    px    = 3 * NUM_SECTOR; 
-    p     = px;
-    stringSize = sizeX * p;
-    allocFeatureMapObject(map, sizeX, sizeY, p);
-#if 0
-   unsigned char *pData;
-   printf("dump raw  R image data 8x8\r\n");
-   for(j = 0; j < 8 ; j++)
-    {
-        pData = (unsigned char*)(image->imageData + image->widthStep * j);
-        for(i = width-8; i < width ; i++)
-        {
-          printf("%d ", pData[i*3 +0]);
-        }
-          printf("\r\n");
-     }
-   printf("dump raw G image data 8x8\r\n");
-   for(j = 0; j < 8 ; j++)
-    {
-        pData = (unsigned char*)(image->imageData + image->widthStep * j);
-          for(i = width-8; i < width ; i++)
-        {
-          printf("%d ", pData[i*3 +1]);
-        }
-          printf("\r\n");
-     }
-
-   printf("dump raw B image data 8x8\r\n");
-   for(j = 0; j < 8 ; j++)
-    {
-        pData = (unsigned char*)(image->imageData + image->widthStep * j);
-          for(i = width-8; i < width ; i++)
-        {
-          printf("%d ", pData[i*3 +2]);
-        }
-          printf("\r\n");
-     }
-   float *pTemp;
-   printf("dump float B channel\r\n");
-   for(j =1; j < 9 ; j++)
-    {
-
-          for(i = width-6; i < width+2 ; i++)
-        {
-          printf("%d ", int(img_origB1[j*(width+2) + i]));
-        }
-              printf("\r\n");   
-     }
-#endif
-    //Ben: Convolution 1*3 or 3*1
-    //cvFilter2D(image, all_img, &kernel_dy, cvPoint(-1, 0));
-    //cvFilter2D(image, dy, &kernel_dy, cvPoint(0, -1));      
-#if 0    
-    float *pDataRe;
-    printf("dump raw all_img from SW data 8x8\r\n");
-    for(j = 0; j < height ; j++)
-    {
-        pDataRe = (float *)(all_img->imageData + all_img->widthStep * j);
-       
-         for(i = width-8; i < width ; i++)
-        {
-          printf("%f ", pDataRe[i*3+2]);
-        }
-          printf("\r\n");
-    }
-#endif
-    float* r0;
+    // One float plane per channel, so the {-1, 0, 1} gradients are plain
+    // vector loads. Only the inner pixels reach the histograms, their
+    // neighbours are always inside the image
     for(j = 0; j < height; j++)
     {
-        r0 = (float*)(dx->imageData + dx->widthStep * j);
-        for(i = 0; i < width; i++)
-        {
-          r0[i*3+0 ] = R[j*(width) + i];
-          r0[i*3+1] =  G[j*(width) + i];
-          r0[i*3+2] =  B[j*(width) + i];
-        }
-     }
-
-
-    for(j = 0; j < height; j++)
-    {
-        r0 = (float*)(dy->imageData + dy->widthStep * j);
-    
-        for(i = 0; i < width; i++)
+        const unsigned char *row = (const unsigned char *)(image->imageData + image->widthStep * j);
+        for(int ch = 0; ch < numChannels; ch++)
         {
-          r0[i*3+0 ] = R1[j*(width) + i];
-          r0[i*3+1]  = G1[j*(width)  + i];
-          r0[i*3+2]  = B1[j*(width)  + i];
-        }
-     }
-
-#if 0
-   float *pDataRe2;
-   float *pDataRe3;
-   printf("dump raw dx from SW data 8x8\r\n");
-   for(j = 0; j < height ; j++)
-   {
-        pDataRe2 = (float *)(dx->imageData + dx->widthStep * j);
-       // pDataRe3 = (float *)(all_img->imageData + all_img->widthStep * j);
-          for(i = width-8; i < width ; i++)
-        {
-          printf("%f ", pDataRe2[i*3+2]);
-        }
-          printf("\r\n");
-   }
-
-	//cvSplit(image,blue_img,green_img,red_img,0);
-	//cvMerge(red_img,green_img,blue_img,0,dx);                                                                                                                                                                                                                                                                                                                                
-	cvNamedWindow("hello",CV_WINDOW_AUTOSIZE);
-	cvShowImage("dx image",all_img);
-	cvShowImage("yyhello",dy);
-	cvWaitKey(0);
-#endif
-
-    // DUMP output of convolution
-    float * img_convR = new float[height * width];
-    float * img_convG = new float[height * width];
-    float * img_convB = new float[height * width];
-   
-    for (int x = 0; x < height; ++x) {
-        pRawImage = (unsigned char*)(dx->imageData + dx->widthStep * (x));
-        for (int y = 0; y < width; ++y) {
-           img_convR[x*(width) + y] = pRawImage[(y)*3 + 0];
-           img_convG[x*(width) + y] = pRawImage[(y)*3 + 1]; 
-           img_convB[x*(width) + y] = pRawImage[(y)*3 + 2];
-        }
-    }
- if(bCapture){
-    FILE *fpRconv = fopen("./Rconvdx.data", "w+b");
-    if(NULL!= fpRconv)
-    {
-       fwrite(img_convR, sizeof(float), height*width, fpRconv);
-       fclose(fpRconv);
-    }
-    FILE *fpGconv = fopen("./Gconvdx.data", "w+b");
-    if(NULL!= fpGconv)
-    {
-       fwrite(img_convG, sizeof(float), height*width, fpGconv);
-       fclose(fpGconv);
-    }
-    FILE *fpBconv = fopen("./Bconvdx.data", "w+b");
-    if(NULL!= fpBconv)
-    {
-       fwrite(img_convB, sizeof(float), height*width, fpBconv);
-       fclose(fpBconv);
-    }
-}
-   for (int x = 0; x < height; ++x) {
-        pRawImage = (unsigned char*)(dy->imageData + dy->widthStep * (x));
-        for (int y = 0; y < width; ++y) {
-           img_convR[x*(width) + y] = pRawImage[(y)*3 + 0];
-           img_convG[x*(width) + y] = pRawImage[(y)*3 + 1]; 
-           img_convB[x*(width) + y] = pRawImage[(y)*3 + 2];
+            float *plane = planes + ch * width * height + j * width;
+            for(i = 0; i < width; i++)
+            {
+                plane[i] = (float)row[i * numChannels + ch];
+            }
         }
     }
- if(bCapture){ 
-   FILE * fpRconv = fopen("./Rconvdy.data", "w+b");
-    if(NULL!= fpRconv)
-    {
-       fwrite(img_convR, sizeof(float), height*width, fpRconv);
-       fclose(fpRconv);
-    }
-    FILE *fpGconv = fopen("./Gconvdy.data", "w+b");
-    if(NULL!= fpGconv)
-    {
-       fwrite(img_convG, sizeof(float), height*width, fpGconv);
-       fclose(fpGconv);
-    }
-   FILE * fpBconv = fopen("./Bconvdy.data", "w+b");
-    if(NULL!= fpBconv)
-    {
-       fwrite(img_convB, sizeof(float), height*width, fpBconv);
-       fclose(fpBconv);
-    }
-}
-
-  //  std::cout<< "  >getFeatures part2 width:" << width << "height" << height<<"num of channel"<<numChannels <<" k="<<k<<" widthStep="<<dx->widthStep<<" sizeY="<<sizeY<<" sizeX="<<sizeX<<std::endl;
     for(j = 1; j < height - 1; j++)
     {
-        datadx = (float*)(dx->imageData + dx->widthStep * j);
-        datady = (float*)(dy->imageData + dy->widthStep * j);
-        for(i = 1; i < width - 1; i++)
-        {
-            c = 0;
-            x = (datadx[i * numChannels + c]);
-            y = (datady[i * numChannels + c]);
-            // Ben: Does MDF support sqrtf?
-            r[j * width + i] =sqrtf(x * x + y * y);
-            for(ch = 1; ch < numChannels; ch++)
-            {
-                tx = (datadx[i * numChannels + ch]);
-                ty = (datady[i * numChannels + ch]);
-                magnitude = sqrtf(tx * tx + ty * ty);
-                if(magnitude > r[j * width + i])
-                {
-                    r[j * width + i] = magnitude;
-                    c = ch;
-                    x = tx;
-                    y = ty;
-                }
-            }/*for(ch = 1; ch < numChannels; ch++)*/
-            
-            max  = boundary_x[0] * x + boundary_y[0] * y;
-            maxi = 0;
-            for (kk = 0; kk < NUM_SECTOR; kk++) 
-            {
-                dotProd = boundary_x[kk] * x + boundary_y[kk] * y;
-                if (dotProd > max) 
-                {
-                    max  = dotProd;
-                    maxi = kk;
-                }
-                else 
-                {
-                    if (-dotProd > max) 
-                    {
-                        max  = -dotProd;
-                        maxi = kk + NUM_SECTOR;
-                    }
-                }
-            }
-            alfa[j * width * 2 + i * 2    ] = maxi % NUM_SECTOR;
-            
-            alfa[j * width * 2 + i * 2 + 1] = maxi;  
-        }/*for(i = 0; i < width; i++)*/
-    }/*for(j = 0; j < height; j++)*/
-    tmEnd = std::chrono::high_resolution_clock::now();
-    chrono::duration<double> diffTime  = tmEnd   - tmStart;
-    std::cout<< "  >getFeatures part1 takes:" << diffTime.count()*1000 <<"(ms)"<<std::endl;
-
-  std::cout<< "  >sizeY :" << sizeY <<" sizeX:"<<sizeX<<std::endl;
-  std::cout<< " dump alfa:"<<sizeX<<std::endl;
- if(bCapture){ 
-     FILE *fpRconv = fopen("./alfa.data", "w+b");
-    if(NULL!= fpRconv)
-    {
-       fwrite(alfa, sizeof(int), height*width*2, fpRconv);
-       fclose(fpRconv);
+        gradientRow(planes, width, height, numChannels, j, boundary_x, boundary_y, r, alfa0, alfa1);
     }
-}
 
+    sizeX = width  / k;
+    sizeY = height / k;
+    p     = 3 * NUM_SECTOR;
+    stringSize = sizeX * p;
+    allocFeatureMapObject(map, sizeX, sizeY, p);
+    float *features = (*map)->map;
+
+    // Bilinear vote of every pixel into its cell and the nearest neighbours,
+    // in the same order as ever so the sums come out the same
     for(i = 0; i < sizeY; i++)
     {
       for(j = 0; j < sizeX; j++)
       {
         for(ii = 0; ii < k; ii++)
         {
+          int y = i * k + ii;
+          if (y <= 0 || y >= height - 1)
+          {
+            continue;
+          }
+          int ny = i + nearest[ii];
+          bool rowNeighbour = (ny >= 0) && (ny <= sizeY - 1);
+          float *cell  = features + i * stringSize + j * p;
+          float *cellY = features + ny * stringSize + j * p;
           for(jj = 0; jj < k; jj++)
           {
-            if ((i * k + ii > 0) && 
-                (i * k + ii < height - 1) && 
-                (j * k + jj > 0) && 
-                (j * k + jj < width  - 1))
+            int x = j * k + jj;
+            if (x <= 0 || x >= width - 1)
             {
-              d = (k * i + ii) * width + (j * k + jj);
-              (*map)->map[ i * stringSize + j * (*map)->numFeatures + alfa[d * 2    ]] += 
-                  r[d] * w[ii * 2] * w[jj * 2];
-              (*map)->map[ i * stringSize + j * (*map)->numFeatures + alfa[d * 2 + 1] + NUM_SECTOR] += 
-                  r[d] * w[ii * 2] * w[jj * 2];
-              if ((i + nearest[ii] >= 0) && 
-                  (i + nearest[ii] <= sizeY - 1))
-              {
-                (*map)->map[(i + nearest[ii]) * stringSize + j * (*map)->numFeatures + alfa[d * 2    ]             ] += 
-                  r[d] * w[ii * 2 + 1] * w[jj * 2 ];
-                (*map)->map[(i + nearest[ii]) * stringSize + j * (*map)->numFeatures + alfa[d * 2 + 1] + NUM_SECTOR] += 
-                  r[d] * w[ii * 2 + 1] * w[jj * 2 ];
-              }
-              if ((j + nearest[jj] >= 0) && 
-                  (j + nearest[jj] <= sizeX - 1))
-              {
-                (*map)->map[i * stringSize + (j + nearest[jj]) * (*map)->numFeatures + alfa[d * 2    ]             ] += 
-                  r[d] * w[ii * 2] * w[jj * 2 + 1];
-                (*map)->map[i * stringSize + (j + nearest[jj]) * (*map)->numFeatures + alfa[d * 2 + 1] + NUM_SECTOR] += 
-                  r[d] * w[ii * 2] * w[jj * 2 + 1];
-              }
-              if ((i + nearest[ii] >= 0) && 
-                  (i + nearest[ii] <= sizeY - 1) && 
-                  (j + nearest[jj] >= 0) && 
-                  (j + nearest[jj] <= sizeX - 1))
-              {
-                (*map)->map[(i + nearest[ii]) * stringSize + (j + nearest[jj]) * (*map)->numFeatures + alfa[d * 2    ]             ] += 
-                  r[d] * w[ii * 2 + 1] * w[jj * 2 + 1];
-                (*map)->map[(i + nearest[ii]) * stringSize + (j + nearest[jj]) * (*map)->numFeatures + alfa[d * 2 + 1] + NUM_SECTOR] += 
-                  r[d] * w[ii * 2 + 1] * w[jj * 2 + 1];
-              }
+              continue;
+            }
+            int nx = j + nearest[jj];
+            bool colNeighbour = (nx >= 0) && (nx <= sizeX - 1);
+            d = y * width + x;
+            int bin0 = alfa0[d];
+            int bin1 = alfa1[d] + NUM_SECTOR;
+            float rw0 = r[d] * w[ii * 2];
+            float rw1 = r[d] * w[ii * 2 + 1];
+            cell[bin0] += rw0 * w[jj * 2];
+            cell[bin1] += rw0 * w[jj * 2];
+            if (rowNeighbour)
+            {
+              cellY[bin0] += rw1 * w[jj * 2];
+              cellY[bin1] += rw1 * w[jj * 2];
+            }
+            if (colNeighbour)
+            {
+              cell[(nx - j) * p + bin0] += rw0 * w[jj * 2 + 1];
+              cell[(nx - j) * p + bin1] += rw0 * w[jj * 2 + 1];
+            }
+            if (rowNeighbour && colNeighbour)
+            {
+              cellY[(nx - j) * p + bin0] += rw1 * w[jj * 2 + 1];
+              cellY[(nx - j) * p + bin1] += rw1 * w[jj * 2 + 1];
             }
           }/*for(jj = 0; jj < k; jj++)*/
         }/*for(ii = 0; ii < k; ii++)*/
-      }/*for(j = 1; j < sizeX - 1; j++)*/
-    }/*for(i = 1; i < sizeY - 1; i++)*/
-
- if(bCapture){ 
-    FILE *fpRconv = fopen("./map.data", "w+b");
-    if(NULL!= fpRconv)
-    {
-       fwrite( (*map)->map, sizeof(float), sizeX*sizeY*27, fpRconv);
-       fclose(fpRconv);
-    }
-}
-
-   // std::cout<<" allocFeatureMapObject-> (*map)->sizeX:"<<(*map)->sizeX<<" (*map)->sizeY:"<<(*map)->sizeY<<" (*map)->numFeatures:"<<(*map)->numFeatures<<std::endl;
-
-    cvReleaseImage(&dx);
-    cvReleaseImage(&dy);
-
-
-    free(w);
-    free(nearest);
-    
-    free(r);
-    free(alfa);
+      }/*for(j = 0; j < sizeX; j++)*/
+    }/*for(i = 0; i < sizeY; i++)*/
 
     return LATENT_SVM_OK;
 }
@@ -857,9 +553,6 @@ int PCAFeatureMaps(CvLSVMFeatureMapCaskade *map)
     if (newData == NULL)
         return -1;
 
-    std::chrono::high_resolution_clock::time_point tmStart;
-    std::chrono::high_resolution_clock::time_point tmEnd;
-    tmStart = std::chrono::high_resolution_clock::now();
     for(i = 0; i < sizeY; i++)
     {
         for(j = 0; j < sizeX; j++)
@@ -900,9 +593,6 @@ int PCAFeatureMaps(CvLSVMFeatureMapCaskade *map)
         }/*for(j = 0; j < sizeX; j++)*/
     }/*for(i = 0; i < sizeY; i++)*/
 //swop data
-     tmEnd = std::chrono::high_resolution_clock::now();
-    chrono::duration<double> diffTime  = tmEnd   - tmStart;
-    std::cout<< "  >getFeatures PCA takes:" << diffTime.count()*1000 <<"(ms)"<<std::endl;
 
     map->numFeatures = pp;
 
@@ -913,6 +603,160 @@ int PCAFeatureMaps(CvLSVMFeatureMapCaskade *map)
     return LATENT_SVM_OK;
 }
 
+// Normalized, truncated and reduced features of one cell. cell holds the
+// NUM_SECTOR contrast insensitive and 2 * NUM_SECTOR sensitive bins, invNorm
+// the inverse norms of the four blocks around it, in the order of
+// normalizeAndTruncate_orig(). out gets the 2 * NUM_SECTOR sensitive and the
+// NUM_SECTOR insensitive bins summed over the blocks, then the sum of the
+// sensitive bins of every block, as PCAFeatureMaps() lays them out
+static void normalizeCell(const float *cell, const float *invNorm, float alfa, float *out)
+{
+    const float nx = 1.0f / sqrtf((float)(NUM_SECTOR * 2));
+    const float ny = 1.0f / sqrtf(4.0f);
+#if defined(HAVE_AVX2) && NUM_SECTOR == 9
+    // bins 0 .. 7, 8 .. 15, 16 .. 23 and 24 .. 26, the sensitive ones start
+    // at lane 1 of a1. The AVX-512 build takes this path too: 27 bins leave
+    // most of a second 512 bit register empty, and the block sums only get
+    // more shuffles
+    const __m256i tail = _mm256_setr_epi32(-1, -1, -1, 0, 0, 0, 0, 0);
+    __m256 a0 = _mm256_loadu_ps(cell);
+    __m256 a1 = _mm256_loadu_ps(cell + 8);
+    __m256 a2 = _mm256_loadu_ps(cell + 16);
+    __m256 a3 = _mm256_maskload_ps(cell + 24, tail);
+    __m256 limit = _mm256_set1_ps(alfa);
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    __m256 sum2 = _mm256_setzero_ps();
+    __m256 sum3 = _mm256_setzero_ps();
+    for (int n = 0; n < 4; n++)
+    {
+        __m256 scale = _mm256_set1_ps(invNorm[n]);
+        __m256 t0 = _mm256_min_ps(_mm256_mul_ps(a0, scale), limit);
+        __m256 t1 = _mm256_min_ps(_mm256_mul_ps(a1, scale), limit);
+        __m256 t2 = _mm256_min_ps(_mm256_mul_ps(a2, scale), limit);
+        __m256 t3 = _mm256_min_ps(_mm256_mul_ps(a3, scale), limit);
+        sum0 = _mm256_add_ps(sum0, t0);
+        sum1 = _mm256_add_ps(sum1, t1);
+        sum2 = _mm256_add_ps(sum2, t2);
+        sum3 = _mm256_add_ps(sum3, t3);
+
+        __m256 sensitive = _mm256_add_ps(_mm256_add_ps(_mm256_blend_ps(t1, _mm256_setzero_ps(), 0x01), t2), t3);
+        __m128 h = _mm_add_ps(_mm256_castps256_ps128(sensitive), _mm256_extractf128_ps(sensitive, 1));
+        h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+        h = _mm_add_ss(h, _mm_shuffle_ps(h, h, 1));
+        out[NUM_SECTOR * 3 + n] = _mm_cvtss_f32(h) * nx;
+    }
+    __m256 scale = _mm256_set1_ps(ny);
+    sum0 = _mm256_mul_ps(sum0, scale);
+    sum1 = _mm256_mul_ps(sum1, scale);
+    _mm256_maskstore_ps(out, _mm256_setr_epi32(-1, -1, -1, -1, -1, -1, -1, 0),
+                        _mm256_permutevar8x32_ps(sum1, _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0)));
+    _mm256_storeu_ps(out + 7, _mm256_mul_ps(sum2, scale));
+    _mm256_maskstore_ps(out + 15, tail, _mm256_mul_ps(sum3, scale));
+    _mm256_storeu_ps(out + NUM_SECTOR * 2, sum0);
+    out[NUM_SECTOR * 3 - 1] = _mm256_cvtss_f32(sum1);
+#else
+    for (int jj = 0; jj < NUM_SECTOR * 3; jj++)
+    {
+        float val = 0;
+        for (int n = 0; n < 4; n++)
+        {
+            val += min(cell[jj] * invNorm[n], alfa);
+        }
+        // the sensitive bins go first
+        out[(jj < NUM_SECTOR) ? jj + NUM_SECTOR * 2 : jj - NUM_SECTOR] = val * ny;
+    }
+    for (int n = 0; n < 4; n++)
+    {
+        float val = 0;
+        for (int jj = NUM_SECTOR; jj < NUM_SECTOR * 3; jj++)
+        {
+            val += min(cell[jj] * invNorm[n], alfa);
+        }
+        out[NUM_SECTOR * 3 + n] = val * nx;
+    }
+#endif
+}
+
+/*
+// Feature map Normalization, Truncation and reduction in one pass
+//
+// API
+// int normalizeTruncatePCA(const featureMap *map, const float alfa, float *out,
+//                          CvLSVMFeatureScratch *scratch);
+// INPUT
+// map               - feature map of getFeatureMaps
+// alfa              - truncation threshold
+// scratch           - buffers kept between calls, NULL for temporary ones
+// OUTPUT
+// out               - (sizeX - 2) x (sizeY - 2) cells of NUM_SECTOR * 3 + 4 features
+// RESULT
+// Error status
+*/
+int normalizeTruncatePCA(const CvLSVMFeatureMapCaskade *map, const float alfa, float *out,
+                         CvLSVMFeatureScratch *scratch)
+{
+    int i, j, ii;
+    int sizeX, sizeY, p, pp;
+
+    sizeX = map->sizeX;
+    sizeY = map->sizeY;
+    p     = map->numFeatures;
+    pp    = NUM_SECTOR * 3 + 4;
+    if (p != NUM_SECTOR * 3 || sizeX < 3 || sizeY < 3)
+        return -1;
+
+    CvLSVMFeatureScratch temporary;
+    if (scratch == NULL)
+        scratch = &temporary;
+    scratch->energy.resize(sizeX * sizeY);
+    scratch->invNorm.resize((sizeX - 1) * (sizeY - 1));
+    float *energy  = scratch->energy.data();
+    float *invNorm = scratch->invNorm.data();
+
+    // Row i of the map gives the energies of its cells and the norms of the
+    // blocks between rows i - 1 and i, then the cells of row i - 1 get their
+    // features while they are still in cache. Every energy and block norm is
+    // computed once, where normalizeAndTruncate_orig() does it four times
+    for(i = 0; i < sizeY; i++)
+    {
+        for(j = 0; j < sizeX; j++)
+        {
+            const float *cell = map->map + (i * sizeX + j) * p;
+            float valOfNorm = 0.0f;
+            for(ii = 0; ii < NUM_SECTOR; ii++)
+            {
+                valOfNorm += cell[ii] * cell[ii];
+            }
+            energy[i * sizeX + j] = valOfNorm;
+        }
+        if (i == 0)
+            continue;
+
+        const float *upper = energy + (i - 1) * sizeX;
+        const float *lower = energy + i * sizeX;
+        for(j = 0; j < sizeX - 1; j++)
+        {
+            invNorm[(i - 1) * (sizeX - 1) + j] =
+                1.0f / (sqrtf(upper[j] + upper[j + 1] + lower[j] + lower[j + 1]) + FLT_EPSILON);
+        }
+        if (i == 1)
+            continue;
+
+        // blocks below right, above right, below left and above left of the cell
+        const float *below = invNorm + (i - 1) * (sizeX - 1);
+        const float *above = invNorm + (i - 2) * (sizeX - 1);
+        for(j = 1; j < sizeX - 1; j++)
+        {
+            float blocks[4] = { below[j], above[j], below[j - 1], above[j - 1] };
+            normalizeCell(map->map + ((i - 1) * sizeX + j) * p, blocks, alfa,
+                          out + ((i - 2) * (sizeX - 2) + j - 1) * pp);
+        }
+    }
+
+    return LATENT_SVM_OK;
+}
+
 
 //modified from "lsvmc_routine.cpp"
 
@@ -51,6 +51,7 @@
 #define _FHOG_H_
 
 #include <stdio.h>
+#include <vector>
 //#include "_lsvmc_types.h"
 //#include "_lsvmc_error.h"
 //#include "_lsvmc_routine.h"
@@ -119,20 +120,37 @@ typedef struct{
 
 
 
+// Per pixel and per cell buffers of getFeatureMaps and normalizeTruncatePCA.
+// The KCF tracker keeps one per thread, shared by all the trackers and scales
+// that run on it, so they are only allocated again for a larger template. Not
+// to be used by two threads at once
+typedef struct{
+    std::vector<float> planes;  // the image as float, one plane per channel
+    std::vector<float> r;       // gradient magnitude
+    std::vector<int>   alfa;    // orientation bin mod NUM_SECTOR, then the signed bin
+    std::vector<int>   nearest;
+    std::vector<float> w;
+    std::vector<float> energy;  // sum of squares of the contrast insensitive bins of a cell
+    std::vector<float> invNorm; // inverse norm of the 2x2 cell blocks
+} CvLSVMFeatureScratch;
+
 /*
 // Getting feature map for the selected subimage  
 //
 // API
-// int getFeatureMaps(const IplImage * image, const int k, featureMap **map);
+// int getFeatureMaps(const IplImage * image, const int k, featureMap **map,
+//                    CvLSVMFeatureScratch *scratch);
 // INPUT
 // image             - selected subimage
 // k                 - size of cells
+// scratch           - per pixel buffers kept between calls, NULL for temporary ones
 // OUTPUT
 // map               - feature map
 // RESULT
 // Error status
 */
-int getFeatureMaps(const IplImage * image, const int k, CvLSVMFeatureMapCaskade **map);
+int getFeatureMaps(const IplImage * image, const int k, CvLSVMFeatureMapCaskade **map,
+                   CvLSVMFeatureScratch *scratch = NULL);
 
 
 /*
@@ -166,6 +184,26 @@ int normalizeAndTruncate_orig(CvLSVMFeatureMapCaskade *map, const float alfa);
 */
 int PCAFeatureMaps(CvLSVMFeatureMapCaskade *map);
 
+/*
+// Feature map Normalization, Truncation and reduction in one pass, the
+// result of normalizeAndTruncate_orig() and PCAFeatureMaps() written to a
+// buffer of the caller
+//
+// API
+// int normalizeTruncatePCA(const featureMap *map, const float alfa, float *out,
+//                          CvLSVMFeatureScratch *scratch);
+// INPUT
+// map               - feature map of getFeatureMaps
+// alfa              - truncation threshold
+// scratch           - buffers kept between calls, NULL for temporary ones
+// OUTPUT
+// out               - (sizeX - 2) x (sizeY - 2) cells of NUM_SECTOR * 3 + 4 features
+// RESULT
+// Error status
+*/
+int normalizeTruncatePCA(const CvLSVMFeatureMapCaskade *map, const float alfa, float *out,
+                         CvLSVMFeatureScratch *scratch = NULL);
+
 
 //modified from "lsvmc_routine.h"
 
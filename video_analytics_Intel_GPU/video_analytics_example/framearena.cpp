@@ -0,0 +1,131 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+/*
+// brief Contiguous, optionally huge page backed memory for frame buffers
+*/
+
+#include "framearena.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <iostream>
+
+static size_t AlignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+VaFrameArena::VaFrameArena():
+    m_base(NULL),
+    m_size(0),
+    m_used(0),
+    m_backing(BACKING_NONE)
+{
+}
+
+VaFrameArena::~VaFrameArena()
+{
+    if (m_base != NULL)
+    {
+        munmap(m_base, m_size);
+    }
+}
+
+int VaFrameArena::Initialize(size_t size, bool hugepages)
+{
+    if (m_base != NULL || size == 0)
+    {
+        return -1;
+    }
+
+    if (hugepages)
+    {
+        size_t hugeSize = AlignUp(size, VA_HUGE_PAGE_SIZE);
+        void *base = mmap(NULL, hugeSize, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (base != MAP_FAILED)
+        {
+            m_base = (char *)base;
+            m_size = hugeSize;
+            m_backing = BACKING_HUGETLB;
+            return 0;
+        }
+
+        // no reserved huge pages, ask for transparent ones. THP only backs
+        // whole aligned 2 MB ranges, so map one more and trim the ends
+        base = mmap(NULL, hugeSize + VA_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED)
+        {
+            fprintf(stderr, "Error in frame arena allocation\n");
+            return -1;
+        }
+        char *aligned = (char *)AlignUp((uintptr_t)base, VA_HUGE_PAGE_SIZE);
+        size_t head = aligned - (char *)base;
+        if (head > 0)
+        {
+            munmap(base, head);
+        }
+        munmap(aligned + hugeSize, VA_HUGE_PAGE_SIZE - head);
+        m_base = aligned;
+        m_size = hugeSize;
+        m_backing = (madvise(m_base, m_size, MADV_HUGEPAGE) == 0) ? BACKING_THP : BACKING_PAGES;
+        return 0;
+    }
+
+    size = AlignUp(size, (size_t)sysconf(_SC_PAGESIZE));
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        fprintf(stderr, "Error in frame arena allocation\n");
+        return -1;
+    }
+    m_base = (char *)base;
+    m_size = size;
+    m_backing = BACKING_PAGES;
+    return 0;
+}
+
+void *VaFrameArena::Alloc(size_t size, size_t alignment)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t offset = AlignUp(m_used, alignment);
+    if (m_base == NULL || offset + size > m_size)
+    {
+        return NULL;
+    }
+    m_used = offset + size;
+    return m_base + offset;
+}
+
+bool VaFrameArena::Contains(const void *ptr) const
+{
+    return m_base != NULL && (const char *)ptr >= m_base && (const char *)ptr < m_base + m_size;
+}
+
+const char *VaFrameArena::BackingName(Backing backing)
+{
+    static const char *names[] = {"none", "4K pages", "transparent huge pages", "hugetlb"};
+    return names[backing];
+}
+
+void VaFrameArena::Print(const char *name) const
+{
+    std::cout << " " << name << ": " << (m_used >> 10) << " KB of " << (m_size >> 10)
+              << " KB, " << BackingName(m_backing) << std::endl;
+}
@@ -0,0 +1,66 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+/*
+// brief Contiguous, optionally huge page backed memory for frame buffers
+*/
+
+#ifndef _FRAMEARENA_H_
+#define _FRAMEARENA_H_
+
+#include <stddef.h>
+#include <mutex>
+
+#define VA_HUGE_PAGE_SIZE (2UL << 20)
+
+// One mapping that the frame buffers of a channel are carved from, so the
+// copy and preprocessing passes over a frame need few TLB entries. Buffers
+// are never freed one by one, the whole region goes with the arena.
+class VaFrameArena
+{
+public:
+    enum Backing
+    {
+        BACKING_NONE    = 0,
+        BACKING_PAGES   = 1, // regular 4 KB pages
+        BACKING_THP     = 2, // transparent huge pages requested with madvise()
+        BACKING_HUGETLB = 3  // reserved huge pages, MAP_HUGETLB
+    };
+
+    VaFrameArena();
+    ~VaFrameArena();
+    // Map size bytes, with hugepages try MAP_HUGETLB first, then THP
+    int Initialize(size_t size, bool hugepages);
+    // size bytes aligned to alignment, NULL once the arena is full
+    void *Alloc(size_t size, size_t alignment = 64);
+    bool Contains(const void *ptr) const;
+
+    Backing GetBacking() const { return m_backing; }
+    size_t GetSize() const { return m_size; }
+    size_t GetUsed() const { return m_used; }
+    void Print(const char *name) const;
+
+    static const char *BackingName(Backing backing);
+
+protected:
+    char *m_base;
+    size_t m_size;
+    size_t m_used;
+    Backing m_backing;
+    std::mutex m_mutex;
+};
+
+#endif
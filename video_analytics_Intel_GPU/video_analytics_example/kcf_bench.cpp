@@ -0,0 +1,174 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+
+/*
+// brief Micro benchmark of the KCF Gaussian correlation on the CPU
+//
+// Plays the detect() step of a tracker: random features of the size a 96
+// pixel template gives (24 x 24 cells), correlated with a template once per
+// frame. Compares
+// the per-channel version (two forward and one inverse transform per HOG
+// channel) with VaKcfCorrelation (one forward transform per channel, the
+// template spectra cached, a single inverse transform), and reports the
+// largest difference of the two kernels. Also times a forward and inverse
+// transform of one channel with cv::dft as FFTTools::fftd ran it and with
+// the cached plans of VaKcfFft.
+//
+// usage: kcf_bench [iterations] [cells] [channels]
+*/
+
+#include "kcfcorrelation.h"
+#include "kcffft.h"
+#include <assert.h>
+#include <math.h>
+#include "ffttools.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+static uint64_t now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// The correlation as the tracker did it before, one inverse transform per channel
+static cv::Mat PerChannel(const cv::Mat &x1, const cv::Mat &x2, int sizeY, int sizeX, float sigma)
+{
+    using namespace FFTTools;
+    cv::Mat c = cv::Mat(cv::Size(sizeX, sizeY), CV_32F, cv::Scalar(0));
+    cv::Mat caux;
+    for (int i = 0; i < x1.rows; i ++)
+    {
+        cv::Mat x1aux = x1.row(i).reshape(1, sizeY);
+        cv::Mat x2aux = x2.row(i).reshape(1, sizeY);
+        cv::mulSpectrums(fftd(x1aux), fftd(x2aux), caux, 0, true);
+        caux = fftd(caux, true);
+        rearrange(caux);
+        caux.convertTo(caux, CV_32F);
+        c = c + real(caux);
+    }
+    cv::Mat d;
+    cv::max(((cv::sum(x1.mul(x1))[0] + cv::sum(x2.mul(x2))[0]) - 2. * c) / (sizeY * sizeX * x1.rows), 0, d);
+    cv::Mat k;
+    cv::exp((-d / (sigma * sigma)), k);
+    return k;
+}
+
+static cv::Mat RandomFeatures(int channels, int sizeY, int sizeX)
+{
+    cv::Mat x(channels, sizeY * sizeX, CV_32F);
+    for (int i = 0; i < channels; i ++)
+    {
+        float *p = x.ptr<float>(i);
+        for (int j = 0; j < sizeY * sizeX; j ++)
+        {
+            p[j] = (float)rand() / RAND_MAX * 0.2f;
+        }
+    }
+    return x;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = (argc > 1) ? atoi(argv[1]) : 1000;
+    int cells = (argc > 2) ? atoi(argv[2]) : 24;
+    int channels = (argc > 3) ? atoi(argv[3]) : 31;
+    if (iterations <= 0 || cells <= 1 || (cells & 1) || channels <= 0)
+    {
+        fprintf(stderr, "usage: %s [iterations] [cells] [channels]\n", argv[0]);
+        return 1;
+    }
+    const float sigma = 0.6f;
+    // the template sizes are always even
+    int sizeX = cells;
+    int sizeY = cells;
+    printf("%d iterations, %d x %d cells, %d channels\n", iterations, sizeX, sizeY, channels);
+
+    cv::Mat z = RandomFeatures(channels, sizeY, sizeX);
+    cv::Mat x = RandomFeatures(channels, sizeY, sizeX);
+
+    uint64_t start = now_ns();
+    cv::Mat k0;
+    for (int i = 0; i < iterations; i ++)
+    {
+        k0 = PerChannel(x, z, sizeY, sizeX, sigma);
+    }
+    uint64_t perChannel = now_ns() - start;
+
+    // the template spectra are computed once per train(), not per detect()
+    std::vector<cv::Mat> zf;
+    VaKcfCorrelation::Spectra(z, sizeY, sizeX, zf);
+    double zz = VaKcfCorrelation::Energy(z);
+    start = now_ns();
+    cv::Mat k1;
+    for (int i = 0; i < iterations; i ++)
+    {
+        std::vector<cv::Mat> xf;
+        VaKcfCorrelation::Spectra(x, sizeY, sizeX, xf);
+        k1 = VaKcfCorrelation::Gaussian(xf, VaKcfCorrelation::Energy(x), zf, zz, sizeY * sizeX * channels, sigma);
+    }
+    uint64_t summed = now_ns() - start;
+
+    double diff = 0;
+    for (int y = 0; y < sizeY; y ++)
+    {
+        for (int c = 0; c < sizeX; c ++)
+        {
+            double d = fabs(k0.at<float>(y, c) - k1.at<float>(y, c));
+            diff = (d > diff) ? d : diff;
+        }
+    }
+    printf("%-12s %10.1f us/frame\n", "per channel", perChannel / 1000.0 / iterations);
+    printf("%-12s %10.1f us/frame  %.2fx, max difference %g\n", "summed",
+           summed / 1000.0 / iterations, (double)perChannel / summed, diff);
+
+    // one channel there and back
+    cv::Mat channel = x.row(0).reshape(1, sizeY).clone();
+    start = now_ns();
+    cv::Mat back0;
+    for (int i = 0; i < iterations; i ++)
+    {
+        back0 = FFTTools::real(FFTTools::fftd(FFTTools::fftd(channel), true));
+    }
+    uint64_t complexDft = now_ns() - start;
+
+    start = now_ns();
+    cv::Mat spectrum, back1;
+    for (int i = 0; i < iterations; i ++)
+    {
+        VaKcfFft::Forward(channel, spectrum);
+        VaKcfFft::Inverse(spectrum, back1);
+    }
+    uint64_t realFft = now_ns() - start;
+
+    diff = 0;
+    for (int y = 0; y < sizeY; y ++)
+    {
+        for (int c = 0; c < sizeX; c ++)
+        {
+            double d = fabs(back0.at<float>(y, c) - back1.at<float>(y, c));
+            diff = (d > diff) ? d : diff;
+        }
+    }
+    printf("%-12s %10.2f us/transform pair\n", "cv::dft", complexDft / 1000.0 / iterations);
+    printf("%-12s %10.2f us/transform pair  %.2fx, max difference %g\n", "VaKcfFft",
+           realFft / 1000.0 / iterations, (double)complexDft / realFft, diff);
+    return 0;
+}
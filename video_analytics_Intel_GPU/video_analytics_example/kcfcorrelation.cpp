@@ -0,0 +1,213 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+
+/*
+// brief Gaussian kernel correlation of KCF features in the Fourier domain
+*/
+
+#include "kcfcorrelation.h"
+#include "kcffft.h"
+#if defined(HAVE_AVX2) || defined(HAVE_SSE)
+#include <immintrin.h>
+#endif
+
+void VaKcfCorrelation::Spectra(const cv::Mat &x, int sizeY, int sizeX, std::vector<cv::Mat> &xf)
+{
+    xf.resize(x.rows);
+    for (int i = 0; i < x.rows; i ++)
+    {
+        cv::Mat channel(sizeY, sizeX, CV_32F, (void *)x.ptr<float>(i));
+        VaKcfFft::Forward(channel, xf[i]);
+    }
+}
+
+// acc += a * conj(b) over n complex numbers
+static void MulConjAccumulate(float *acc, const float *a, const float *b, int n)
+{
+    int i = 0;
+#if defined(HAVE_AVX2)
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256 va = _mm256_loadu_ps(a + 2 * i);
+        __m256 vb = _mm256_loadu_ps(b + 2 * i);
+        // (ar*br + ai*bi, ai*br - ar*bi)
+        __m256 bre = _mm256_moveldup_ps(vb);
+        __m256 bim = _mm256_movehdup_ps(vb);
+        __m256 swapped = _mm256_permute_ps(va, 0xb1);
+        __m256 prod = _mm256_fmsubadd_ps(va, bre, _mm256_mul_ps(swapped, bim));
+        _mm256_storeu_ps(acc + 2 * i, _mm256_add_ps(_mm256_loadu_ps(acc + 2 * i), prod));
+    }
+#elif defined(HAVE_SSE)
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128 va = _mm_loadu_ps(a + 2 * i);
+        __m128 vb = _mm_loadu_ps(b + 2 * i);
+        __m128 bre = _mm_moveldup_ps(vb);
+        __m128 bim = _mm_movehdup_ps(vb);
+        __m128 swapped = _mm_shuffle_ps(va, va, 0xb1);
+        // addsub gives (x0 - y0, x1 + y1), so subtract the negated cross terms
+        __m128 cross = _mm_mul_ps(swapped, bim);
+        __m128 prod = _mm_addsub_ps(_mm_mul_ps(va, bre), _mm_xor_ps(cross, _mm_set1_ps(-0.0f)));
+        _mm_storeu_ps(acc + 2 * i, _mm_add_ps(_mm_loadu_ps(acc + 2 * i), prod));
+    }
+#endif
+    for (; i < n; i ++)
+    {
+        float ar = a[2 * i], ai = a[2 * i + 1];
+        float br = b[2 * i], bi = b[2 * i + 1];
+        acc[2 * i]     += ar * br + ai * bi;
+        acc[2 * i + 1] += ai * br - ar * bi;
+    }
+}
+
+// Swap the quadrants so the zero shift lands in the center, as FFTTools::rearrange
+static void Rearrange(const cv::Mat &in, cv::Mat &out)
+{
+    int cx = in.cols / 2;
+    int cy = in.rows / 2;
+    out.create(in.rows, in.cols, CV_32F);
+    for (int y = 0; y < in.rows; y ++)
+    {
+        const float *src = in.ptr<float>(y);
+        float *dst = out.ptr<float>((y + in.rows - cy) % in.rows);
+        for (int x = 0; x < in.cols; x ++)
+        {
+            dst[(x + in.cols - cx) % in.cols] = src[x];
+        }
+    }
+}
+
+// d = max((xx - 2 * c) * scale, 0), in place
+static void SquaredDistance(cv::Mat &c, float xx, float scale)
+{
+    float *p = (float *)c.data;
+    int n = (int)c.total();
+    int i = 0;
+#if defined(HAVE_AVX2)
+    __m256 vxx = _mm256_set1_ps(xx);
+    __m256 vtwo = _mm256_set1_ps(-2.0f);
+    __m256 vscale = _mm256_set1_ps(scale);
+    __m256 vzero = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 v = _mm256_fmadd_ps(_mm256_loadu_ps(p + i), vtwo, vxx);
+        _mm256_storeu_ps(p + i, _mm256_max_ps(_mm256_mul_ps(v, vscale), vzero));
+    }
+#elif defined(HAVE_SSE)
+    __m128 vxx = _mm_set1_ps(xx);
+    __m128 vtwo = _mm_set1_ps(2.0f);
+    __m128 vscale = _mm_set1_ps(scale);
+    __m128 vzero = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 v = _mm_sub_ps(vxx, _mm_mul_ps(_mm_loadu_ps(p + i), vtwo));
+        _mm_storeu_ps(p + i, _mm_max_ps(_mm_mul_ps(v, vscale), vzero));
+    }
+#endif
+    for (; i < n; i ++)
+    {
+        float v = (xx - 2.0f * p[i]) * scale;
+        p[i] = v > 0 ? v : 0;
+    }
+}
+
+cv::Mat VaKcfCorrelation::Gaussian(const std::vector<cv::Mat> &x1f, double xx1,
+                                   const std::vector<cv::Mat> &x2f, double xx2,
+                                   int numel, float sigma)
+{
+    int rows = x1f[0].rows;
+    int cols = x1f[0].cols;
+    cv::Mat acc(rows, cols, CV_32FC2, cv::Scalar(0));
+    for (size_t i = 0; i < x1f.size(); i ++)
+    {
+        MulConjAccumulate((float *)acc.data, (const float *)x1f[i].data, (const float *)x2f[i].data, rows * cols);
+    }
+
+    // the sum of the spectra of real maps is the spectrum of a real map
+    cv::Mat c;
+    VaKcfFft::Inverse(acc, c);
+    cv::Mat d;
+    Rearrange(c, d);
+
+    SquaredDistance(d, (float)(xx1 + xx2), 1.0f / numel);
+    cv::Mat k;
+    cv::exp(d * (-1.0 / (sigma * sigma)), k);
+    return k;
+}
+
+void VaKcfCorrelation::Interpolate(std::vector<cv::Mat> &a, const std::vector<cv::Mat> &b, float factor)
+{
+    if (a.size() != b.size() || factor >= 1.0f)
+    {
+        a.resize(b.size());
+        for (size_t i = 0; i < b.size(); i ++)
+        {
+            b[i].copyTo(a[i]);
+        }
+        return;
+    }
+    for (size_t i = 0; i < a.size(); i ++)
+    {
+        float *pa = (float *)a[i].data;
+        const float *pb = (const float *)b[i].data;
+        int n = (int)a[i].total() * 2;
+        for (int j = 0; j < n; j ++)
+        {
+            pa[j] += factor * (pb[j] - pa[j]);
+        }
+    }
+}
+
+double VaKcfCorrelation::Energy(const cv::Mat &x)
+{
+    const float *p = (const float *)x.data;
+    int n = (int)(x.total() * x.channels());
+    int i = 0;
+    double total = 0;
+#if defined(HAVE_AVX2)
+    __m256 acc = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 v = _mm256_loadu_ps(p + i);
+        acc = _mm256_fmadd_ps(v, v, acc);
+    }
+    float lanes[8];
+    _mm256_storeu_ps(lanes, acc);
+    for (int l = 0; l < 8; l ++)
+    {
+        total += lanes[l];
+    }
+#elif defined(HAVE_SSE)
+    __m128 acc = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 v = _mm_loadu_ps(p + i);
+        acc = _mm_add_ps(acc, _mm_mul_ps(v, v));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    for (int l = 0; l < 4; l ++)
+    {
+        total += lanes[l];
+    }
+#endif
+    for (; i < n; i ++)
+    {
+        total += (double)p[i] * p[i];
+    }
+    return total;
+}
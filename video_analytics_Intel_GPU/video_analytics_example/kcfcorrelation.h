@@ -0,0 +1,51 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+
+/*
+// brief Gaussian kernel correlation of KCF features in the Fourier domain
+*/
+
+#ifndef _KCFCORRELATION_H_
+#define _KCFCORRELATION_H_
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// The features of a KCF tracker are a matrix with one row per HOG channel, each
+// row a sizeY x sizeX map. The cross-correlation of two of them is the inverse
+// transform of the sum of the per channel cross spectra, as the transform is
+// linear one inverse transform is enough for all channels. The template is
+// only ever blended with new features, so its spectra can be blended the same
+// way and kept from frame to frame instead of being transformed again.
+class VaKcfCorrelation
+{
+public:
+    // Spectra of every channel of x, in the half spectrum layout of VaKcfFft
+    static void Spectra(const cv::Mat &x, int sizeY, int sizeX, std::vector<cv::Mat> &xf);
+    // k = exp(-max(xx1 + xx2 - 2 * c, 0) / (numel * sigma^2)) with c the
+    // centered cross-correlation of the features behind x1f and x2f and xx1,
+    // xx2 their energies
+    static cv::Mat Gaussian(const std::vector<cv::Mat> &x1f, double xx1,
+                            const std::vector<cv::Mat> &x2f, double xx2,
+                            int numel, float sigma);
+    // a = (1 - factor) * a + factor * b, a takes b when it is empty
+    static void Interpolate(std::vector<cv::Mat> &a, const std::vector<cv::Mat> &b, float factor);
+    // Sum of the squared elements of a continuous float matrix
+    static double Energy(const cv::Mat &x);
+};
+
+#endif
@@ -0,0 +1,752 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+
+/*
+// brief Real to complex FFT of KCF maps with cached plans
+*/
+
+#include "kcffft.h"
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <map>
+#include <mutex>
+#if defined(HAVE_AVX2) || defined(HAVE_SSE)
+#include <immintrin.h>
+#endif
+
+#define CV_PI   3.1415926535897932384626433832795
+#define CV_MAX_LOCAL_DFT_SIZE  (1 << 15)
+#define CV_SWAP(a,b,t) ((t) = (a), (a) = (b), (b) = (t))
+// plans a thread keeps at hand, the rows and columns of a couple of template sizes
+#define KCF_FFT_THREAD_PLANS  4
+
+static unsigned char bitrevTab[] =
+{
+  0x00,0x80,0x40,0xc0,0x20,0xa0,0x60,0xe0,0x10,0x90,0x50,0xd0,0x30,0xb0,0x70,0xf0,
+  0x08,0x88,0x48,0xc8,0x28,0xa8,0x68,0xe8,0x18,0x98,0x58,0xd8,0x38,0xb8,0x78,0xf8,
+  0x04,0x84,0x44,0xc4,0x24,0xa4,0x64,0xe4,0x14,0x94,0x54,0xd4,0x34,0xb4,0x74,0xf4,
+  0x0c,0x8c,0x4c,0xcc,0x2c,0xac,0x6c,0xec,0x1c,0x9c,0x5c,0xdc,0x3c,0xbc,0x7c,0xfc,
+  0x02,0x82,0x42,0xc2,0x22,0xa2,0x62,0xe2,0x12,0x92,0x52,0xd2,0x32,0xb2,0x72,0xf2,
+  0x0a,0x8a,0x4a,0xca,0x2a,0xaa,0x6a,0xea,0x1a,0x9a,0x5a,0xda,0x3a,0xba,0x7a,0xfa,
+  0x06,0x86,0x46,0xc6,0x26,0xa6,0x66,0xe6,0x16,0x96,0x56,0xd6,0x36,0xb6,0x76,0xf6,
+  0x0e,0x8e,0x4e,0xce,0x2e,0xae,0x6e,0xee,0x1e,0x9e,0x5e,0xde,0x3e,0xbe,0x7e,0xfe,
+  0x01,0x81,0x41,0xc1,0x21,0xa1,0x61,0xe1,0x11,0x91,0x51,0xd1,0x31,0xb1,0x71,0xf1,
+  0x09,0x89,0x49,0xc9,0x29,0xa9,0x69,0xe9,0x19,0x99,0x59,0xd9,0x39,0xb9,0x79,0xf9,
+  0x05,0x85,0x45,0xc5,0x25,0xa5,0x65,0xe5,0x15,0x95,0x55,0xd5,0x35,0xb5,0x75,0xf5,
+  0x0d,0x8d,0x4d,0xcd,0x2d,0xad,0x6d,0xed,0x1d,0x9d,0x5d,0xdd,0x3d,0xbd,0x7d,0xfd,
+  0x03,0x83,0x43,0xc3,0x23,0xa3,0x63,0xe3,0x13,0x93,0x53,0xd3,0x33,0xb3,0x73,0xf3,
+  0x0b,0x8b,0x4b,0xcb,0x2b,0xab,0x6b,0xeb,0x1b,0x9b,0x5b,0xdb,0x3b,0xbb,0x7b,0xfb,
+  0x07,0x87,0x47,0xc7,0x27,0xa7,0x67,0xe7,0x17,0x97,0x57,0xd7,0x37,0xb7,0x77,0xf7,
+  0x0f,0x8f,0x4f,0xcf,0x2f,0xaf,0x6f,0xef,0x1f,0x9f,0x5f,0xdf,0x3f,0xbf,0x7f,0xff
+};
+
+static const double DFTTab[][2] =
+{
+{ 1.00000000000000000, 0.00000000000000000 },
+{-1.00000000000000000, 0.00000000000000000 },
+{ 0.00000000000000000, 1.00000000000000000 },
+{ 0.70710678118654757, 0.70710678118654746 },
+{ 0.92387953251128674, 0.38268343236508978 },
+{ 0.98078528040323043, 0.19509032201612825 },
+{ 0.99518472667219693, 0.09801714032956060 },
+{ 0.99879545620517241, 0.04906767432741802 },
+{ 0.99969881869620425, 0.02454122852291229 },
+{ 0.99992470183914450, 0.01227153828571993 },
+{ 0.99998117528260111, 0.00613588464915448 },
+{ 0.99999529380957619, 0.00306795676296598 },
+{ 0.99999882345170188, 0.00153398018628477 },
+{ 0.99999970586288223, 0.00076699031874270 },
+{ 0.99999992646571789, 0.00038349518757140 },
+{ 0.99999998161642933, 0.00019174759731070 },
+{ 0.99999999540410733, 0.00009587379909598 },
+{ 0.99999999885102686, 0.00004793689960307 },
+{ 0.99999999971275666, 0.00002396844980842 },
+{ 0.99999999992818922, 0.00001198422490507 },
+{ 0.99999999998204725, 0.00000599211245264 },
+{ 0.99999999999551181, 0.00000299605622633 },
+{ 0.99999999999887801, 0.00000149802811317 },
+{ 0.99999999999971945, 0.00000074901405658 },
+{ 0.99999999999992983, 0.00000037450702829 },
+{ 0.99999999999998246, 0.00000018725351415 },
+{ 0.99999999999999567, 0.00000009362675707 },
+{ 0.99999999999999889, 0.00000004681337854 },
+{ 0.99999999999999978, 0.00000002340668927 },
+{ 0.99999999999999989, 0.00000001170334463 },
+{ 1.00000000000000000, 0.00000000585167232 },
+{ 1.00000000000000000, 0.00000000292583616 }
+};
+
+#define BitRev(i,shift) \
+   ((int)((((unsigned)bitrevTab[(i)&255] << 24)+ \
+           ((unsigned)bitrevTab[((i)>> 8)&255] << 16)+ \
+           ((unsigned)bitrevTab[((i)>>16)&255] <<  8)+ \
+           ((unsigned)bitrevTab[((i)>>24)])) >> (shift)))
+
+
+
+int VaKcfFft::DFTFactorize( int n, int* factors )
+{
+    int nf = 0, f, i, j;
+
+    if( n <= 5 )
+    {
+        factors[0] = n;
+        return 1;
+    }
+
+    f = (((n - 1)^n)+1) >> 1;
+    if( f > 1 )
+    {
+        factors[nf++] = f;
+        n = f == n ? 1 : n/f;
+    }
+
+    for( f = 3; n > 1; )
+    {
+        int d = n/f;
+        if( d*f == n )
+        {
+            factors[nf++] = f;
+            n = d;
+        }
+        else
+        {
+            f += 2;
+            if( f*f > n )
+                break;
+        }
+    }
+
+    if( n > 1 )
+        factors[nf++] = n;
+
+    f = (factors[0] & 1) == 0;
+    for( i = f; i < (nf+f)/2; i++ )
+        CV_SWAP( factors[i], factors[nf-i-1+f], j );
+
+    return nf;
+}
+
+void VaKcfFft::DFTInit( int n0, int nf, int* factors, int* itab, int elem_size, float* _wave, int inv_itab )
+{
+    int digits[34], radix[34];
+    int n = factors[0], m = 0;
+    int* itab0 = itab;
+    int i, j, k;
+    double w[2], w1[2];
+    double t;
+
+    if( n0 <= 5 )
+    {
+        itab[0] = 0;
+        itab[n0-1] = n0-1;
+
+        if( n0 != 4 )
+        {
+            for( i = 1; i < n0-1; i++ )
+                itab[i] = i;
+        }
+        else
+        {
+            itab[1] = 2;
+            itab[2] = 1;
+        }
+        if( n0 == 5 )
+        {
+            _wave[0] = 1.0f;
+            _wave[1] = 0.0f;
+        }
+        if( n0 != 4 )
+            return;
+        m = 2;
+    }
+    else
+    {
+        // radix[] is initialized from index 'nf' down to zero
+        assert (nf < 34);
+        radix[nf] = 1;
+        digits[nf] = 0;
+        for( i = 0; i < nf; i++ )
+        {
+            digits[i] = 0;
+            radix[nf-i-1] = radix[nf-i]*factors[nf-i-1];
+        }
+
+        if( inv_itab && factors[0] != factors[nf-1] )
+            itab = (int*)_wave;
+
+        if( (n & 1) == 0 )
+        {
+            int a = radix[1], na2 = n*a>>1, na4 = na2 >> 1;
+            for( m = 0; (unsigned)(1 << m) < (unsigned)n; m++ )
+                ;
+            if( n <= 2  )
+            {
+                itab[0] = 0;
+                itab[1] = na2;
+            }
+            else if( n <= 256 )
+            {
+                int shift = 10 - m;
+                for( i = 0; i <= n - 4; i += 4 )
+                {
+                    j = (bitrevTab[i>>2]>>shift)*a;
+                    itab[i] = j;
+                    itab[i+1] = j + na2;
+                    itab[i+2] = j + na4;
+                    itab[i+3] = j + na2 + na4;
+                }
+            }
+            else
+            {
+                int shift = 34 - m;
+                for( i = 0; i < n; i += 4 )
+                {
+                    int i4 = i >> 2;
+                    j = BitRev(i4,shift)*a;
+                    itab[i] = j;
+                    itab[i+1] = j + na2;
+                    itab[i+2] = j + na4;
+                    itab[i+3] = j + na2 + na4;
+                }
+            }
+
+            digits[1]++;
+
+            if( nf >= 2 )
+            {
+                for( i = n, j = radix[2]; i < n0; )
+                {
+                    for( k = 0; k < n; k++ )
+                        itab[i+k] = itab[k] + j;
+                    if( (i += n) >= n0 )
+                        break;
+                    j += radix[2];
+                    for( k = 1; ++digits[k] >= factors[k]; k++ )
+                    {
+                        digits[k] = 0;
+                        j += radix[k+2] - radix[k];
+                    }
+                }
+            }
+        }
+        else
+        {
+            for( i = 0, j = 0;; )
+            {
+                itab[i] = j;
+                if( ++i >= n0 )
+                    break;
+                j += radix[1];
+                for( k = 0; ++digits[k] >= factors[k]; k++ )
+                {
+                    digits[k] = 0;
+                    j += radix[k+2] - radix[k];
+                }
+            }
+        }
+
+        if( itab != itab0 )
+        {
+            itab0[0] = 0;
+            for( i = n0 & 1; i < n0; i += 2 )
+            {
+                int k0 = itab[i];
+                int k1 = itab[i+1];
+                itab0[k0] = i;
+                itab0[k1] = i+1;
+            }
+        }
+    }
+
+    if( (n0 & (n0-1)) == 0 )
+    {
+        w[0] = w1[0] =  DFTTab[m][0];
+        w[1] = w1[1] = -DFTTab[m][1];
+    }
+    else
+    {
+        t = -CV_PI*2/n0;
+        w[1] = w1[1] = sin(t);
+        w[0] = w1[0] = sqrtf(1. - w1[1]*w1[1]);
+    }
+    n = (n0+1)/2;
+
+    float* wave = _wave;
+
+    wave[0] = 1.f;
+    wave[1] = 0.f;
+
+    if( (n0 & 1) == 0 )
+    {
+        wave[2*n]   = -1.0f;
+        wave[2*n+1] =  0.0f;
+    }
+
+    for( i = 1; i < n; i++ )
+    {
+        wave[2*i]   = w[0];
+        wave[2*i+1] = w[1];
+        wave[2*(n0-i)]   =  w[0];
+        wave[2*(n0-i)+1] = -w[1];
+
+        t    = w[0]*w1[0] - w[1]*w1[1];
+        w[1] = w[0]*w1[1] + w[1]*w1[0];
+        w[0] = t;
+    }
+}
+
+const VaKcfFft::Plan *VaKcfFft::GetPlan(int n)
+{
+    // every transform asks for its plans, the trackers and scales running in
+    // parallel on the pool would serialize on the lock of the shared cache.
+    // A plan never changes once made, so a thread may keep the pointer
+    thread_local int s_sizes[KCF_FFT_THREAD_PLANS] = {0};
+    thread_local const Plan *s_recent[KCF_FFT_THREAD_PLANS] = {NULL};
+    thread_local int s_next = 0;
+    for (int i = 0; i < KCF_FFT_THREAD_PLANS; i ++)
+    {
+        if (s_sizes[i] == n)
+        {
+            return s_recent[i];
+        }
+    }
+    const Plan *plan = LoadPlan(n);
+    s_sizes[s_next] = n;
+    s_recent[s_next] = plan;
+    s_next = (s_next + 1) % KCF_FFT_THREAD_PLANS;
+    return plan;
+}
+
+const VaKcfFft::Plan *VaKcfFft::LoadPlan(int n)
+{
+    // a tracker only ever needs a few sizes, the plans are kept until exit.
+    // Map nodes don't move, so the plans handed out stay valid
+    static std::mutex s_planMutex;
+    static std::map<int, Plan> s_plans;
+    std::lock_guard<std::mutex> lock(s_planMutex);
+    std::map<int, Plan>::iterator it = s_plans.find(n);
+    if (it != s_plans.end())
+    {
+        return &it->second;
+    }
+
+    Plan *plan = &s_plans[n];
+    plan->n = n;
+    plan->nf = DFTFactorize(n, plan->factors);
+    plan->itab.resize(n);
+    std::vector<float> wave(2 * n + 2);
+    DFTInit(n, plan->nf, plan->factors, &plan->itab[0], 2 * sizeof(float), &wave[0], 0);
+
+    // the twiddles are worked out in double here, DFTInit skips them for the
+    // direct transforms of n <= 5
+    plan->wave.resize(2 * n);
+    for (int k = 0; k < n; k ++)
+    {
+        double angle = -2.0 * CV_PI * k / n;
+        plan->wave[2 * k] = (float)cos(angle);
+        plan->wave[2 * k + 1] = (float)sin(angle);
+    }
+    plan->half.resize(2 * (n + 1));
+    for (int k = 0; k <= n; k ++)
+    {
+        double angle = -CV_PI * k / n;
+        plan->half[2 * k] = (float)cos(angle);
+        plan->half[2 * k + 1] = (float)sin(angle);
+    }
+    return plan;
+}
+
+// t = w * b, b = a - t, a = a + t over n lanes
+static void Butterfly2(float *aRe, float *aIm, float *bRe, float *bIm, float wr, float wi, int n)
+{
+    int i = 0;
+#if defined(HAVE_AVX2)
+    __m256 vwr = _mm256_set1_ps(wr);
+    __m256 vwi = _mm256_set1_ps(wi);
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 br = _mm256_loadu_ps(bRe + i);
+        __m256 bi = _mm256_loadu_ps(bIm + i);
+        __m256 tr = _mm256_fmsub_ps(br, vwr, _mm256_mul_ps(bi, vwi));
+        __m256 ti = _mm256_fmadd_ps(br, vwi, _mm256_mul_ps(bi, vwr));
+        __m256 ar = _mm256_loadu_ps(aRe + i);
+        __m256 ai = _mm256_loadu_ps(aIm + i);
+        _mm256_storeu_ps(aRe + i, _mm256_add_ps(ar, tr));
+        _mm256_storeu_ps(aIm + i, _mm256_add_ps(ai, ti));
+        _mm256_storeu_ps(bRe + i, _mm256_sub_ps(ar, tr));
+        _mm256_storeu_ps(bIm + i, _mm256_sub_ps(ai, ti));
+    }
+#elif defined(HAVE_SSE)
+    __m128 vwr = _mm_set1_ps(wr);
+    __m128 vwi = _mm_set1_ps(wi);
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 br = _mm_loadu_ps(bRe + i);
+        __m128 bi = _mm_loadu_ps(bIm + i);
+        __m128 tr = _mm_sub_ps(_mm_mul_ps(br, vwr), _mm_mul_ps(bi, vwi));
+        __m128 ti = _mm_add_ps(_mm_mul_ps(br, vwi), _mm_mul_ps(bi, vwr));
+        __m128 ar = _mm_loadu_ps(aRe + i);
+        __m128 ai = _mm_loadu_ps(aIm + i);
+        _mm_storeu_ps(aRe + i, _mm_add_ps(ar, tr));
+        _mm_storeu_ps(aIm + i, _mm_add_ps(ai, ti));
+        _mm_storeu_ps(bRe + i, _mm_sub_ps(ar, tr));
+        _mm_storeu_ps(bIm + i, _mm_sub_ps(ai, ti));
+    }
+#endif
+    for (; i < n; i ++)
+    {
+        float tr = bRe[i] * wr - bIm[i] * wi;
+        float ti = bRe[i] * wi + bIm[i] * wr;
+        bRe[i] = aRe[i] - tr;
+        bIm[i] = aIm[i] - ti;
+        aRe[i] += tr;
+        aIm[i] += ti;
+    }
+}
+
+// x = w * x over n lanes
+static void Twiddle(float *re, float *im, float wr, float wi, int n)
+{
+    int i = 0;
+#if defined(HAVE_AVX2)
+    __m256 vwr = _mm256_set1_ps(wr);
+    __m256 vwi = _mm256_set1_ps(wi);
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 xr = _mm256_loadu_ps(re + i);
+        __m256 xi = _mm256_loadu_ps(im + i);
+        _mm256_storeu_ps(re + i, _mm256_fmsub_ps(xr, vwr, _mm256_mul_ps(xi, vwi)));
+        _mm256_storeu_ps(im + i, _mm256_fmadd_ps(xr, vwi, _mm256_mul_ps(xi, vwr)));
+    }
+#elif defined(HAVE_SSE)
+    __m128 vwr = _mm_set1_ps(wr);
+    __m128 vwi = _mm_set1_ps(wi);
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 xr = _mm_loadu_ps(re + i);
+        __m128 xi = _mm_loadu_ps(im + i);
+        _mm_storeu_ps(re + i, _mm_sub_ps(_mm_mul_ps(xr, vwr), _mm_mul_ps(xi, vwi)));
+        _mm_storeu_ps(im + i, _mm_add_ps(_mm_mul_ps(xr, vwi), _mm_mul_ps(xi, vwr)));
+    }
+#endif
+    for (; i < n; i ++)
+    {
+        float xr = re[i];
+        re[i] = xr * wr - im[i] * wi;
+        im[i] = xr * wi + im[i] * wr;
+    }
+}
+
+// acc += w * x over n lanes
+static void MulAccumulate(float *accRe, float *accIm, const float *xRe, const float *xIm, float wr, float wi, int n)
+{
+    int i = 0;
+#if defined(HAVE_AVX2)
+    __m256 vwr = _mm256_set1_ps(wr);
+    __m256 vwi = _mm256_set1_ps(wi);
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 xr = _mm256_loadu_ps(xRe + i);
+        __m256 xi = _mm256_loadu_ps(xIm + i);
+        __m256 ar = _mm256_fmadd_ps(xr, vwr, _mm256_loadu_ps(accRe + i));
+        __m256 ai = _mm256_fmadd_ps(xr, vwi, _mm256_loadu_ps(accIm + i));
+        _mm256_storeu_ps(accRe + i, _mm256_fnmadd_ps(xi, vwi, ar));
+        _mm256_storeu_ps(accIm + i, _mm256_fmadd_ps(xi, vwr, ai));
+    }
+#elif defined(HAVE_SSE)
+    __m128 vwr = _mm_set1_ps(wr);
+    __m128 vwi = _mm_set1_ps(wi);
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 xr = _mm_loadu_ps(xRe + i);
+        __m128 xi = _mm_loadu_ps(xIm + i);
+        __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, vwr), _mm_mul_ps(xi, vwi));
+        __m128 ti = _mm_add_ps(_mm_mul_ps(xr, vwi), _mm_mul_ps(xi, vwr));
+        _mm_storeu_ps(accRe + i, _mm_add_ps(_mm_loadu_ps(accRe + i), tr));
+        _mm_storeu_ps(accIm + i, _mm_add_ps(_mm_loadu_ps(accIm + i), ti));
+    }
+#endif
+    for (; i < n; i ++)
+    {
+        accRe[i] += xRe[i] * wr - xIm[i] * wi;
+        accIm[i] += xRe[i] * wi + xIm[i] * wr;
+    }
+}
+
+void VaKcfFft::Transform(const Plan *plan, const float *srcRe, const float *srcIm, int srcStride,
+                         float *re, float *im, int lanes, bool inverse)
+{
+    int n = plan->n;
+    const float *wave = &plan->wave[0];
+    // the inverse runs on the conjugate twiddles
+    float sign = inverse ? -1.0f : 1.0f;
+
+    for (int k = 0; k < n; k ++)
+    {
+        memcpy(re + (size_t)k * lanes, srcRe + (size_t)plan->itab[k] * srcStride, lanes * sizeof(float));
+        memcpy(im + (size_t)k * lanes, srcIm + (size_t)plan->itab[k] * srcStride, lanes * sizeof(float));
+    }
+
+    int len = 1;
+    int f = 0;
+    if ((plan->factors[0] & 1) == 0)
+    {
+        // DFTInit reverses the bits of the power of 2, so it goes in radix 2 steps
+        for (; len < plan->factors[0]; len *= 2)
+        {
+            int dw0 = n / (2 * len);
+            for (int i = 0; i < n; i += 2 * len)
+            {
+                for (int j = 0; j < len; j ++)
+                {
+                    size_t a = (size_t)(i + j) * lanes;
+                    size_t b = a + (size_t)len * lanes;
+                    Butterfly2(re + a, im + a, re + b, im + b, wave[2 * j * dw0], sign * wave[2 * j * dw0 + 1], lanes);
+                }
+            }
+        }
+        f = 1;
+    }
+
+    // The odd factors are small, a KCF map is a few dozen cells, so their
+    // butterflies are direct transforms of length factor
+    thread_local std::vector<float> scratch;
+    for (; f < plan->nf; f ++)
+    {
+        int factor = plan->factors[f];
+        int span = len * factor;
+        int dw0 = n / span;
+        int dwf = n / factor;
+        scratch.resize(2 * (size_t)factor * lanes);
+        float *sRe = &scratch[0];
+        float *sIm = sRe + (size_t)factor * lanes;
+        for (int i = 0; i < n; i += span)
+        {
+            for (int j = 0; j < len; j ++)
+            {
+                float *vRe = re + (size_t)(i + j) * lanes;
+                float *vIm = im + (size_t)(i + j) * lanes;
+                size_t step = (size_t)len * lanes;
+                for (int q = 1; q < factor && j > 0; q ++)
+                {
+                    int w = j * q * dw0;
+                    Twiddle(vRe + q * step, vIm + q * step, wave[2 * w], sign * wave[2 * w + 1], lanes);
+                }
+                memset(sRe, 0, 2 * (size_t)factor * lanes * sizeof(float));
+                for (int r = 0; r < factor; r ++)
+                {
+                    for (int q = 0; q < factor; q ++)
+                    {
+                        int w = (r * q % factor) * dwf;
+                        MulAccumulate(sRe + (size_t)r * lanes, sIm + (size_t)r * lanes, vRe + q * step, vIm + q * step,
+                                      wave[2 * w], sign * wave[2 * w + 1], lanes);
+                    }
+                }
+                for (int r = 0; r < factor; r ++)
+                {
+                    memcpy(vRe + r * step, sRe + (size_t)r * lanes, lanes * sizeof(float));
+                    memcpy(vIm + r * step, sIm + (size_t)r * lanes, lanes * sizeof(float));
+                }
+            }
+        }
+        len = span;
+    }
+}
+
+// dst (cols x rows) = src (rows x cols)
+static void Transpose(const float *src, int rows, int cols, float *dst)
+{
+    for (int y = 0; y < rows; y ++)
+    {
+        for (int x = 0; x < cols; x ++)
+        {
+            dst[(size_t)x * rows + y] = src[(size_t)y * cols + x];
+        }
+    }
+}
+
+void VaKcfFft::ForwardReal(const float *x, int rows, int cols, float *xf)
+{
+    int m = rows / 2;
+    int half = m + 1;
+    const Plan *planY = GetPlan(m);
+    const Plan *planX = GetPlan(cols);
+    size_t size = (size_t)half * cols;
+    thread_local std::vector<float> buffer;
+    buffer.resize(4 * size);
+    float *aRe = &buffer[0];
+    float *aIm = aRe + size;
+    float *bRe = aIm + size;
+    float *bIm = bRe + size;
+
+    // columns, the even rows as the real and the odd rows as the imaginary part
+    Transform(planY, x, x + cols, 2 * cols, aRe, aIm, cols, false);
+
+    // split them into the spectra of the two real columns and merge those
+    const float *w = &planY->half[0];
+    for (int k = 0; k <= m; k ++)
+    {
+        const float *zRe = aRe + (size_t)(k % m) * cols;
+        const float *zIm = aIm + (size_t)(k % m) * cols;
+        const float *cRe = aRe + (size_t)((m - k) % m) * cols;
+        const float *cIm = aIm + (size_t)((m - k) % m) * cols;
+        float *yRe = bRe + (size_t)k * cols;
+        float *yIm = bIm + (size_t)k * cols;
+        float wr = 0.5f * w[2 * k];
+        float wi = 0.5f * w[2 * k + 1];
+        for (int c = 0; c < cols; c ++)
+        {
+            // even = (z[k] + conj(z[m - k])) / 2, odd = (z[k] - conj(z[m - k])) / 2i
+            float er = zRe[c] + cRe[c];
+            float ei = zIm[c] - cIm[c];
+            float or_ = zIm[c] + cIm[c];
+            float oi = cRe[c] - zRe[c];
+            yRe[c] = 0.5f * er + wr * or_ - wi * oi;
+            yIm[c] = 0.5f * ei + wr * oi + wi * or_;
+        }
+    }
+
+    // rows of the half spectrum
+    Transpose(bRe, half, cols, aRe);
+    Transpose(bIm, half, cols, aIm);
+    Transform(planX, aRe, aIm, half, bRe, bIm, half, false);
+
+    for (size_t i = 0; i < size; i ++)
+    {
+        xf[2 * i] = bRe[i];
+        xf[2 * i + 1] = bIm[i];
+    }
+}
+
+void VaKcfFft::InverseReal(const float *xf, int rows, int cols, float *x)
+{
+    int m = rows / 2;
+    int half = m + 1;
+    const Plan *planY = GetPlan(m);
+    const Plan *planX = GetPlan(cols);
+    size_t size = (size_t)half * cols;
+    thread_local std::vector<float> buffer;
+    buffer.resize(4 * size);
+    float *aRe = &buffer[0];
+    float *aIm = aRe + size;
+    float *bRe = aIm + size;
+    float *bIm = bRe + size;
+
+    for (size_t i = 0; i < size; i ++)
+    {
+        aRe[i] = xf[2 * i];
+        aIm[i] = xf[2 * i + 1];
+    }
+    Transform(planX, aRe, aIm, half, bRe, bIm, half, true);
+    Transpose(bRe, cols, half, aRe);
+    Transpose(bIm, cols, half, aIm);
+
+    // pack the spectra of the even and odd rows into one complex transform,
+    // z[k] = even[k] + i odd[k], both left at twice their value
+    const float *w = &planY->half[0];
+    for (int k = 0; k < m; k ++)
+    {
+        const float *yRe = aRe + (size_t)k * cols;
+        const float *yIm = aIm + (size_t)k * cols;
+        const float *cRe = aRe + (size_t)(m - k) * cols;
+        const float *cIm = aIm + (size_t)(m - k) * cols;
+        float *zRe = bRe + (size_t)k * cols;
+        float *zIm = bIm + (size_t)k * cols;
+        float wr = w[2 * k];
+        float wi = w[2 * k + 1];
+        for (int c = 0; c < cols; c ++)
+        {
+            // even = y[k] + conj(y[m - k]), odd = (y[k] - conj(y[m - k])) * conj(w^k)
+            float er = yRe[c] + cRe[c];
+            float ei = yIm[c] - cIm[c];
+            float dr = yRe[c] - cRe[c];
+            float di = yIm[c] + cIm[c];
+            float or_ = dr * wr + di * wi;
+            float oi = di * wr - dr * wi;
+            zRe[c] = er - oi;
+            zIm[c] = ei + or_;
+        }
+    }
+    Transform(planY, bRe, bIm, cols, aRe, aIm, cols, true);
+
+    float scale = 1.0f / ((float)rows * cols);
+    for (int k = 0; k < m; k ++)
+    {
+        float *even = x + (size_t)(2 * k) * cols;
+        float *odd = even + cols;
+        const float *zRe = aRe + (size_t)k * cols;
+        const float *zIm = aIm + (size_t)k * cols;
+        for (int c = 0; c < cols; c ++)
+        {
+            even[c] = zRe[c] * scale;
+            odd[c] = zIm[c] * scale;
+        }
+    }
+}
+
+void VaKcfFft::Forward(const cv::Mat &x, cv::Mat &xf)
+{
+    // KCF templates are an even number of cells high
+    assert(x.type() == CV_32F && (x.rows & 1) == 0);
+    cv::Mat src = x.isContinuous() ? x : x.clone();
+    xf.create(SpectrumSize(x.rows, x.cols), CV_32FC2);
+    ForwardReal(src.ptr<float>(), src.rows, src.cols, xf.ptr<float>());
+}
+
+void VaKcfFft::Inverse(const cv::Mat &xf, cv::Mat &x)
+{
+    assert(xf.type() == CV_32FC2 && xf.isContinuous());
+    int rows = 2 * (xf.cols - 1);
+    int cols = xf.rows;
+    x.create(rows, cols, CV_32F);
+    InverseReal(xf.ptr<float>(), rows, cols, x.ptr<float>());
+}
+
+void VaKcfFft::Multiply(const cv::Mat &a, const cv::Mat &b, cv::Mat &c)
+{
+    c.create(a.size(), CV_32FC2);
+    const float *pa = a.ptr<float>();
+    const float *pb = b.ptr<float>();
+    float *pc = c.ptr<float>();
+    int n = (int)a.total();
+    for (int i = 0; i < n; i ++)
+    {
+        float ar = pa[2 * i], ai = pa[2 * i + 1];
+        float br = pb[2 * i], bi = pb[2 * i + 1];
+        pc[2 * i]     = ar * br - ai * bi;
+        pc[2 * i + 1] = ar * bi + ai * br;
+    }
+}
+
+void VaKcfFft::Divide(const cv::Mat &a, const cv::Mat &b, float lambda, cv::Mat &c)
+{
+    c.create(a.size(), CV_32FC2);
+    const float *pa = a.ptr<float>();
+    const float *pb = b.ptr<float>();
+    float *pc = c.ptr<float>();
+    int n = (int)a.total();
+    for (int i = 0; i < n; i ++)
+    {
+        float ar = pa[2 * i], ai = pa[2 * i + 1];
+        float br = pb[2 * i] + lambda, bi = pb[2 * i + 1];
+        float d = 1.0f / (br * br + bi * bi);
+        pc[2 * i]     = (ar * br + ai * bi) * d;
+        pc[2 * i + 1] = (ai * br - ar * bi) * d;
+    }
+}
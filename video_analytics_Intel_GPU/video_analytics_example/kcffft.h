@@ -0,0 +1,88 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+
+/*
+// brief Real to complex FFT of KCF maps with cached plans
+*/
+
+#ifndef _KCFFFT_H_
+#define _KCFFFT_H_
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// 2D FFT of the real maps of a KCF tracker. The size of the maps is fixed
+// for a track, so the factorization, digit reversal and twiddles of every
+// transform length are computed once and kept in a plan cache shared by all
+// trackers, and every thread keeps the last few it used, so the trackers on
+// the pool don't take its lock. A real map of rows x cols has a conjugate
+// symmetric spectrum, so only the non-negative vertical frequencies are
+// computed: the columns are transformed first, two rows packed into one
+// complex row, then the rows of the half spectrum. The butterflies run on whole rows of independent
+// transforms, which is what the SIMD paths work on.
+//
+// A spectrum is a CV_32FC2 matrix of cols x (rows / 2 + 1), transposed
+// against the map. Only the pointwise operations below and Inverse() look
+// at it, they don't care about the layout. rows must be even, which the KCF
+// templates always are.
+class VaKcfFft
+{
+public:
+    // Spectrum of a continuous CV_32F map
+    static void Forward(const cv::Mat &x, cv::Mat &xf);
+    // Map of a spectrum, scaled by 1 / (rows * cols) so it is the inverse of Forward()
+    static void Inverse(const cv::Mat &xf, cv::Mat &x);
+    // Size of the spectrum of a rows x cols map
+    static cv::Size SpectrumSize(int rows, int cols) { return cv::Size(rows / 2 + 1, cols); }
+    // c = a * b, pointwise complex product
+    static void Multiply(const cv::Mat &a, const cv::Mat &b, cv::Mat &c);
+    // c = a / (b + lambda), pointwise complex quotient
+    static void Divide(const cv::Mat &a, const cv::Mat &b, float lambda, cv::Mat &c);
+
+    // Mixed radix factorization of n, the power of 2 first, and the digit
+    // reversal table and twiddles of it. The GPU transform kernels take the
+    // same tables
+    static int DFTFactorize(int n, int *factors);
+    static void DFTInit(int n0, int nf, int *factors, int *itab, int elem_size, float *_wave, int inv_itab);
+
+protected:
+    struct Plan
+    {
+        int n;
+        int nf;
+        int factors[34];
+        std::vector<int> itab;
+        // exp(-2 pi i k / n), interleaved
+        std::vector<float> wave;
+        // exp(-2 pi i k / 2n) for k <= n, to split the transform of two packed real rows
+        std::vector<float> half;
+    };
+
+    // Plan of length n, from a small cache of the calling thread
+    static const Plan *GetPlan(int n);
+    // Plan of length n from the cache shared by all threads, made on first use
+    static const Plan *LoadPlan(int n);
+    // Batched complex transform of length plan->n. Element k of every one of
+    // the lanes transforms is row k of the output, the input rows are read
+    // from src at srcStride floats apart
+    static void Transform(const Plan *plan, const float *srcRe, const float *srcIm, int srcStride,
+                          float *re, float *im, int lanes, bool inverse);
+    static void ForwardReal(const float *x, int rows, int cols, float *xf);
+    static void InverseReal(const float *xf, int rows, int cols, float *x);
+};
+
+#endif
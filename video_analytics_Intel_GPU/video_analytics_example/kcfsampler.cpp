@@ -0,0 +1,314 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+
+/*
+// brief Search window of a KCF tracker sampled from an NV12 frame
+*/
+
+#include "kcfsampler.h"
+#include <math.h>
+#include <string.h>
+#include "intelscalartbl.h"
+#if defined(HAVE_AVX2) || defined(HAVE_SSE)
+#include <immintrin.h>
+#endif
+
+// 1 / 32 pixel phases of the AVS tables
+#define AVS_PHASES 32
+
+int VaKcfSampler::ParseFilter(const std::string &name)
+{
+    if (name == "bilinear")
+        return FILTER_BILINEAR;
+    if (name == "avs")
+        return FILTER_AVS;
+    return -1;
+}
+
+const char *VaKcfSampler::FilterName(Filter filter)
+{
+    return (filter == FILTER_AVS) ? "avs" : "bilinear";
+}
+
+static inline int Clamp(int v, int lo, int hi)
+{
+    return (v < lo) ? lo : (v > hi) ? hi : v;
+}
+
+void VaKcfSampler::ComputeTaps(int size, int roiStart, int roiSize, int srcSize, bool chroma,
+                               const float (*table)[8], Taps &taps)
+{
+    // the roi and the frame in pixels of the plane
+    int lo = roiStart;
+    int hi = roiStart + roiSize - 1;
+    int n = srcSize;
+    if (chroma)
+    {
+        lo = (int)floorf(lo * 0.5f);
+        hi = (int)floorf(hi * 0.5f);
+        n = srcSize / 2;
+    }
+
+    // the AVS luma filter spans the pixels -3 .. 4 around the position, the
+    // chroma one only has its middle 4 coefficients set
+    int offset = 0;
+    int column = 0;
+    taps.count = 2;
+    if (table != NULL)
+    {
+        taps.count = chroma ? 4 : 8;
+        offset = chroma ? -1 : -3;
+        column = chroma ? 2 : 0;
+    }
+    taps.size = size;
+    taps.index.resize(taps.count * size);
+    taps.weight.resize(taps.count * size);
+    taps.first = n - 1;
+    taps.last = 0;
+
+    float scale = (float)roiSize / size;
+    for (int x = 0; x < size; x ++)
+    {
+        // pixel centers line up, as in cv::resize()
+        float position = roiStart + (x + 0.5f) * scale - 0.5f;
+        if (chroma)
+        {
+            position = (position + 0.5f) * 0.5f - 0.5f;
+        }
+        int base = (int)floorf(position);
+        float fraction = position - base;
+        int phase = 0;
+        if (table != NULL)
+        {
+            phase = (int)(fraction * AVS_PHASES + 0.5f);
+            if (phase == AVS_PHASES)
+            {
+                base ++;
+                phase = 0;
+            }
+        }
+
+        for (int k = 0; k < taps.count; k ++)
+        {
+            int index = Clamp(Clamp(base + offset + k, lo, hi), 0, n - 1);
+            taps.index[k * size + x] = index;
+            if (table != NULL)
+                taps.weight[k * size + x] = table[phase][column + k];
+            else
+                taps.weight[k * size + x] = (k == 0) ? 1.0f - fraction : fraction;
+            taps.first = (index < taps.first) ? index : taps.first;
+            taps.last = (index > taps.last) ? index : taps.last;
+        }
+    }
+}
+
+void VaKcfSampler::FilterColumn(const unsigned char *const *rows, const float *weight, int count,
+                                int first, int last, float *line)
+{
+    int i = first;
+#if defined(HAVE_AVX2)
+    for (; i + 8 <= last + 1; i += 8)
+    {
+        __m256 acc = _mm256_setzero_ps();
+        for (int k = 0; k < count; k ++)
+        {
+            __m256i pixels = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(rows[k] + i)));
+            acc = _mm256_fmadd_ps(_mm256_set1_ps(weight[k]), _mm256_cvtepi32_ps(pixels), acc);
+        }
+        _mm256_storeu_ps(line + i, acc);
+    }
+#elif defined(HAVE_SSE)
+    for (; i + 4 <= last + 1; i += 4)
+    {
+        __m128 acc = _mm_setzero_ps();
+        for (int k = 0; k < count; k ++)
+        {
+            int quad;
+            memcpy(&quad, rows[k] + i, sizeof(quad));
+            __m128i pixels = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(quad));
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(weight[k]), _mm_cvtepi32_ps(pixels)));
+        }
+        _mm_storeu_ps(line + i, acc);
+    }
+#endif
+    for (; i <= last; i ++)
+    {
+        float acc = 0;
+        for (int k = 0; k < count; k ++)
+        {
+            acc += weight[k] * rows[k][i];
+        }
+        line[i] = acc;
+    }
+}
+
+void VaKcfSampler::FilterRow(const float *line, int stride, const Taps &taps, float *out)
+{
+    int x = 0;
+    int size = taps.size;
+#if defined(HAVE_AVX2)
+    // the taps of a pixel are scattered over the line, they are gathered
+    __m256i vstride = _mm256_set1_epi32(stride);
+    for (; x + 8 <= size; x += 8)
+    {
+        __m256 acc = _mm256_setzero_ps();
+        for (int k = 0; k < taps.count; k ++)
+        {
+            __m256i index = _mm256_loadu_si256((const __m256i *)(taps.index.data() + k * size + x));
+            __m256 pixels = _mm256_i32gather_ps(line, _mm256_mullo_epi32(index, vstride), 4);
+            acc = _mm256_fmadd_ps(_mm256_loadu_ps(taps.weight.data() + k * size + x), pixels, acc);
+        }
+        _mm256_storeu_ps(out + x, acc);
+    }
+#endif
+    for (; x < size; x ++)
+    {
+        float acc = 0;
+        for (int k = 0; k < taps.count; k ++)
+        {
+            acc += taps.weight[k * size + x] * line[taps.index[k * size + x] * stride];
+        }
+        out[x] = acc;
+    }
+}
+
+static inline unsigned char Saturate(float v)
+{
+    int i = (int)lrintf(v);
+    return (unsigned char)((i < 0) ? 0 : (i > 255) ? 255 : i);
+}
+
+// Rounded luma of a row
+static void StoreGray(const float *luma, int width, unsigned char *dst)
+{
+    int x = 0;
+#if defined(HAVE_AVX2)
+    for (; x + 8 <= width; x += 8)
+    {
+        __m256i y = _mm256_cvtps_epi32(_mm256_loadu_ps(luma + x));
+        __m128i v = _mm_packs_epi32(_mm256_castsi256_si128(y), _mm256_extracti128_si256(y, 1));
+        _mm_storel_epi64((__m128i *)(dst + x), _mm_packus_epi16(v, v));
+    }
+#endif
+    for (; x < width; x ++)
+    {
+        dst[x] = Saturate(luma[x]);
+    }
+}
+
+// BGR of a row with the fixed point BT.601 matrix of the GPU kernels, in
+// 1 / 256 units: the YUV2RGB rows are R, G and B, the columns Y, U, V and
+// the offset
+static void StoreBgr(const float *luma, const float *cb, const float *cr, int width, unsigned char *dst)
+{
+    const float s = 1.0f / 256;
+    int x = 0;
+#if defined(HAVE_AVX2)
+    __m256 ky = _mm256_set1_ps(YUV2RGB[0] * s);
+    __m256 rv = _mm256_set1_ps(YUV2RGB[2] * s);
+    __m256 r0 = _mm256_set1_ps(YUV2RGB[3] * s);
+    __m256 gu = _mm256_set1_ps(YUV2RGB[5] * s);
+    __m256 gv = _mm256_set1_ps(YUV2RGB[6] * s);
+    __m256 g0 = _mm256_set1_ps(YUV2RGB[7] * s);
+    __m256 bu = _mm256_set1_ps(YUV2RGB[9] * s);
+    __m256 b0 = _mm256_set1_ps(YUV2RGB[11] * s);
+    for (; x + 8 <= width; x += 8)
+    {
+        __m256 y = _mm256_mul_ps(ky, _mm256_loadu_ps(luma + x));
+        __m256 u = _mm256_loadu_ps(cb + x);
+        __m256 v = _mm256_loadu_ps(cr + x);
+        __m256i r = _mm256_cvtps_epi32(_mm256_fmadd_ps(rv, v, _mm256_add_ps(y, r0)));
+        __m256i g = _mm256_cvtps_epi32(_mm256_fmadd_ps(gv, v, _mm256_fmadd_ps(gu, u, _mm256_add_ps(y, g0))));
+        __m256i b = _mm256_cvtps_epi32(_mm256_fmadd_ps(bu, u, _mm256_add_ps(y, b0)));
+        // 8 bytes of each, saturated, then interleaved
+        __m256i bg = _mm256_packs_epi32(b, g);
+        __m256i rr = _mm256_packs_epi32(r, r);
+        bg = _mm256_permute4x64_epi64(bg, 0xd8);
+        rr = _mm256_permute4x64_epi64(rr, 0xd8);
+        __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(bg), _mm256_extracti128_si256(bg, 1));
+        __m128i red = _mm_packus_epi16(_mm256_castsi256_si128(rr), _mm256_castsi256_si128(rr));
+        // b0..b7 g0..g7 in bytes, r0..r7 in the low half of red
+        __m128i lo = _mm_shuffle_epi8(bytes, _mm_setr_epi8(0, 8, -1, 1, 9, -1, 2, 10, -1, 3, 11, -1, 4, 12, -1, 5));
+        lo = _mm_or_si128(lo, _mm_shuffle_epi8(red, _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1)));
+        __m128i hi = _mm_shuffle_epi8(bytes, _mm_setr_epi8(13, -1, 6, 14, -1, 7, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+        hi = _mm_or_si128(hi, _mm_shuffle_epi8(red, _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, -1, -1, -1, -1, -1, -1)));
+        _mm_storeu_si128((__m128i *)(dst + x * 3), lo);
+        _mm_storel_epi64((__m128i *)(dst + x * 3 + 16), hi);
+    }
+#endif
+    for (; x < width; x ++)
+    {
+        float y = YUV2RGB[0] * s * luma[x];
+        dst[x * 3 + 0] = Saturate(y + YUV2RGB[11] * s + YUV2RGB[9] * s * cb[x]);
+        dst[x * 3 + 1] = Saturate(y + YUV2RGB[7] * s + YUV2RGB[5] * s * cb[x] + YUV2RGB[6] * s * cr[x]);
+        dst[x * 3 + 2] = Saturate(y + YUV2RGB[3] * s + YUV2RGB[2] * s * cr[x]);
+    }
+}
+
+void VaKcfSampler::Sample(const cv::Mat &nv12, const cv::Rect &roi, cv::Size size, int channels,
+                          Filter filter, cv::Mat &dst)
+{
+    int width = nv12.cols;
+    int height = nv12.rows * 2 / 3;
+    bool avs = (filter == FILTER_AVS);
+
+    // the taps only depend on the roi and are cheap, the lines are per thread
+    // as the trackers of a frame may run on a pool
+    thread_local Taps lumaX, lumaY, chromaX, chromaY;
+    thread_local std::vector<float> line, luma, cb, cr;
+    ComputeTaps(size.width, roi.x, roi.width, width, false, avs ? Tbl0X : NULL, lumaX);
+    ComputeTaps(size.height, roi.y, roi.height, height, false, avs ? Tbl0Y : NULL, lumaY);
+    line.resize(width);
+    luma.resize(size.width);
+    if (channels == 3)
+    {
+        ComputeTaps(size.width, roi.x, roi.width, width, true, avs ? Tbl1X : NULL, chromaX);
+        ComputeTaps(size.height, roi.y, roi.height, height, true, avs ? Tbl1Y : NULL, chromaY);
+        cb.resize(size.width);
+        cr.resize(size.width);
+    }
+    dst.create(size, (channels == 3) ? CV_8UC3 : CV_8UC1);
+
+    const unsigned char *rows[8];
+    float weight[8];
+    for (int j = 0; j < size.height; j ++)
+    {
+        for (int k = 0; k < lumaY.count; k ++)
+        {
+            rows[k] = nv12.ptr(lumaY.index[k * size.height + j]);
+            weight[k] = lumaY.weight[k * size.height + j];
+        }
+        FilterColumn(rows, weight, lumaY.count, lumaX.first, lumaX.last, line.data());
+        FilterRow(line.data(), 1, lumaX, luma.data());
+        if (channels != 3)
+        {
+            StoreGray(luma.data(), size.width, dst.ptr(j));
+            continue;
+        }
+
+        // the UV line is filtered as it is interleaved, then split by the row taps
+        for (int k = 0; k < chromaY.count; k ++)
+        {
+            rows[k] = nv12.ptr(height + chromaY.index[k * size.height + j]);
+            weight[k] = chromaY.weight[k * size.height + j];
+        }
+        FilterColumn(rows, weight, chromaY.count, chromaX.first * 2, chromaX.last * 2 + 1, line.data());
+        FilterRow(line.data(), 2, chromaX, cb.data());
+        FilterRow(line.data() + 1, 2, chromaX, cr.data());
+        StoreBgr(luma.data(), cb.data(), cr.data(), size.width, dst.ptr(j));
+    }
+}
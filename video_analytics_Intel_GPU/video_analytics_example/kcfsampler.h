@@ -0,0 +1,83 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+
+/*
+// brief Search window of a KCF tracker sampled from an NV12 frame
+*/
+
+#ifndef _KCFSAMPLER_H_
+#define _KCFSAMPLER_H_
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+// CPU counterpart of the AVS sampler the GPU backend crops and scales the
+// padded roi with. The template is filtered straight out of the Y and UV
+// planes of the frame, separably: the rows the taps of an output row need are
+// filtered vertically into a line, then the line horizontally into the output
+// pixels, and the luma and chroma converted to BGR on the way out. Taps outside
+// the roi repeat its border, as cv::resize() does, and taps outside the frame
+// the border of the frame, as RectTools::subwindow() with BORDER_REPLICATE
+// does, so there is no copy of the window and no full size conversion.
+class VaKcfSampler
+{
+public:
+    enum Filter
+    {
+        FILTER_BILINEAR = 0,
+        // the 8 tap luma and 4 tap chroma polyphase coefficients the GPU
+        // sampler is set up with in intelscalar.cpp
+        FILTER_AVS      = 1
+    };
+
+    // size pixels of the roi of nv12, a width x height * 3 / 2 CV_8UC1 frame.
+    // dst is CV_8UC3 BGR for channels 3, CV_8UC1 luma for channels 1
+    static void Sample(const cv::Mat &nv12, const cv::Rect &roi, cv::Size size, int channels,
+                       Filter filter, cv::Mat &dst);
+    // "bilinear" or "avs", -1 for anything else
+    static int ParseFilter(const std::string &name);
+    static const char *FilterName(Filter filter);
+
+protected:
+    // Taps of every output pixel along one axis, tap k of pixel x at k * size + x
+    // so the vector paths load the taps of neighbouring pixels together
+    struct Taps
+    {
+        int count;
+        int size;
+        std::vector<int> index;
+        std::vector<float> weight;
+        // range of the source indices of all taps
+        int first;
+        int last;
+    };
+
+    // Taps of the size output pixels of roiStart .. roiStart + roiSize in a
+    // plane of srcSize pixels, half the luma ones for chroma. table is one of
+    // the AVS coefficient tables, NULL for bilinear
+    static void ComputeTaps(int size, int roiStart, int roiSize, int srcSize, bool chroma,
+                            const float (*table)[8], Taps &taps);
+    // line[i] = sum of weight[k] * rows[k][i] over the taps, for i in first .. last
+    static void FilterColumn(const unsigned char *const *rows, const float *weight, int count,
+                             int first, int last, float *line);
+    // out[x] = sum of taps.weight * line[taps.index * stride] over the taps of x,
+    // stride 2 picks one component of a UV line
+    static void FilterRow(const float *line, int stride, const Taps &taps, float *out);
+};
+
+#endif
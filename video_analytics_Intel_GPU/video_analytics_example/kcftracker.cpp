@@ -82,7 +82,6 @@ the use of this software, even if advised of the possibility of such damage.
 
 #ifndef _KCFTRACKER_HEADERS
 #include "kcftracker.hpp"
-#include "ffttools.hpp"
 #include "recttools.hpp"
 #include "fhog.hpp"
 #include "labdata.hpp"
@@ -93,6 +92,8 @@ the use of this software, even if advised of the possibility of such damage.
 #include "fhog.hpp"
 #include "opencv2/imgproc/imgproc_c.h"
 #include "intelscalartbl.h"
+#include "kcfcorrelation.h"
+#include "kcffft.h"
 using namespace std;
 
 
@@ -108,10 +109,21 @@ KCFTracker::KCFTracker(bool hog, bool fixed_window, bool multiscale, bool lab):
     padding(0.0),
     output_sigma_factor(0.0),
     template_size(0),
+    scale_step(1.0),
+    scale_weight(1.0),
+    train_interval(s_trainInterval),
+    stable_peak(0.5f),
+    reuse_features(s_reuseFeatures),
     _scale(0.0),
     _gaussian_size(0),
     _hogfeatures(false),
     _labfeatures(false),
+    _peak_value(0.0),
+    _framesSinceTrain(0),
+    _backend(s_backend),
+    _surface(0),
+    _frameWidth(0),
+    _frameHeight(0),
 
     featureKernel(NULL),
     processKernel(NULL),
@@ -202,33 +214,87 @@ KCFTracker::KCFTracker(bool hog, bool fixed_window, bool multiscale, bool lab):
 
     // use multiple scale only
     template_size = 96;
-   // scale_step = 1.20;//1.05;
-   // scale_weight = 0.95;
+    scale_step = multiscale ? 1.05 : 1;
+    scale_weight = 0.95;
 
     memset(&sInParamConfig, 0, sizeof(sInParamConfig));
 
     //Initialize MDF kernel
-    initMDF();
+    if (_backend == BACKEND_GPU && initMDF() != 0)
+    {
+        std::cout<<"KCF: no GPU, tracking on the CPU"<<std::endl;
+        _backend = BACKEND_CPU;
+    }
     
 }
 
 // Initialize tracker 
 void KCFTracker::init(const cv::Rect &roi, unsigned int vaSurfaceID, int width, int height)
+{
+    _surface = vaSurfaceID;
+    _frame.release();
+    _frameWidth = width;
+    _frameHeight = height;
+    initModel(roi);
+}
+
+void KCFTracker::init(const cv::Rect &roi, const cv::Mat &frame)
+{
+    _frame = frame;
+    _frameWidth = frame.cols;
+    _frameHeight = (frame.channels() == 1) ? frame.rows * 2 / 3 : frame.rows;
+    initModel(roi);
+    _frame.release();
+}
+
+void KCFTracker::initModel(const cv::Rect &roi)
 {
     _roi = roi;
     assert(roi.width >= 0 && roi.height >= 0);
 
-    _tmpl = getFeatures(vaSurfaceID, 1, 1.0f, width, height);
+    _tmpl = getFrameFeatures(1, 1.0f);
     _prob = createGaussianPeak(size_patch[0], size_patch[1]);
-    _alphaf = cv::Mat(size_patch[0], size_patch[1], CV_32FC2, float(0));
+    _alphaf = cv::Mat(VaKcfFft::SpectrumSize(size_patch[0], size_patch[1]), CV_32FC2, float(0));
     train(_tmpl, 1.0); // train with initial frame
+    _peak_value = 0;
+    _framesSinceTrain = 0;
  }
 // Update position based on the new frame
 cv::Rect KCFTracker::update(unsigned int vaSurfaceID,  int width, int  height)
+{
+    _surface = vaSurfaceID;
+    _frame.release();
+    _frameWidth = width;
+    _frameHeight = height;
+    return updateModel();
+}
+
+cv::Rect KCFTracker::update(const cv::Mat &frame)
+{
+    _frame = frame;
+    _frameWidth = frame.cols;
+    _frameHeight = (frame.channels() == 1) ? frame.rows * 2 / 3 : frame.rows;
+    cv::Rect roi = updateModel();
+    _frame.release();
+    return roi;
+}
+
+void KCFTracker::correct(const cv::Rect &roi)
+{
+    if (roi.width <= 0 || roi.height <= 0 || _roi.width <= 0 || _roi.height <= 0)
+        return;
+    // the template keeps its size in cells, only the window it is sampled from scales
+    _scale *= sqrtf((float) roi.width * roi.height / (_roi.width * _roi.height));
+    _roi = roi;
+}
+
+cv::Rect KCFTracker::updateModel()
 {
     std::chrono::high_resolution_clock::time_point tmStart;
     std::chrono::high_resolution_clock::time_point tmEnd;
     chrono::duration<double> diffTime;
+    int width = _frameWidth;
+    int height = _frameHeight;
 
     tmStart = std::chrono::high_resolution_clock::now();
 
@@ -241,35 +307,41 @@ cv::Rect KCFTracker::update(unsigned int vaSurfaceID,  int width, int  height)
     float cy = _roi.y + _roi.height / 2.0f;
 
 
-    float peak_value;
-    //Test at a original size
-    cv::Point2f res = detect(_tmpl, getFeatures(vaSurfaceID, 0, 1.0f, width, height), peak_value);
-
-    /*if (scale_step != 1) {
-        // Test at a smaller _scale
-        float new_peak_value;
-        cv::Point2f new_res = detect(_tmpl, getFeatures(vaSurfaceID, 0, 1.0f / scale_step, width, height), new_peak_value);
-
-        if (scale_weight * new_peak_value > peak_value) {
-            res = new_res;
-            peak_value = new_peak_value;
-            _scale /= scale_step;
-            _roi.width /= scale_step;
-            _roi.height /= scale_step;
-        }
-
-        // Test at a bigger _scale
-        new_res = detect(_tmpl, getFeatures(vaSurfaceID, 0, scale_step, width, height), new_peak_value);
+    // Test at the original scale, and with scale_step a smaller and a bigger
+    // one. The CPU backend runs them on the tracking pool, as they only read
+    // the model; the GPU trackers share a CM queue and take turns
+    float scales[3] = { 1.0f, 1.0f / scale_step, scale_step };
+    int nScales = (scale_step != 1) ? 3 : 1;
+    cv::Mat zs[3];
+    cv::Point2f results[3];
+    float peaks[3];
+    auto search = [&](int i) {
+        zs[i] = getFrameFeatures(0, scales[i]);
+        results[i] = detect(_tmpl, zs[i], peaks[i]);
+    };
+    if (nScales > 1 && _backend == BACKEND_CPU && s_executor != NULL)
+        s_executor->ParallelFor(nScales, search);
+    else
+        for (int i = 0; i < nScales; i++)
+            search(i);
 
-        if (scale_weight * new_peak_value > peak_value) {
-            res = new_res;
-            peak_value = new_peak_value;
-            _scale *= scale_step;
-            _roi.width *= scale_step;
-            _roi.height *= scale_step;
-        }
+    int best = 0;
+    for (int i = 1; i < nScales; i++) {
+        if (scale_weight * peaks[i] > peaks[best])
+            best = i;
+    }
+    if (best != 0) {
+        _scale *= scales[best];
+        _roi.width *= scales[best];
+        _roi.height *= scales[best];
     }
-    */
+    cv::Mat z = zs[best];
+    cv::Point2f res = results[best];
+    float peak_value = peaks[best];
+
+    // a high peak that barely changed from the last frame, the target is locked
+    bool stable = peak_value >= stable_peak && fabs(peak_value - _peak_value) <= 0.1f * _peak_value;
+    _peak_value = peak_value;
 
     // Adjust by cell size and _scale
     _roi.x = cx - _roi.width / 2.0f + ((float) res.x * cell_size * _scale);
@@ -281,7 +353,22 @@ cv::Rect KCFTracker::update(unsigned int vaSurfaceID,  int width, int  height)
     if (_roi.y + _roi.height <= 0) _roi.y = -_roi.height + 2;
 
     assert(_roi.width >= 0 && _roi.height >= 0);
-    cv::Mat x = getFeatures(vaSurfaceID, 0, 1.0f, width, height);
+
+    // A locked target is only trained every train_interval frames, the
+    // frames in between keep the model as it is
+    _framesSinceTrain ++;
+    if (train_interval > 1 && stable && _framesSinceTrain < train_interval)
+        return _roi;
+
+    // Under a cell of displacement the features of the detection are what a
+    // new extraction would give, but for the sub-cell shift. Those of the
+    // scale picked are taken at what is now the template scale. This is
+    // independent of train_interval, it saves an extraction on every frame
+    cv::Mat x;
+    if (reuse_features && fabs(res.x) < 1.0f && fabs(res.y) < 1.0f)
+        x = z;
+    else
+        x = getFrameFeatures(0, 1.0f);
 
     tmEnd = std::chrono::high_resolution_clock::now();
     diffTime  = tmEnd   - tmStart;
@@ -289,7 +376,13 @@ cv::Rect KCFTracker::update(unsigned int vaSurfaceID,  int width, int  height)
         
     tmStart = std::chrono::high_resolution_clock::now();
 
-    train(x, interp_factor);
+    // one blend for the frames since the last training decays the old model
+    // as much as a blend on every one of them would have
+    float factor = interp_factor;
+    if (_framesSinceTrain > 1)
+        factor = 1.0f - powf(1.0f - interp_factor, (float)_framesSinceTrain);
+    train(x, factor);
+    _framesSinceTrain = 0;
     tmEnd = std::chrono::high_resolution_clock::now();
         diffTime  = tmEnd   - tmStart;
     //    std::cout<< "  Update 2nd part  takes: :" << diffTime.count()*1000 <<"(ms)"<<std::endl;
@@ -304,13 +397,25 @@ cv::Rect KCFTracker::update(unsigned int vaSurfaceID,  int width, int  height)
 // Detect object in the current frame.
 cv::Point2f KCFTracker::detect(cv::Mat z, cv::Mat x, float &peak_value)
 {
-    using namespace FFTTools;
     std::chrono::high_resolution_clock::time_point tmStart;
     std::chrono::high_resolution_clock::time_point tmEnd;
     tmStart = std::chrono::high_resolution_clock::now();
 
-    cv::Mat k = gaussianCorrelation_gpu(x, z);
-    cv::Mat res = (real(fftd(complexMultiplication(_alphaf, fftd(k)), true)));
+    cv::Mat k;
+    if (_backend == BACKEND_GPU) {
+        k = gaussianCorrelation_gpu(x, z);
+    }
+    else {
+        // z is the template, its spectra are kept up to date by train()
+        std::vector<cv::Mat> xf;
+        VaKcfCorrelation::Spectra(x, size_patch[0], size_patch[1], xf);
+        k = VaKcfCorrelation::Gaussian(xf, VaKcfCorrelation::Energy(x), _tmplf, VaKcfCorrelation::Energy(z),
+                                       size_patch[0]*size_patch[1]*size_patch[2], sigma);
+    }
+    cv::Mat kf, res;
+    VaKcfFft::Forward(k, kf);
+    VaKcfFft::Multiply(_alphaf, kf, kf);
+    VaKcfFft::Inverse(kf, res);
 
     //minMaxLoc only accepts doubles for the peak, and integer points for the coordinates
     cv::Point2i pi;
@@ -341,13 +446,25 @@ cv::Point2f KCFTracker::detect(cv::Mat z, cv::Mat x, float &peak_value)
 // train tracker with a single image
 void KCFTracker::train(cv::Mat x, float train_interp_factor)
 {
-    using namespace FFTTools;
     std::chrono::high_resolution_clock::time_point tmStart;
     std::chrono::high_resolution_clock::time_point tmEnd;
     tmStart = std::chrono::high_resolution_clock::now();
 
-    cv::Mat k = gaussianCorrelation_gpu(x, x);
-    cv::Mat alphaf = complexDivision(_prob, (fftd(k) + lambda));
+    cv::Mat k;
+    if (_backend == BACKEND_GPU) {
+        k = gaussianCorrelation_gpu(x, x);
+    }
+    else {
+        std::vector<cv::Mat> xf;
+        VaKcfCorrelation::Spectra(x, size_patch[0], size_patch[1], xf);
+        double xx = VaKcfCorrelation::Energy(x);
+        k = VaKcfCorrelation::Gaussian(xf, xx, xf, xx, size_patch[0]*size_patch[1]*size_patch[2], sigma);
+        // the transform is linear, blend the template spectra like the template
+        VaKcfCorrelation::Interpolate(_tmplf, xf, train_interp_factor);
+    }
+    cv::Mat kf, alphaf;
+    VaKcfFft::Forward(k, kf);
+    VaKcfFft::Divide(_prob, kf, lambda, alphaf);
     
     _tmpl = (1 - train_interp_factor) * _tmpl + (train_interp_factor) * x;
     _alphaf = (1 - train_interp_factor) * _alphaf + (train_interp_factor) * alphaf;
@@ -365,46 +482,6 @@ void KCFTracker::train(cv::Mat x, float train_interp_factor)
 
 }
 
-// Evaluates a Gaussian kernel with bandwidth SIGMA for all relative shifts between input images X and Y, which must both be MxN. They must    also be periodic (ie., pre-processed with a cosine window).
-cv::Mat KCFTracker::gaussianCorrelation(cv::Mat x1, cv::Mat x2)
-{
-    using namespace FFTTools;
-
-    std::chrono::high_resolution_clock::time_point tmStart;
-    std::chrono::high_resolution_clock::time_point tmEnd;
-    tmStart = std::chrono::high_resolution_clock::now();
-    //std::cout<<"size_patch[0]:"<<size_patch[0]<<" size_patch[1]:"<<size_patch[1]<< " size_patch[2]"<<size_patch[2]<<std::endl;
-    cv::Mat c = cv::Mat( cv::Size(size_patch[1], size_patch[0]), CV_32F, cv::Scalar(0) );
-    // HOG features
-    if (1) {
-        cv::Mat caux;
-        cv::Mat x1aux;
-        cv::Mat x2aux;
-        //std::cout<<"row:"<<x1.rows<<" cols:"<<x1.cols<<std::endl;
-        for (int i = 0; i < size_patch[2]; i++) {
-            x1aux = x1.row(i);   // Procedure do deal with cv::Mat multichannel bug
-            x1aux = x1aux.reshape(1, size_patch[0]);
-            x2aux = x2.row(i).reshape(1, size_patch[0]);
-            cv::mulSpectrums(fftd(x1aux), fftd(x2aux), caux, 0, true); 
-            caux = fftd(caux, true);
-            rearrange(caux);
-            caux.convertTo(caux,CV_32F);
-            c = c + real(caux);
-        }
-    }
-
-    cv::Mat d; 
-    cv::max(( (cv::sum(x1.mul(x1))[0] + cv::sum(x2.mul(x2))[0])- 2. * c) / (size_patch[0]*size_patch[1]*size_patch[2]) , 0, d);
-
-    cv::Mat k;
-    cv::exp((-d / (sigma * sigma)), k);
-
-
-    tmEnd = std::chrono::high_resolution_clock::now();
-    chrono::duration<double> diffTime  = tmEnd   - tmStart;
-    std::cout<< "  >gaussianCorrelation takes:" << diffTime.count()*1000 <<"(ms)"<<std::endl;
-    return c;
-}
 extern int gpu_gaussianCorrelation(unsigned char* InputBuffer0, unsigned char *InputBuffer1, unsigned short usWidth, unsigned short usHeight, unsigned char uChannel, unsigned short usPitchX, unsigned short usPitchY, unsigned short usPitchZ, unsigned char *Outputbuffer);
 
 cv::Mat KCFTracker::gaussianCorrelation_gpu(cv::Mat x1, cv::Mat x2)
@@ -452,19 +529,14 @@ cv::Mat KCFTracker::createGaussianPeak(int sizey, int sizex)
             int jh = j - sxh;
             res(i, j) = std::exp(mult * (float) (ih * ih + jh * jh));
         }
-    return FFTTools::fftd(res);
+    cv::Mat resf;
+    VaKcfFft::Forward(res, resf);
+    return resf;
 }
 
 
-// Obtain sub-window from image, with replication-padding and extract features
-cv::Mat KCFTracker::getFeatures(unsigned int vaSurfaceID, bool inithann, float scale_adjust, int rawWidth, int rawHeight)
+cv::Rect KCFTracker::getExtractedRoi(bool inithann, float scale_adjust)
 {
-
-    std::chrono::high_resolution_clock::time_point tmStart;
-    std::chrono::high_resolution_clock::time_point tmEnd;
-    chrono::duration<double> diffTime;
-    tmStart = std::chrono::high_resolution_clock::now();
-
     cv::Rect extracted_roi;
 
     float cx = _roi.x + _roi.width / 2;
@@ -503,35 +575,83 @@ cv::Mat KCFTracker::getFeatures(unsigned int vaSurfaceID, bool inithann, float s
     // center roi with new size
     extracted_roi.x = cx - extracted_roi.width / 2;
     extracted_roi.y = cy - extracted_roi.height / 2;
-    cv::Mat FeaturesMap; 
-
-    if (1) {
-      
-
-        getFeatureMaps_gpu(vaSurfaceID, extracted_roi, rawWidth, rawHeight, _tmpl_sz.width, _tmpl_sz.height,cell_size, &SVMFeaturemap);
+    return extracted_roi;
+}
 
-        if (SVMFeaturemap)
-        { 
-            size_patch[0] = SVMFeaturemap->sizeY;
-            size_patch[1] = SVMFeaturemap->sizeX;
-            size_patch[2] = SVMFeaturemap->numFeatures;
+cv::Mat KCFTracker::packFeatures(const CvLSVMFeatureMapCaskade *map, bool inithann)
+{
+    cv::Mat FeaturesMap; 
 
-            FeaturesMap = cv::Mat(cv::Size(SVMFeaturemap->numFeatures,SVMFeaturemap->sizeX*SVMFeaturemap->sizeY), CV_32F, SVMFeaturemap->map);  // Procedure do deal with cv::Mat multichannel bug
-            FeaturesMap = FeaturesMap.t();
+    if (map)
+    { 
+        // the template size only changes on init, the scales searched in
+        // parallel leave it alone
+        if (inithann) {
+            size_patch[0] = map->sizeY;
+            size_patch[1] = map->sizeX;
+            size_patch[2] = map->numFeatures;
         }
-       // freeFeatureMapObject(&map);
+
+        FeaturesMap = cv::Mat(cv::Size(map->numFeatures,map->sizeX*map->sizeY), CV_32F, map->map);  // Procedure do deal with cv::Mat multichannel bug
+        FeaturesMap = FeaturesMap.t();
     }
  
     if (inithann) {
         createHanningMats();
     }
    
-    FeaturesMap = hann.mul(FeaturesMap);
-    tmEnd = std::chrono::high_resolution_clock::now();
-    diffTime  = tmEnd   - tmStart;
-   // std::cout<< "  >GetFeatures takes:" << diffTime.count()*1000 <<"(ms)"<<std::endl;
+    return hann.mul(FeaturesMap);
+}
+
+cv::Mat KCFTracker::getFrameFeatures(bool inithann, float scale_adjust)
+{
+    if (!_frame.empty())
+        return getFeatures(_frame, inithann, scale_adjust);
+    return getFeatures(_surface, inithann, scale_adjust, _frameWidth, _frameHeight);
+}
+
+// Obtain sub-window from image, with replication-padding and extract features
+cv::Mat KCFTracker::getFeatures(unsigned int vaSurfaceID, bool inithann, float scale_adjust, int rawWidth, int rawHeight)
+{
+    cv::Rect extracted_roi = getExtractedRoi(inithann, scale_adjust);
+
+    getFeatureMaps_gpu(vaSurfaceID, extracted_roi, rawWidth, rawHeight, _tmpl_sz.width, _tmpl_sz.height,cell_size, &SVMFeaturemap);
+
+    return packFeatures(SVMFeaturemap, inithann);
+}
+
+cv::Mat KCFTracker::getFeatures(const cv::Mat &frame, bool inithann, float scale_adjust)
+{
+    cv::Rect extracted_roi = getExtractedRoi(inithann, scale_adjust);
+
+    cv::Mat z;
+    if (frame.channels() == 1) {
+        // cropped, scaled and converted in one pass, like the GPU sampler does
+        VaKcfSampler::Sample(frame, extracted_roi, _tmpl_sz, 3, s_sampler, z);
+    } else {
+        z = RectTools::subwindow(frame, extracted_roi, cv::BORDER_REPLICATE);
+        if (z.cols != _tmpl_sz.width || z.rows != _tmpl_sz.height) {
+            cv::resize(z, z, _tmpl_sz);
+        }
+    }
 
-    return FeaturesMap;
+    // HOG features
+    IplImage z_ipl = z;
+    // the per pixel buffers of fHOG are kept per thread, for all the trackers
+    // and scales that run on it
+    thread_local CvLSVMFeatureScratch hogScratch;
+    CvLSVMFeatureMapCaskade *map;
+    getFeatureMaps(&z_ipl, cell_size, &map, &hogScratch);
+
+    // normalized, truncated and reduced in one pass straight into features
+    CvLSVMFeatureMapCaskade pca = { map->sizeX - 2, map->sizeY - 2, NUM_SECTOR * 3 + 4, NULL };
+    cv::Mat features(pca.sizeX * pca.sizeY, pca.numFeatures, CV_32F);
+    pca.map = (float *)features.data;
+    normalizeTruncatePCA(map, 0.2f, pca.map, &hogScratch);
+    freeFeatureMapObject(&map);
+
+    // packFeatures() copies the map out in the transpose
+    return packFeatures(&pca, inithann);
 }
     
 // Initialize Hanning window. Function called only in the first frame.
@@ -571,8 +691,64 @@ float KCFTracker::subPixelPeak(float left, float center, float right)
 
 extern VADisplay m_va_dpy;
 CmDevice* KCFTracker::pCmDev =NULL;
+KCFTracker::Backend KCFTracker::s_backend = KCFTracker::BACKEND_GPU;
+VaKcfSampler::Filter KCFTracker::s_sampler = VaKcfSampler::FILTER_BILINEAR;
+int KCFTracker::s_trainInterval = 1;
+bool KCFTracker::s_reuseFeatures = true;
+VaTaskExecutor *KCFTracker::s_executor = NULL;
 
-int KCFTracker::initMDF()
+#define KCF_CORRELATION_ISA "../../kcfGPU/kcf_correlation_genx.isa"
+#define KCF_FEATURE_ISA     "../../kcfGPU/kcf_featrue_genx.isa"
+
+static bool fileExists(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return false;
+    fclose(file);
+    return true;
+}
+
+int KCFTracker::selectBackend(Backend backend)
+{
+    if (backend != BACKEND_CPU)
+    {
+        bool gpu = (createDevice() == 0 && fileExists(KCF_CORRELATION_ISA) && fileExists(KCF_FEATURE_ISA));
+        if (!gpu && backend == BACKEND_GPU)
+        {
+            return -1;
+        }
+        backend = gpu ? BACKEND_GPU : BACKEND_CPU;
+    }
+    s_backend = backend;
+    return backend;
+}
+
+int KCFTracker::parseBackend(const std::string &name)
+{
+    if (name == "auto")
+        return BACKEND_AUTO;
+    if (name == "gpu")
+        return BACKEND_GPU;
+    if (name == "cpu")
+        return BACKEND_CPU;
+    return -1;
+}
+
+const char *KCFTracker::backendName(Backend backend)
+{
+    switch (backend)
+    {
+    case BACKEND_GPU:
+        return "gpu";
+    case BACKEND_CPU:
+        return "cpu";
+    default:
+        return "auto";
+    }
+}
+
+int KCFTracker::createDevice()
 {
     int  result;
     UINT version = 0;
@@ -587,6 +763,7 @@ int KCFTracker::initMDF()
         result = ::CreateCmDevice(KCFTracker::pCmDev, version, m_va_dpy);
         if (result != CM_SUCCESS ) {
             std::cout<<"CmDevice creation error"<<std::endl;
+            KCFTracker::pCmDev = NULL;
             return -1;
         }
         if( version < CM_1_0 ){
@@ -595,6 +772,16 @@ int KCFTracker::initMDF()
         }
         std::cout<<"A new MDF device was created success"<<std::endl;
     }
+    return 0;
+}
+
+int KCFTracker::initMDF()
+{
+    int  result;
+    if (createDevice() != 0)
+    {
+        return -1;
+    }
 
     bsetupKernelOnce = false;
     featuremap =NULL;
@@ -663,10 +850,10 @@ int KCFTracker::initMDF()
     // Load kernel into CmProgram obj
     if (programGaussianCorrection == NULL)
     {
-        FILE* pISA = fopen("../../kcfGPU/kcf_correlation_genx.isa", "rb");
+        FILE* pISA = fopen(KCF_CORRELATION_ISA, "rb");
         if(NULL == pISA){
            std::cout<<"Failed to open kcf_correction_genx.isa"<<std::endl;
-           exit(-1);
+           return -1;
         }
 
         // Find the kernel code size
@@ -953,7 +1140,7 @@ int KCFTracker::getFeatureMaps_gpu(unsigned int vaSurfaceID,  cv::Rect extracted
     FILE* pISA;
     if( NULL == programHogFeature)
     {                  
-        pISA = fopen("../../kcfGPU/kcf_featrue_genx.isa", "rb");
+        pISA = fopen(KCF_FEATURE_ISA, "rb");
         if (pISA == NULL) 
         { 
             printf("Error in loading ISA file."); exit(-1); 
@@ -1217,286 +1404,6 @@ int KCFTracker::getFeatureMaps_gpu(unsigned int vaSurfaceID,  cv::Rect extracted
 #define HORIZONTAL_WALKER 0
 #define VERTICAL_WALSER   1
 
-#define CV_PI   3.1415926535897932384626433832795
-#define CV_MAX_LOCAL_DFT_SIZE  (1 << 15)
-#define CV_SWAP(a,b,t) ((t) = (a), (a) = (b), (b) = (t))
-
-static unsigned char bitrevTab[] =
-{
-  0x00,0x80,0x40,0xc0,0x20,0xa0,0x60,0xe0,0x10,0x90,0x50,0xd0,0x30,0xb0,0x70,0xf0,
-  0x08,0x88,0x48,0xc8,0x28,0xa8,0x68,0xe8,0x18,0x98,0x58,0xd8,0x38,0xb8,0x78,0xf8,
-  0x04,0x84,0x44,0xc4,0x24,0xa4,0x64,0xe4,0x14,0x94,0x54,0xd4,0x34,0xb4,0x74,0xf4,
-  0x0c,0x8c,0x4c,0xcc,0x2c,0xac,0x6c,0xec,0x1c,0x9c,0x5c,0xdc,0x3c,0xbc,0x7c,0xfc,
-  0x02,0x82,0x42,0xc2,0x22,0xa2,0x62,0xe2,0x12,0x92,0x52,0xd2,0x32,0xb2,0x72,0xf2,
-  0x0a,0x8a,0x4a,0xca,0x2a,0xaa,0x6a,0xea,0x1a,0x9a,0x5a,0xda,0x3a,0xba,0x7a,0xfa,
-  0x06,0x86,0x46,0xc6,0x26,0xa6,0x66,0xe6,0x16,0x96,0x56,0xd6,0x36,0xb6,0x76,0xf6,
-  0x0e,0x8e,0x4e,0xce,0x2e,0xae,0x6e,0xee,0x1e,0x9e,0x5e,0xde,0x3e,0xbe,0x7e,0xfe,
-  0x01,0x81,0x41,0xc1,0x21,0xa1,0x61,0xe1,0x11,0x91,0x51,0xd1,0x31,0xb1,0x71,0xf1,
-  0x09,0x89,0x49,0xc9,0x29,0xa9,0x69,0xe9,0x19,0x99,0x59,0xd9,0x39,0xb9,0x79,0xf9,
-  0x05,0x85,0x45,0xc5,0x25,0xa5,0x65,0xe5,0x15,0x95,0x55,0xd5,0x35,0xb5,0x75,0xf5,
-  0x0d,0x8d,0x4d,0xcd,0x2d,0xad,0x6d,0xed,0x1d,0x9d,0x5d,0xdd,0x3d,0xbd,0x7d,0xfd,
-  0x03,0x83,0x43,0xc3,0x23,0xa3,0x63,0xe3,0x13,0x93,0x53,0xd3,0x33,0xb3,0x73,0xf3,
-  0x0b,0x8b,0x4b,0xcb,0x2b,0xab,0x6b,0xeb,0x1b,0x9b,0x5b,0xdb,0x3b,0xbb,0x7b,0xfb,
-  0x07,0x87,0x47,0xc7,0x27,0xa7,0x67,0xe7,0x17,0x97,0x57,0xd7,0x37,0xb7,0x77,0xf7,
-  0x0f,0x8f,0x4f,0xcf,0x2f,0xaf,0x6f,0xef,0x1f,0x9f,0x5f,0xdf,0x3f,0xbf,0x7f,0xff
-};
-
-static const double DFTTab[][2] =
-{
-{ 1.00000000000000000, 0.00000000000000000 },
-{-1.00000000000000000, 0.00000000000000000 },
-{ 0.00000000000000000, 1.00000000000000000 },
-{ 0.70710678118654757, 0.70710678118654746 },
-{ 0.92387953251128674, 0.38268343236508978 },
-{ 0.98078528040323043, 0.19509032201612825 },
-{ 0.99518472667219693, 0.09801714032956060 },
-{ 0.99879545620517241, 0.04906767432741802 },
-{ 0.99969881869620425, 0.02454122852291229 },
-{ 0.99992470183914450, 0.01227153828571993 },
-{ 0.99998117528260111, 0.00613588464915448 },
-{ 0.99999529380957619, 0.00306795676296598 },
-{ 0.99999882345170188, 0.00153398018628477 },
-{ 0.99999970586288223, 0.00076699031874270 },
-{ 0.99999992646571789, 0.00038349518757140 },
-{ 0.99999998161642933, 0.00019174759731070 },
-{ 0.99999999540410733, 0.00009587379909598 },
-{ 0.99999999885102686, 0.00004793689960307 },
-{ 0.99999999971275666, 0.00002396844980842 },
-{ 0.99999999992818922, 0.00001198422490507 },
-{ 0.99999999998204725, 0.00000599211245264 },
-{ 0.99999999999551181, 0.00000299605622633 },
-{ 0.99999999999887801, 0.00000149802811317 },
-{ 0.99999999999971945, 0.00000074901405658 },
-{ 0.99999999999992983, 0.00000037450702829 },
-{ 0.99999999999998246, 0.00000018725351415 },
-{ 0.99999999999999567, 0.00000009362675707 },
-{ 0.99999999999999889, 0.00000004681337854 },
-{ 0.99999999999999978, 0.00000002340668927 },
-{ 0.99999999999999989, 0.00000001170334463 },
-{ 1.00000000000000000, 0.00000000585167232 },
-{ 1.00000000000000000, 0.00000000292583616 }
-};
-
-#define BitRev(i,shift) \
-   ((int)((((unsigned)bitrevTab[(i)&255] << 24)+ \
-           ((unsigned)bitrevTab[((i)>> 8)&255] << 16)+ \
-           ((unsigned)bitrevTab[((i)>>16)&255] <<  8)+ \
-           ((unsigned)bitrevTab[((i)>>24)])) >> (shift)))
-
-
-
-int KCFTracker::DFTFactorize( int n, int* factors )
-{
-    int nf = 0, f, i, j;
-
-    if( n <= 5 )
-    {
-        factors[0] = n;
-        return 1;
-    }
-
-    f = (((n - 1)^n)+1) >> 1;
-    if( f > 1 )
-    {
-        factors[nf++] = f;
-        n = f == n ? 1 : n/f;
-    }
-
-    for( f = 3; n > 1; )
-    {
-        int d = n/f;
-        if( d*f == n )
-        {
-            factors[nf++] = f;
-            n = d;
-        }
-        else
-        {
-            f += 2;
-            if( f*f > n )
-                break;
-        }
-    }
-
-    if( n > 1 )
-        factors[nf++] = n;
-
-    f = (factors[0] & 1) == 0;
-    for( i = f; i < (nf+f)/2; i++ )
-        CV_SWAP( factors[i], factors[nf-i-1+f], j );
-
-    return nf;
-}
-
-void KCFTracker::DFTInit( int n0, int nf, int* factors, int* itab, int elem_size, float* _wave, int inv_itab )
-{
-    int digits[34], radix[34];
-    int n = factors[0], m = 0;
-    int* itab0 = itab;
-    int i, j, k;
-    double w[2], w1[2];
-    double t;
-
-    if( n0 <= 5 )
-    {
-        itab[0] = 0;
-        itab[n0-1] = n0-1;
-
-        if( n0 != 4 )
-        {
-            for( i = 1; i < n0-1; i++ )
-                itab[i] = i;
-        }
-        else
-        {
-            itab[1] = 2;
-            itab[2] = 1;
-        }
-        if( n0 == 5 )
-        {
-            _wave[0] = 1.0f;
-            _wave[1] = 0.0f;
-        }
-        if( n0 != 4 )
-            return;
-        m = 2;
-    }
-    else
-    {
-        // radix[] is initialized from index 'nf' down to zero
-        assert (nf < 34);
-        radix[nf] = 1;
-        digits[nf] = 0;
-        for( i = 0; i < nf; i++ )
-        {
-            digits[i] = 0;
-            radix[nf-i-1] = radix[nf-i]*factors[nf-i-1];
-        }
-
-        if( inv_itab && factors[0] != factors[nf-1] )
-            itab = (int*)_wave;
-
-        if( (n & 1) == 0 )
-        {
-            int a = radix[1], na2 = n*a>>1, na4 = na2 >> 1;
-            for( m = 0; (unsigned)(1 << m) < (unsigned)n; m++ )
-                ;
-            if( n <= 2  )
-            {
-                itab[0] = 0;
-                itab[1] = na2;
-            }
-            else if( n <= 256 )
-            {
-                int shift = 10 - m;
-                for( i = 0; i <= n - 4; i += 4 )
-                {
-                    j = (bitrevTab[i>>2]>>shift)*a;
-                    itab[i] = j;
-                    itab[i+1] = j + na2;
-                    itab[i+2] = j + na4;
-                    itab[i+3] = j + na2 + na4;
-                }
-            }
-            else
-            {
-                int shift = 34 - m;
-                for( i = 0; i < n; i += 4 )
-                {
-                    int i4 = i >> 2;
-                    j = BitRev(i4,shift)*a;
-                    itab[i] = j;
-                    itab[i+1] = j + na2;
-                    itab[i+2] = j + na4;
-                    itab[i+3] = j + na2 + na4;
-                }
-            }
-
-            digits[1]++;
-
-            if( nf >= 2 )
-            {
-                for( i = n, j = radix[2]; i < n0; )
-                {
-                    for( k = 0; k < n; k++ )
-                        itab[i+k] = itab[k] + j;
-                    if( (i += n) >= n0 )
-                        break;
-                    j += radix[2];
-                    for( k = 1; ++digits[k] >= factors[k]; k++ )
-                    {
-                        digits[k] = 0;
-                        j += radix[k+2] - radix[k];
-                    }
-                }
-            }
-        }
-        else
-        {
-            for( i = 0, j = 0;; )
-            {
-                itab[i] = j;
-                if( ++i >= n0 )
-                    break;
-                j += radix[1];
-                for( k = 0; ++digits[k] >= factors[k]; k++ )
-                {
-                    digits[k] = 0;
-                    j += radix[k+2] - radix[k];
-                }
-            }
-        }
-
-        if( itab != itab0 )
-        {
-            itab0[0] = 0;
-            for( i = n0 & 1; i < n0; i += 2 )
-            {
-                int k0 = itab[i];
-                int k1 = itab[i+1];
-                itab0[k0] = i;
-                itab0[k1] = i+1;
-            }
-        }
-    }
-
-    if( (n0 & (n0-1)) == 0 )
-    {
-        w[0] = w1[0] =  DFTTab[m][0];
-        w[1] = w1[1] = -DFTTab[m][1];
-    }
-    else
-    {
-        t = -CV_PI*2/n0;
-        w[1] = w1[1] = sin(t);
-        w[0] = w1[0] = sqrtf(1. - w1[1]*w1[1]);
-    }
-    n = (n0+1)/2;
-
-    float* wave = _wave;
-
-    wave[0] = 1.f;
-    wave[1] = 0.f;
-
-    if( (n0 & 1) == 0 )
-    {
-        wave[2*n]   = -1.0f;
-        wave[2*n+1] =  0.0f;
-    }
-
-    for( i = 1; i < n; i++ )
-    {
-        wave[2*i]   = w[0];
-        wave[2*i+1] = w[1];
-        wave[2*(n0-i)]   =  w[0];
-        wave[2*(n0-i)+1] = -w[1];
-
-        t    = w[0]*w1[0] - w[1]*w1[1];
-        w[1] = w[0]*w1[1] + w[1]*w1[0];
-        w[0] = t;
-    }
-}
-
 
 int KCFTracker::Call_DFT_FWD_H(CmDevice* pCmDev, CmProgram* program, CmKernel* kernel, CmSurface2D*  pInputSurf, CmBufferUP *pParamSurfHUP, CmBuffer*  pOutputSurf, sPerfProfileParam sInParamConfig, int nf, float *fExetime, CmThreadSpace** pTS)
 {
@@ -2052,8 +1959,8 @@ int KCFTracker::gpu_gaussianCorrelation(unsigned char* InputBuffer0, unsigned ch
 
     if (gPitchX != sInParamConfig.usPitchX)
     {
-        nfx = DFTFactorize(sInParamConfig.usPitchX, factor);
-        DFTInit( sInParamConfig.usPitchX, nfx, factor, itab, elem_size, wave, 0);
+        nfx = VaKcfFft::DFTFactorize(sInParamConfig.usPitchX, factor);
+        VaKcfFft::DFTInit( sInParamConfig.usPitchX, nfx, factor, itab, elem_size, wave, 0);
 
         if (pParamBufferULTH != NULL)
         {
@@ -2104,8 +2011,8 @@ int KCFTracker::gpu_gaussianCorrelation(unsigned char* InputBuffer0, unsigned ch
         memset(itab,  0, 32*sizeof(unsigned char));
         memset(wave,  0, 64*sizeof(float));
 
-        nfy = DFTFactorize(sInParamConfig.usPitchY, factor);
-        DFTInit( sInParamConfig.usPitchY, nfy, factor, itab, elem_size, wave, 0);
+        nfy = VaKcfFft::DFTFactorize(sInParamConfig.usPitchY, factor);
+        VaKcfFft::DFTInit( sInParamConfig.usPitchY, nfy, factor, itab, elem_size, wave, 0);
 
 
         if(pParamBufferULTV != NULL){
@@ -31,6 +31,9 @@ Their values can be customized further before calling init():
     template_size: template size in pixels, 0 to use ROI size
     scale_step: scale step for multi-scale estimation, 1 to disable it
     scale_weight: to downweight detection scores of other scales for added stability
+    train_interval: most frames between two trainings while the peak is high and stable, 1 to train every frame
+    stable_peak: peak value from which the target counts as locked for train_interval
+    reuse_features: train on the features of the detection when the target moved less than a cell
 
 For speed, the value (template_size/cell_size) should be a power of 2 or a product of small prime numbers.
 
@@ -95,6 +98,8 @@ the use of this software, even if advised of the possibility of such damage.
 #endif
 #include "SetupSurface.h"
 #include "fhog.hpp"
+#include "kcfsampler.h"
+#include "taskexecutor.h"
 
 
 #ifndef _OPENCV_KCFTRACKER_HPP_
@@ -157,14 +162,54 @@ typedef struct {
 class KCFTracker : public Tracker
 {
 public:
+    // Where the features and the correlation are computed. The GPU backend needs
+    // a CM device and the .isa kernels, the CPU one runs on frames in memory
+    enum Backend
+    {
+        BACKEND_AUTO = 0,
+        BACKEND_GPU  = 1,
+        BACKEND_CPU  = 2
+    };
+
     // Constructor
     KCFTracker(bool hog = true, bool fixed_window = true, bool multiscale = true, bool lab = true);
 
     // Initialize tracker 
     virtual void init(const cv::Rect &roi, unsigned int vaSurfaceID, int width, int height);
+    virtual void init(const cv::Rect &roi, const cv::Mat &frame);
     
     // Update position based on the new frame
     virtual cv::Rect update(unsigned int vaSurfaceID, int width, int height);
+    virtual cv::Rect update(const cv::Mat &frame);
+
+    // Move the tracker onto the box a detection found its object at, keeping
+    // the trained model. The search window follows the size of the box
+    void correct(const cv::Rect &roi);
+
+    // Backend of the trackers constructed from now on. AUTO takes the GPU when a
+    // CM device can be created and the kernels are found, the CPU otherwise.
+    // Returns the backend picked, -1 when the GPU was asked for and is missing
+    static int selectBackend(Backend backend);
+    static Backend getBackend() { return s_backend; }
+    // "auto", "gpu" or "cpu", -1 for anything else
+    static int parseBackend(const std::string &name);
+    static const char *backendName(Backend backend);
+    // Filter the CPU backend samples the search window of an NV12 frame with,
+    // AVS matches the GPU sampler
+    static void setSampler(VaKcfSampler::Filter filter) { s_sampler = filter; }
+    // Pool the CPU trackers search their scales on in parallel, NULL to
+    // search them one after another
+    static void setExecutor(VaTaskExecutor *executor) { s_executor = executor; }
+    // train_interval of the trackers constructed from now on
+    static void setTrainInterval(int frames) { s_trainInterval = frames; }
+    // reuse_features of the trackers constructed from now on
+    static void setReuseFeatures(bool reuse) { s_reuseFeatures = reuse; }
+
+    // False when the tracker runs on the CPU, only the cv::Mat init() and update() work then
+    bool onGpu() const { return _backend == BACKEND_GPU; }
+
+    // Correlation peak of the last update(), how sure the tracker is of the new position
+    float getPeakValue() const { return _peak_value; }
 
     float interp_factor; // linear interpolation factor for adaptation
     float sigma; // gaussian kernel bandwidth
@@ -174,21 +219,33 @@ public:
     float padding; // extra area surrounding the target
     float output_sigma_factor; // bandwidth of gaussian target
     int template_size; // template size
-   // float scale_step; // scale step for multi-scale estimation
-   // float scale_weight;  // to downweight detection scores of other scales for added stability
+    float scale_step; // scale step for multi-scale estimation, 1 to disable it
+    float scale_weight;  // to downweight detection scores of other scales for added stability
+    int train_interval; // most frames between two trainings of a locked target, 1 trains every frame
+    float stable_peak; // peak value from which a target with a steady peak counts as locked
+    bool reuse_features; // train on the detection features when the target moved less than a cell
 
    //Global resource for MDF
    static CmDevice* pCmDev;
 
 protected:
+    static Backend s_backend;
+    static VaKcfSampler::Filter s_sampler;
+    static int s_trainInterval;
+    static bool s_reuseFeatures;
+    static VaTaskExecutor *s_executor;
     // Detect object in the current frame.
     cv::Point2f detect(cv::Mat z, cv::Mat x, float &peak_value);
 
     // train tracker with a single image
     void train(cv::Mat x, float train_interp_factor);
 
+    // Common part of both init() and update() once the frame is set
+    void initModel(const cv::Rect &roi);
+    cv::Rect updateModel();
+
     // Evaluates a Gaussian kernel with bandwidth SIGMA for all relative shifts between input images X and Y, which must both be MxN. They must    also be periodic (ie., pre-processed with a cosine window).
-    cv::Mat gaussianCorrelation(cv::Mat x1, cv::Mat x2);
+    // The CPU backend uses VaKcfCorrelation on the spectra instead
     cv::Mat gaussianCorrelation_gpu(cv::Mat x1, cv::Mat x2);
 
     // Create Gaussian Peak. Function called only in the first frame.
@@ -196,6 +253,14 @@ protected:
 
     // Obtain sub-window from image, with replication-padding and extract features
     cv::Mat getFeatures(unsigned int vaSurfaceID, bool inithann, float scale_adjust = 1.0f, int rawWidth=1920, int rawHeight=1080);
+    // Same with the CPU fHOG on a BGR or NV12 frame in memory
+    cv::Mat getFeatures(const cv::Mat &frame, bool inithann, float scale_adjust = 1.0f);
+    // Features of the frame passed to the running init() or update()
+    cv::Mat getFrameFeatures(bool inithann, float scale_adjust = 1.0f);
+    // Padded search window around the current roi, sets the template size first when inithann
+    cv::Rect getExtractedRoi(bool inithann, float scale_adjust);
+    // Hann windowed feature matrix of a PCA reduced feature map
+    cv::Mat packFeatures(const CvLSVMFeatureMapCaskade *map, bool inithann);
     void getFeatures2(unsigned int vaSurfaceID, bool inithann, float scale_adjust, int rawWidth, int rawHeight);
     // Initialize Hanning window. Function called only in the first frame.
     void createHanningMats();
@@ -205,6 +270,7 @@ protected:
 
     // Initialize Intel GPU accelerator
     int initMDF();
+    static int createDevice();
 
     int getFeatureMaps_gpu(unsigned int vaSurfaceID,  cv::Rect extracted_roi, int rawWidth, int rawHeight, int tempWidth, int tempHeight, const int k, CvLSVMFeatureMapCaskade **map);
     int refreshKernels(int nRawWidth, int nRawheight,cv::Rect extracted_roi, int nWidth, int nHeight);
@@ -214,14 +280,13 @@ protected:
     int Call_ImageSum(CmDevice* pCmDev, CmProgram* program, CmKernel* kernel, CmBuffer*  pInputSurf0, CmBuffer*  pOutputSurf, sPerfProfileParam sInParamConfig, float *fExetime, CmThreadSpace** pTS);
     int Call_MulSpec(CmDevice* pCmDev, CmProgram* program, CmKernel* kernel, CmBuffer*  pInputSurf0, CmBuffer*  pInputSurf1, CmSurface2D*  pOutputSurf, sPerfProfileParam sInParamConfig, float *fExetime, CmThreadSpace** pTS);
     int Call_FianlExpImageSum(CmDevice* pCmDev, CmProgram* program, CmBuffer*  pInputSurf0, unsigned char *InputBuffer1, unsigned char *OutputBuffer, sPerfProfileParam sInParamConfig, float *fExetime);
-    int DFTFactorize( int n, int* factors );
-    void DFTInit( int n0, int nf, int* factors, int* itab, int elem_size, float* _wave, int inv_itab );
     int Call_DFT_FWD_H(CmDevice* pCmDev, CmProgram* program, CmKernel* kernel, CmSurface2D*  pInputSurf, CmBufferUP *pParamSurfHUP, CmBuffer*  pOutputSurf, sPerfProfileParam sInParamConfig, int nf, float *fExetime, CmThreadSpace** pTS);
     int Call_DFT_FWD_V(CmDevice* pCmDev, CmProgram* program, CmKernel* kernel, CmBuffer*  pInputSurf, CmBufferUP *ParamBufferUP, CmBuffer* pOutputSurf, sPerfProfileParam sInParamConfig, int nf, float *fExetime, CmThreadSpace** pTS);
 
     cv::Mat _alphaf;
     cv::Mat _prob;
     cv::Mat _tmpl;
+    std::vector<cv::Mat> _tmplf; // spectra of the template channels, CPU backend only
     cv::Mat _num;
     cv::Mat _den;
     cv::Mat _labCentroids;
@@ -234,6 +299,15 @@ private:
     int _gaussian_size;
     bool _hogfeatures;
     bool _labfeatures;
+    float _peak_value;
+    int _framesSinceTrain;
+    Backend _backend;
+
+    // frame of the running init() or update(), the image is empty for a surface
+    unsigned int _surface;
+    cv::Mat _frame;
+    int _frameWidth;
+    int _frameHeight;
 
     CmKernel* featureKernel;
     CmKernel* processKernel;
@@ -0,0 +1,118 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+
+/*
+// brief Adaptive detection interval of a tracked stream
+*/
+
+#include "keyframepolicy.h"
+#include <algorithm>
+
+// tracking is doubted once the peak fell below this share of its value after the key frame
+#define KEYFRAME_PEAK_DROP  0.5f
+// or once an object moved by more than this share of its size in one frame
+#define KEYFRAME_MOTION     0.1f
+
+VaKeyframePolicy::VaKeyframePolicy():
+    m_min(1),
+    m_max(1),
+    m_interval(1),
+    m_keyNow(false),
+    m_since(0),
+    m_frames(0),
+    m_keyFrames(0),
+    m_postponed(0),
+    m_objects(-1),
+    m_refPeak(0),
+    m_shrunk(false)
+{
+}
+
+void VaKeyframePolicy::Initialize(int minInterval, int maxInterval)
+{
+    m_min = std::max(minInterval, 1);
+    m_max = std::max(maxInterval, m_min);
+    m_interval.store(m_min, std::memory_order_relaxed);
+    m_keyNow.store(false, std::memory_order_relaxed);
+    // the first frame of the stream is a key frame
+    m_since = m_max;
+    m_objects = -1;
+    m_refPeak = 0;
+    m_shrunk = false;
+}
+
+bool VaKeyframePolicy::NextFrame(bool allowed)
+{
+    m_frames.store(m_frames.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    m_since ++;
+    bool due = (m_since >= m_interval.load(std::memory_order_relaxed)) ||
+               m_keyNow.load(std::memory_order_relaxed);
+    if (due && !allowed)
+    {
+        m_postponed.store(m_postponed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    if (!due || !allowed)
+    {
+        return false;
+    }
+    m_since = 0;
+    m_keyNow.store(false, std::memory_order_relaxed);
+    m_keyFrames.store(m_keyFrames.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return true;
+}
+
+void VaKeyframePolicy::Shrink(bool now)
+{
+    int interval = m_interval.load(std::memory_order_relaxed);
+    m_interval.store(std::max(m_min, interval / 2), std::memory_order_relaxed);
+    if (now)
+    {
+        m_keyNow.store(true, std::memory_order_relaxed);
+    }
+}
+
+void VaKeyframePolicy::OnDetection(int objects)
+{
+    if (m_objects >= 0 && objects != m_objects)
+    {
+        Shrink(false);
+    }
+    else
+    {
+        int interval = m_interval.load(std::memory_order_relaxed);
+        m_interval.store(std::min(m_max, interval + 1), std::memory_order_relaxed);
+    }
+    m_objects = objects;
+    m_refPeak = 0;
+    m_shrunk = false;
+}
+
+void VaKeyframePolicy::OnTracking(float peak, float motion)
+{
+    if (m_refPeak <= 0)
+    {
+        // the first update after a detection sets the bar
+        m_refPeak = peak;
+        return;
+    }
+    // once per key frame, the key frame asked for is on its way
+    if (!m_shrunk && (peak < m_refPeak * KEYFRAME_PEAK_DROP || motion > KEYFRAME_MOTION))
+    {
+        Shrink(true);
+        m_shrunk = true;
+    }
+}
@@ -0,0 +1,75 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+
+/*
+// brief Adaptive detection interval of a tracked stream
+*/
+
+#ifndef _KEYFRAMEPOLICY_H_
+#define _KEYFRAMEPOLICY_H_
+
+#include <stdint.h>
+#include <atomic>
+
+// Picks the key frames of a stream, the frames that get a fresh detection
+// while the tracker carries the boxes along in between. The interval grows by
+// one frame after every key frame that found as many objects as the one
+// before, and halves when the count changed, when the correlation peak of the
+// trackers dropped well below what it was right after the last detection, or
+// when the boxes move fast. The latter two also ask for a key frame right
+// away. The decoder calls NextFrame(), the tracker of the stream reports back.
+class VaKeyframePolicy
+{
+public:
+    VaKeyframePolicy();
+    void Initialize(int minInterval, int maxInterval);
+
+    // Decoder side: true if the next frame is a key frame. allowed false
+    // postpones a due key frame, e.g. when -fps has no budget for it
+    bool NextFrame(bool allowed);
+
+    // Tracker side: objects found on a key frame
+    void OnDetection(int objects);
+    // Tracker side: mean correlation peak of the tracked objects on a frame, and
+    // how far the fastest of them moved, in units of its own size
+    void OnTracking(float peak, float motion);
+
+    int GetInterval() const { return m_interval.load(std::memory_order_relaxed); }
+    uint64_t GetFrames() const { return m_frames.load(std::memory_order_relaxed); }
+    uint64_t GetKeyFrames() const { return m_keyFrames.load(std::memory_order_relaxed); }
+    // frames a due key frame was postponed on, as NextFrame() was not allowed one
+    uint64_t GetPostponed() const { return m_postponed.load(std::memory_order_relaxed); }
+
+protected:
+    void Shrink(bool now);
+
+    int m_min;
+    int m_max;
+    std::atomic<int> m_interval;
+    std::atomic<bool> m_keyNow;
+    // decoder
+    int m_since;
+    std::atomic<uint64_t> m_frames;
+    std::atomic<uint64_t> m_keyFrames;
+    std::atomic<uint64_t> m_postponed;
+    // tracker
+    int m_objects;
+    float m_refPeak;
+    bool m_shrunk;
+};
+
+#endif
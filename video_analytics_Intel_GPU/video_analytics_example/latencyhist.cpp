@@ -0,0 +1,306 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+/*
+// brief Per-stage latency histograms
+*/
+
+#include "latencyhist.h"
+#include <stdio.h>
+#include <iostream>
+
+// histograms of the calling thread, NULL until it records the first sample
+static thread_local void *s_threadHistograms = NULL;
+
+VaLatencyHistogram::VaLatencyHistogram()
+{
+    Reset();
+}
+
+void VaLatencyHistogram::Reset()
+{
+    for (int i = 0; i < NUM_BUCKETS; i ++)
+    {
+        m_buckets[i].store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+}
+
+int VaLatencyHistogram::BucketIndex(uint64_t us)
+{
+    if (us < LINEAR_BUCKETS)
+    {
+        return (int)us;
+    }
+    if (us > BucketValue(NUM_BUCKETS - 1))
+    {
+        return NUM_BUCKETS - 1;
+    }
+    // keep the 5 top bits: the leading one picks the octave, the next 4 the bucket in it
+    int msb = 63 - __builtin_clzll(us);
+    int shift = msb - 4;
+    return LINEAR_BUCKETS + (shift - 1) * SUB_BUCKETS + (int)((us >> shift) - SUB_BUCKETS);
+}
+
+uint64_t VaLatencyHistogram::BucketValue(int index)
+{
+    if (index < LINEAR_BUCKETS)
+    {
+        return (uint64_t)index;
+    }
+    int shift = (index - LINEAR_BUCKETS) / SUB_BUCKETS + 1;
+    uint64_t sub = (index - LINEAR_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS;
+    return ((sub + 1) << shift) - 1;
+}
+
+void VaLatencyHistogram::Record(uint64_t us)
+{
+    // single writer: plain load and store instead of a locked add
+    std::atomic<uint64_t> &bucket = m_buckets[BucketIndex(us)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    m_count.store(m_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    m_sum.store(m_sum.load(std::memory_order_relaxed) + us, std::memory_order_relaxed);
+}
+
+void VaLatencyHistogram::Merge(const VaLatencyHistogram &other)
+{
+    for (int i = 0; i < NUM_BUCKETS; i ++)
+    {
+        m_buckets[i].fetch_add(other.m_buckets[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    m_count.fetch_add(other.m_count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    m_sum.fetch_add(other.m_sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void VaLatencyHistogram::Subtract(const VaLatencyHistogram &other)
+{
+    for (int i = 0; i < NUM_BUCKETS; i ++)
+    {
+        m_buckets[i].fetch_sub(other.m_buckets[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    m_count.fetch_sub(other.m_count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    m_sum.fetch_sub(other.m_sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+uint64_t VaLatencyHistogram::GetMean() const
+{
+    uint64_t count = GetCount();
+    return (count > 0) ? m_sum.load(std::memory_order_relaxed) / count : 0;
+}
+
+uint64_t VaLatencyHistogram::GetPercentile(double percentile) const
+{
+    // the buckets may be ahead of m_count while a writer is at it, count them
+    uint64_t total = 0;
+    for (int i = 0; i < NUM_BUCKETS; i ++)
+    {
+        total += m_buckets[i].load(std::memory_order_relaxed);
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+    uint64_t target = (uint64_t)(total * percentile / 100.0 + 0.5);
+    if (target < 1)
+    {
+        target = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < NUM_BUCKETS; i ++)
+    {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen >= target)
+        {
+            return BucketValue(i);
+        }
+    }
+    return BucketValue(NUM_BUCKETS - 1);
+}
+
+uint64_t VaLatencyHistogram::GetMax() const
+{
+    for (int i = NUM_BUCKETS - 1; i >= 0; i --)
+    {
+        if (m_buckets[i].load(std::memory_order_relaxed) > 0)
+        {
+            return BucketValue(i);
+        }
+    }
+    return 0;
+}
+
+VaLatencyStats::VaLatencyStats():
+    m_nChannels(0)
+{
+}
+
+VaLatencyStats::~VaLatencyStats()
+{
+    for (size_t i = 0; i < m_threads.size(); i ++)
+    {
+        for (size_t j = 0; j < m_threads[i]->histograms.size(); j ++)
+        {
+            delete m_threads[i]->histograms[j].load(std::memory_order_relaxed);
+        }
+        delete m_threads[i];
+    }
+    for (size_t i = 0; i < m_reported.size(); i ++)
+    {
+        delete m_reported[i];
+    }
+}
+
+void VaLatencyStats::Initialize(int nchannels)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_reported.resize(nchannels * STAGE_NUM);
+    for (size_t i = 0; i < m_reported.size(); i ++)
+    {
+        m_reported[i] = new VaLatencyHistogram();
+    }
+    m_nChannels = nchannels;
+}
+
+VaLatencyStats::ThreadHistograms *VaLatencyStats::CurrentThread()
+{
+    ThreadHistograms *thread = (ThreadHistograms *)s_threadHistograms;
+    if (thread != NULL && thread->owner == this)
+    {
+        return thread;
+    }
+
+    // first sample of this thread. The histograms stay with the stats when
+    // the thread exits, so nothing it recorded is lost
+    thread = new ThreadHistograms();
+    thread->owner = this;
+    thread->histograms = std::vector<std::atomic<VaLatencyHistogram *> >(m_nChannels * STAGE_NUM);
+    for (size_t i = 0; i < thread->histograms.size(); i ++)
+    {
+        thread->histograms[i].store(NULL, std::memory_order_relaxed);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_threads.push_back(thread);
+    }
+    s_threadHistograms = thread;
+    return thread;
+}
+
+void VaLatencyStats::Record(int channel, Stage stage, Clock::duration latency)
+{
+    if (channel < 0 || channel >= m_nChannels)
+    {
+        return;
+    }
+    ThreadHistograms *thread = CurrentThread();
+    std::atomic<VaLatencyHistogram *> &slot = thread->histograms[channel * STAGE_NUM + stage];
+    VaLatencyHistogram *histogram = slot.load(std::memory_order_relaxed);
+    if (histogram == NULL)
+    {
+        histogram = new VaLatencyHistogram();
+        // the reporter may only see it fully constructed
+        slot.store(histogram, std::memory_order_release);
+    }
+    int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    histogram->Record(us > 0 ? (uint64_t)us : 0);
+}
+
+void VaLatencyStats::Collect(int channel, Stage stage, VaLatencyHistogram &merged)
+{
+    for (size_t i = 0; i < m_threads.size(); i ++)
+    {
+        VaLatencyHistogram *histogram =
+            m_threads[i]->histograms[channel * STAGE_NUM + stage].load(std::memory_order_acquire);
+        if (histogram != NULL)
+        {
+            merged.Merge(*histogram);
+        }
+    }
+}
+
+const char *VaLatencyStats::StageName(Stage stage)
+{
+    static const char *names[STAGE_NUM] = {"decode", "copy", "queue wait", "batch wait",
+                                           "inference", "post-process", "track", "display", "total"};
+    return names[stage];
+}
+
+void VaLatencyStats::PrintLine(const char *name, const VaLatencyHistogram &histogram)
+{
+    char line[256];
+    snprintf(line, sizeof(line), "   %-14s %9llu  mean %8llu  p50 %8llu  p90 %8llu  p99 %8llu  p99.9 %8llu  max %8llu",
+             name, (unsigned long long)histogram.GetCount(),
+             (unsigned long long)histogram.GetMean(),
+             (unsigned long long)histogram.GetPercentile(50.0),
+             (unsigned long long)histogram.GetPercentile(90.0),
+             (unsigned long long)histogram.GetPercentile(99.0),
+             (unsigned long long)histogram.GetPercentile(99.9),
+             (unsigned long long)histogram.GetMax());
+    std::cout << line << std::endl;
+}
+
+void VaLatencyStats::Report(bool interval)
+{
+    if (!IsEnabled())
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::cout << (interval ? "Latency of the last interval (us):" : "Latency of the whole run (us):") << std::endl;
+    std::cout << "   stage              count" << std::endl;
+    for (int stage = 0; stage < STAGE_NUM; stage ++)
+    {
+        VaLatencyHistogram all;
+        for (int channel = 0; channel < m_nChannels; channel ++)
+        {
+            VaLatencyHistogram merged;
+            Collect(channel, (Stage)stage, merged);
+            if (interval)
+            {
+                // the snapshot becomes the start of the next interval
+                VaLatencyHistogram *reported = m_reported[channel * STAGE_NUM + stage];
+                VaLatencyHistogram current;
+                current.Merge(merged);
+                merged.Subtract(*reported);
+                reported->Reset();
+                reported->Merge(current);
+            }
+            all.Merge(merged);
+        }
+        if (all.GetCount() > 0)
+        {
+            PrintLine(StageName((Stage)stage), all);
+        }
+    }
+    if (interval)
+    {
+        return;
+    }
+
+    for (int channel = 0; channel < m_nChannels; channel ++)
+    {
+        VaLatencyHistogram total;
+        Collect(channel, STAGE_TOTAL, total);
+        if (total.GetCount() == 0)
+        {
+            continue;
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "channel(%d)", channel);
+        PrintLine(name, total);
+    }
+}
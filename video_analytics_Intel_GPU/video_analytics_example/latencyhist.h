@@ -0,0 +1,128 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+/*
+// brief Per-stage latency histograms
+*/
+
+#ifndef _LATENCYHIST_H_
+#define _LATENCYHIST_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+// Log-linear histogram of microsecond latencies in the HDR histogram layout:
+// exact below 32us, above that 16 buckets per power of two, so every value is
+// kept within 1/16 of itself up to ~25 days. Record() is meant for a single
+// writer thread, any thread may read it concurrently.
+class VaLatencyHistogram
+{
+public:
+    enum
+    {
+        LINEAR_BUCKETS  = 32,
+        SUB_BUCKETS     = 16,
+        OCTAVES         = 36,
+        NUM_BUCKETS     = LINEAR_BUCKETS + OCTAVES * SUB_BUCKETS
+    };
+
+    VaLatencyHistogram();
+    void Record(uint64_t us);
+    void Merge(const VaLatencyHistogram &other);
+    // Remove the samples of an earlier snapshot of the same histogram
+    void Subtract(const VaLatencyHistogram &other);
+    void Reset();
+
+    uint64_t GetCount() const { return m_count.load(std::memory_order_relaxed); }
+    uint64_t GetMean() const;
+    // Smallest value at least percentile % of the samples are not above
+    uint64_t GetPercentile(double percentile) const;
+    uint64_t GetMax() const;
+
+    static int BucketIndex(uint64_t us);
+    // Largest value that lands in a bucket
+    static uint64_t BucketValue(int index);
+
+protected:
+    std::atomic<uint64_t> m_buckets[NUM_BUCKETS];
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sum;
+};
+
+// Latencies of the pipeline stages for every channel. Each recording thread
+// fills histograms of its own, the reporter merges them, so Record() takes no
+// lock and shares no cache line with other threads.
+class VaLatencyStats
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    enum Stage
+    {
+        STAGE_DECODE   = 0, // decoding and VPP of a frame
+        STAGE_COPY     = 1, // frame copies into the pipe and the input blob
+        STAGE_QUEUE    = 2, // frame pipe, from the decoder to the scheduler
+        STAGE_BATCH    = 3, // waiting for the batch to fill up
+        STAGE_INFER    = 4, // infer request, submit to completion
+        STAGE_POSTPROC = 5, // completion until the result is dispatched
+        STAGE_TRACK    = 6,
+        STAGE_DISPLAY  = 7,
+        STAGE_TOTAL    = 8, // decoding start until the result is dispatched
+        STAGE_NUM      = 9
+    };
+
+    VaLatencyStats();
+    ~VaLatencyStats();
+    // Nothing is recorded before it is enabled for nchannels channels
+    void Initialize(int nchannels);
+    bool IsEnabled() const { return m_nChannels > 0; }
+
+    void Record(int channel, Stage stage, Clock::duration latency);
+    void Record(int channel, Stage stage, Clock::time_point start)
+    {
+        Record(channel, stage, Clock::now() - start);
+    }
+
+    // Percentiles of every stage over all channels, since the last interval
+    // report or, with interval false, over the whole run broken down by channel
+    void Report(bool interval);
+
+    static const char *StageName(Stage stage);
+
+protected:
+    struct ThreadHistograms
+    {
+        VaLatencyStats *owner;
+        // channel * STAGE_NUM + stage, allocated by the owner on first use
+        std::vector<std::atomic<VaLatencyHistogram *> > histograms;
+    };
+
+    ThreadHistograms *CurrentThread();
+    // Sum of all threads for one channel and stage into merged
+    void Collect(int channel, Stage stage, VaLatencyHistogram &merged);
+    static void PrintLine(const char *name, const VaLatencyHistogram &histogram);
+
+    int m_nChannels;
+    std::mutex m_mutex;
+    std::vector<ThreadHistograms *> m_threads;
+    // what the previous interval report saw, channel * STAGE_NUM + stage
+    std::vector<VaLatencyHistogram *> m_reported;
+};
+
+#endif
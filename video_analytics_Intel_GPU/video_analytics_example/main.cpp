@@ -30,6 +30,7 @@
 #include <vector>
 #include <queue>
 #include <signal.h>
+#include <errno.h>
 
 #include <pthread.h>  
 #include <unistd.h>  
@@ -44,6 +45,17 @@
 #include <unistd.h>
 #include "common.h"
 #include "dualpipe.h"
+#include "ringpipe.h"
+#include "taskexecutor.h"
+#include "cputopology.h"
+#include "framearena.h"
+#include "latencyhist.h"
+#include "tracing.h"
+#include "rategovernor.h"
+#include "deadlinequeue.h"
+#include "qosscheduler.h"
+#include "keyframepolicy.h"
+#include "trackmanager.h"
 
 
 // =================================================================
@@ -93,6 +105,21 @@ using namespace std;
 
 
 Detector gDetector[NUM_OF_GPU_INFER];
+VaTaskExecutor gExecutor;
+// runs the objects of a frame in parallel for the CPU trackers, see -kcf_workers
+VaTaskExecutor gTrackExecutor;
+// cores of each pipeline stage, only used with gPlacement, see -placement
+VaCpuTopology gTopology;
+bool gPlacement = false;
+// per-stage latencies, only recorded with -pl
+VaLatencyStats gLatency;
+VaRateGovernor gGovernor[NUM_OF_CHANNELS]; // -fps of each channel
+VaDeadlineQueue gReadyQueue; // frames waiting for inference with -deadline
+bool gDeadline = false;
+VaQosScheduler gQos; // frames waiting for inference with -qos
+bool gQosEnabled = false;
+VaKeyframePolicy gKeyframe[NUM_OF_CHANNELS]; // detection interval of each tracked channel
+VaTrackManager gTracks[NUM_OF_CHANNELS]; // tracked objects of each channel
 sem_t gNewtaskAvaiable;
 
 #ifdef TEST_KCF_TRACK_WITH_GPU
@@ -135,9 +162,18 @@ public:
         pmfxVPP(NULL),
         decOutputFile(0),
         nChannel(0),
+        nNode(0),
         nFPS(0),
         bStartCount(false),
-        nFrameProcessed(0)
+        nFrameProcessed(0),
+        nFrame(0),
+        sts(MFX_ERR_NONE),
+        syncpDec(NULL),
+        syncpVPP(NULL),
+        nIndexDec(0),
+        nIndexVPP_In(0),
+        nIndexVPP_Out(0),
+        bNeedMore(false)
     {
     };
     int totalDecNum;
@@ -156,12 +192,24 @@ public:
 
     int decOutputFile;
     int nChannel;
+    int nNode; // NUMA node the channel is decoded on and its frames live on
     int nFPS;
     bool bStartCount;
     int nFrameProcessed;
     VaDualPipe *dpipe;
     VaDualPipe *dKCFpipe; // Pipe between decoding and track thread
 
+    // state of the decoding loop, see DecodeStep()
+    int nFrame;
+    mfxStatus sts;
+    mfxSyncPoint syncpDec;
+    mfxSyncPoint syncpVPP;
+    VaLatencyStats::Clock::time_point pipeStartTs;
+    int nIndexDec;
+    int nIndexVPP_In;
+    int nIndexVPP_Out;
+    bool bNeedMore;
+
     std::chrono::high_resolution_clock::time_point tmStart;
     std::chrono::high_resolution_clock::time_point tmEnd;
 
@@ -186,7 +234,8 @@ public:
         pmfxVPP(NULL),
         width(0),
         height(0),
-        nChannel(0)
+        nChannel(0),
+        nNode(0)
     {
     };
     int totalDecNum;
@@ -204,6 +253,7 @@ public:
     int width;
     int height;
     int nChannel;
+    int nNode;
     VaDualPipe *dpipe;
 };
 
@@ -243,6 +293,11 @@ void sigint_hanlder(int s)
     grunning = false;
 }
 
+void sigusr1_handler(int s)
+{
+    VaTracer::RequestDump();
+}
+
 // ================= Display Thread =======
 // in current version, each grids with the same size (wxh)
 struct DisplayThreadConfig
@@ -274,6 +329,7 @@ void *thr_fps(void *arg)
     memset(total_frame,0, sizeof(unsigned int)*NUM_OF_GPU_INFER);
 
     auto t0=Time::now(),t1=Time::now();
+    auto tLatency = Time::now();
     while(grunning){
         usleep(1000*1000*2);//2s
         t1 = Time::now();
@@ -297,6 +353,18 @@ void *thr_fps(void *arg)
             total_fps = nTotalDecFrames*1000/timeUsed;
             std::cout << "Decode fps=" << total_fps  << "(f/s)\n" << std::endl;
         }
+        if(FLAGS_overflow.compare("block")){
+            for (auto& pDecThrConf : vpDecThradConfig) {
+                unsigned long nDropped = pDecThrConf->dpipe->GetDroppedFrames();
+                if (nDropped > 0)
+                    std::cout << "channel(" << pDecThrConf->nChannel << ") dropped frames: " << nDropped << std::endl;
+            }
+        }
+        VaTracer::DumpIfRequested();
+        if(FLAGS_pl && FLAGS_pl_interval > 0 && t1 - tLatency >= std::chrono::seconds(FLAGS_pl_interval)){
+            gLatency.Report(true);
+            tLatency = t1;
+        }
         t0 = Time::now();
     }
     std::cout<<"Performance thread is done"<<std::endl;
@@ -340,6 +408,12 @@ void *DisplayThreadFunc(void *arg)
             objects = gresultque.front();	
             gresultque.pop();			
             pthread_mutex_unlock(&mutexshow); 	
+            // objects may be reused for the second queue, keep what is shown
+            VaLatencyStats::Clock::time_point showStart = VaLatencyStats::Clock::now();
+            VA_TRACE("display");
+            vector<int> shownChannels;
+            for (size_t k = 0; FLAGS_pl && k < objects.size(); k++)
+                shownChannels.push_back(objects[k].inputid);
             memset(fpshaswrite,0,sizeof(fpshaswrite));
 
             for(int k=0;k<objects.size();k++){
@@ -352,6 +426,8 @@ void *DisplayThreadFunc(void *arg)
                     cv::rectangle(objects[k].orgimg,cvPoint(objects[k].boxs[i].left,objects[k].boxs[i].top),cvPoint(objects[k].boxs[i].right,objects[k].boxs[i].bottom),cv::Scalar(71, 99, 250),2);
                     std::stringstream ss;  
                     ss << CLASSES[(int)(objects[k].boxs[i].classid)] << "/" << objects[k].boxs[i].confidence;  
+                    if (objects[k].boxs[i].trackid > 0)
+                        ss << " #" << objects[k].boxs[i].trackid;
                     std::string  text = ss.str();  
                     cv::putText(objects[k].orgimg, text, cvPoint(objects[k].boxs[i].left,objects[k].boxs[i].top+20), cv::FONT_HERSHEY_PLAIN, 1.0f, cv::Scalar(0, 255, 255));  	
                 }
@@ -410,6 +486,8 @@ void *DisplayThreadFunc(void *arg)
             cv::namedWindow( "Display window", cv::WINDOW_AUTOSIZE );
             cv::imshow( "Display window", onescreen );  
             cv::waitKey(33);
+            for (size_t k = 0; k < shownChannels.size(); k++)
+                gLatency.Record(shownChannels[k], VaLatencyStats::STAGE_DISPLAY, showStart);
     
         } // wait for display		
     }//while(grunnig)
@@ -418,123 +496,167 @@ void *DisplayThreadFunc(void *arg)
 }
 
 
-
-// ================= Decoding Thread =======
-void *DecodeThreadFunc(void *arg)
+#ifndef TEST_KCF_TRACK_WITH_GPU
+// Write the RGBP output of VPP straight into the next batch slot of the detector,
+// the planes land in the same order the scheduler leaves them in the blob
+static void InsertFrameToDetector(struct DecThreadConfig *pDecConfig, mfxFrameSurface1* pSurface)
 {
-    struct DecThreadConfig *pDecConfig = NULL;
-    int nFrame = 0;
-    mfxBitstream mfxBS;
-    mfxStatus sts = MFX_ERR_NONE;
-    mfxSyncPoint syncpDec;
-    mfxSyncPoint syncpVPP;
-
-    struct timeval pipeStartTs = {0};
-
-    int nIndexDec     = 0;
-    int nIndexVPP_In  = 0;
-    int nIndexVPP_In2 = 0;
-    int nIndexVPP_Out = 0;
-    bool bNeedMore    = false;
+    Detector::PlanarSlot planar;
+    IDtype *dst = gDetector[0].InsertPlanar(planar, pDecConfig->nChannel, pDecConfig->nFrameProcessed, 0,
+                                            VaFrameHandle(), pDecConfig->pipeStartTs);
+    if (dst == NULL)
+        return;
+
+    pDecConfig->pmfxAllocator->Lock(pDecConfig->pmfxAllocator->pthis, 
+                                      pSurface->Data.MemId, 
+                                      &(pSurface->Data));
+    mfxFrameInfo* pInfo = &pSurface->Info;
+    mfxFrameData* pData = &pSurface->Data;
+    mfxU32 w, h;
+    if (pInfo->CropH > 0 && pInfo->CropW > 0)
+    {
+        w = pInfo->CropW;
+        h = pInfo->CropH;
+    }
+    else
+    {
+        w = pInfo->Width;
+        h = pInfo->Height;
+    }
+    w = MSDK_MIN(w, (mfxU32)gNet_input_width);
+    h = MSDK_MIN(h, (mfxU32)gNet_input_height);
 
-    unsigned char *temp_img_buffer = (unsigned char *)malloc(gNet_input_width*gNet_input_height*4);
-    if (temp_img_buffer == NULL)
-        return NULL;
-    pDecConfig= (DecThreadConfig *) arg;
-    if( NULL == pDecConfig)
+    mfxU8 *planes[3] = {pData->R, pData->G, pData->B};
+    for (int c = 0; c < 3; c++)
     {
-        std::cout << std::endl << "Failed Decode Thread Configuration" << std::endl;
-        if(temp_img_buffer)
+        mfxU8 *ptr  = planes[c] + pInfo->CropX + pInfo->CropY * pData->Pitch;
+        IDtype *pTemp = dst + c * gNet_input_width * gNet_input_height;
+        for (mfxU32 i = 0; i < h; i++)
         {
-            free(temp_img_buffer);
+            memcpy(pTemp + i * gNet_input_width, ptr + i * pData->Pitch, w);
         }
-        return NULL;
     }
-    std::cout << std::endl <<">channel("<<pDecConfig->nChannel<<") Initialized " << std::endl;
 
-    pDecConfig->tmStart = std::chrono::high_resolution_clock::now();
-    while ((MFX_ERR_NONE <= sts || MFX_ERR_MORE_DATA == sts || MFX_ERR_MORE_SURFACE == sts))
+    pDecConfig->pmfxAllocator->Unlock(pDecConfig->pmfxAllocator->pthis, 
+                                        pSurface->Data.MemId, 
+                                        &(pSurface->Data));
+    gDetector[0].CommitPlanar(planar);
+}
+#endif
+
+// ================= Decoding =======
+// One iteration of the decoding loop: decode a frame and hand it on to
+// inference. The loop state lives in the channel config, so the iterations
+// may run on any thread. Returns false once the channel is done
+static bool DecodeStep(struct DecThreadConfig *pDecConfig)
+{
+    int &nFrame = pDecConfig->nFrame;
+    mfxStatus &sts = pDecConfig->sts;
+    mfxSyncPoint &syncpDec = pDecConfig->syncpDec;
+    mfxSyncPoint &syncpVPP = pDecConfig->syncpVPP;
+    VaLatencyStats::Clock::time_point &pipeStartTs = pDecConfig->pipeStartTs;
+    int &nIndexDec = pDecConfig->nIndexDec;
+    int &nIndexVPP_In = pDecConfig->nIndexVPP_In;
+    int &nIndexVPP_Out = pDecConfig->nIndexVPP_Out;
+    bool &bNeedMore = pDecConfig->bNeedMore;
+    VA_TRACE("decode", pDecConfig->nChannel, nFrame);
+
+    if (!(MFX_ERR_NONE <= sts || MFX_ERR_MORE_DATA == sts || MFX_ERR_MORE_SURFACE == sts))
     {
-       // std::cout << std::endl <<">channel("<<pDecConfig->nChannel<<") Dec: nFrame:"<<nFrame<<" totalDecNum:"<<pDecConfig->totalDecNum << std::endl;
-        if (grunning == false) { break;};
-        if (MFX_WRN_DEVICE_BUSY == sts)
-        {
-            usleep(1000); // Wait if device is busy, then repeat the same call to DecodeFrameAsync
-        }
+        return false;
+    }
+   // std::cout << std::endl <<">channel("<<pDecConfig->nChannel<<") Dec: nFrame:"<<nFrame<<" totalDecNum:"<<pDecConfig->totalDecNum << std::endl;
+    if (grunning == false) { return false;};
+    if (MFX_WRN_DEVICE_BUSY == sts)
+    {
+        usleep(1000); // Wait if device is busy, then repeat the same call to DecodeFrameAsync
+    }
 
-        if (MFX_ERR_MORE_DATA == sts)
-        {   
-            sts = ReadBitStreamData(pDecConfig->pmfxBS, pDecConfig->f_i); // Read more data into input bit stream
-            if(sts != 0){
-              fseek(pDecConfig->f_i,0, SEEK_SET);
-              sts = ReadBitStreamData(pDecConfig->pmfxBS, pDecConfig->f_i);
-            }
-            MSDK_BREAK_ON_ERROR(sts);
+    if (MFX_ERR_MORE_DATA == sts)
+    {   
+        sts = ReadBitStreamData(pDecConfig->pmfxBS, pDecConfig->f_i); // Read more data into input bit stream
+        if(sts != 0){
+          fseek(pDecConfig->f_i,0, SEEK_SET);
+          sts = ReadBitStreamData(pDecConfig->pmfxBS, pDecConfig->f_i);
         }
-        if (FLAGS_pl)
-        {
-            gettimeofday(&pipeStartTs, NULL);
-        }
-        
-        if (MFX_ERR_MORE_SURFACE == sts || MFX_ERR_NONE == sts)
-        {
+        if (MFX_ERR_NONE != sts) return false;
+    }
+    if (FLAGS_pl || gDeadline)
+    {
+        pipeStartTs = VaLatencyStats::Clock::now();
+    }
+    
+    if (MFX_ERR_MORE_SURFACE == sts || MFX_ERR_NONE == sts)
+    {
 recheck21:
 
-            nIndexDec =GetFreeSurfaceIndex(pDecConfig->pmfxDecSurfaces, pDecConfig->nDecSurfNum);
-            if(nIndexDec == MFX_ERR_NOT_FOUND){
-               //std::cout << std::endl<< ">channel("<<pDecConfig->nChannel<<") >> Not able to find an avaialbe decoding recon surface" << std::endl;
-               usleep(10000);
-               goto recheck21;
-            }
+        nIndexDec =GetFreeSurfaceIndex(pDecConfig->pmfxDecSurfaces, pDecConfig->nDecSurfNum);
+        if(nIndexDec == MFX_ERR_NOT_FOUND){
+           //std::cout << std::endl<< ">channel("<<pDecConfig->nChannel<<") >> Not able to find an avaialbe decoding recon surface" << std::endl;
+           usleep(10000);
+           goto recheck21;
         }
+    }
 
-        if(bNeedMore == false)
-        {
-            if (MFX_ERR_MORE_SURFACE == sts || MFX_ERR_NONE == sts)
-            {   
+    if(bNeedMore == false)
+    {
+        if (MFX_ERR_MORE_SURFACE == sts || MFX_ERR_NONE == sts)
+        {   
 recheck:
-                nIndexVPP_In = GetFreeSurfaceIndex(pDecConfig->pmfxVPP_In_Surfaces, pDecConfig->nVPP_In_SurfNum); // Find free frame surface
-         
-                if(nIndexVPP_In == MFX_ERR_NOT_FOUND){
-                   std::cout << ">channel("<<pDecConfig->nChannel<<") >> Not able to find an avaialbe VPP input surface" << std::endl;
-                     
-                   goto recheck;
-                }
+            nIndexVPP_In = GetFreeSurfaceIndex(pDecConfig->pmfxVPP_In_Surfaces, pDecConfig->nVPP_In_SurfNum); // Find free frame surface
+     
+            if(nIndexVPP_In == MFX_ERR_NOT_FOUND){
+               std::cout << ">channel("<<pDecConfig->nChannel<<") >> Not able to find an avaialbe VPP input surface" << std::endl;
+                 
+               goto recheck;
             }
         }
+    }
 
-        // Decode a frame asychronously (returns immediately)
-        //  - If input bitstream contains multiple frames DecodeFrameAsync will start decoding multiple frames, and remove them from bitstream
-        sts = pDecConfig->pmfxDEC->DecodeFrameAsync(pDecConfig->pmfxBS, pDecConfig->pmfxDecSurfaces[nIndexDec], &(pDecConfig->pmfxVPP_In_Surfaces[nIndexVPP_In]), &syncpDec);
+    // Decode a frame asychronously (returns immediately)
+    //  - If input bitstream contains multiple frames DecodeFrameAsync will start decoding multiple frames, and remove them from bitstream
+    sts = pDecConfig->pmfxDEC->DecodeFrameAsync(pDecConfig->pmfxBS, pDecConfig->pmfxDecSurfaces[nIndexDec], &(pDecConfig->pmfxVPP_In_Surfaces[nIndexVPP_In]), &syncpDec);
 
-        // Ignore warnings if output is available,eat the Decode surface
-        // if no output and no action required just repecodeFrameAsync call
-        if (MFX_ERR_NONE < sts && syncpDec)
-        {
-            bNeedMore = false;
-            sts = MFX_ERR_NONE;
-        }
-        else if(MFX_ERR_MORE_DATA == sts)
-        {
-            bNeedMore = true;
-        }
-        else if(MFX_ERR_MORE_SURFACE == sts)
-        {
-            bNeedMore = true;
-        }
-        //else
+    // Ignore warnings if output is available,eat the Decode surface
+    // if no output and no action required just repecodeFrameAsync call
+    if (MFX_ERR_NONE < sts && syncpDec)
+    {
+        bNeedMore = false;
+        sts = MFX_ERR_NONE;
+    }
+    else if(MFX_ERR_MORE_DATA == sts)
+    {
+        bNeedMore = true;
+    }
+    else if(MFX_ERR_MORE_SURFACE == sts)
+    {
+        bNeedMore = true;
+    }
+    //else
 
-        if (MFX_ERR_NONE == sts )
-        {
-            pDecConfig->nFrameProcessed ++;
+    if (MFX_ERR_NONE == sts )
+    {
+        pDecConfig->nFrameProcessed ++;
+        // frames above -fps skip VPP and inference
+#ifdef TEST_KCF_TRACK_WITH_GPU
+        // only key frames are detected, the tracker reports how far apart they
+        // may be. Frames that are only tracked don't count against -fps
+        VaRateGovernor &governor = gGovernor[pDecConfig->nChannel];
+        bool bInfer = gKeyframe[pDecConfig->nChannel].NextFrame(governor.Available());
+        governor.Commit(bInfer);
+#else
+        bool bInfer = gGovernor[pDecConfig->nChannel].Admit();
+#endif
 
-          
+      
 #ifdef TEST_KCF_TRACK_WITH_GPU		
+      if (bInfer || FLAGS_fps_track)
+      {
 		    vsource_frame_t *srcTrackFrame = NULL;
-            srcTrackFrame = (vsource_frame_t*)pDecConfig->dKCFpipe->Get();
-            if(srcTrackFrame == NULL)
-			    break;
-			if ((nFrame % 6) == 0) 
+        srcTrackFrame = (vsource_frame_t*)pDecConfig->dKCFpipe->Get();
+        if(srcTrackFrame == NULL)
+			    return false;
+			if (bInfer) 
 			{
 				//std::cout<<"it is a Key frame, needs to do detection "<<nFrame<<std::endl;
 			    srcTrackFrame->bROIRrefresh = true;
@@ -545,195 +667,263 @@ recheck:
 
 		    mfxFrameSurface1* pSurface = pDecConfig->pmfxVPP_In_Surfaces[nIndexVPP_In];
 			pSurface->Data.Locked +=1;				 
-            srcTrackFrame->pmfxSurface = pSurface;
+        srcTrackFrame->pmfxSurface = pSurface;
 			//std::cout<<"	  Push frame into tracking thread: "<<pSurface<<std::endl; 
 			srcTrackFrame->timestamp = pipeStartTs;
 
-            pDecConfig->dKCFpipe->Store(srcTrackFrame);
-           
-            sem_post(&gNewTrackTaskAvaiable[pDecConfig->nChannel]);
+        pDecConfig->dKCFpipe->Store(srcTrackFrame);
+       
+        sem_post(&gNewTrackTaskAvaiable[pDecConfig->nChannel]);
+      }
 #endif
 
-#ifdef TEST_KCF_TRACK_WITH_GPU	
-            if ((nFrame % 6) == 0)
-#endif
-            {
-               //std::cout <<" send to inference workload" << std::endl;
+        if (bInfer)
+        {
+           //std::cout <<" send to inference workload" << std::endl;
 #ifdef TEST_KCF_TRACK_WITH_GPU				   
-               usleep(30000); 
+           usleep(30000); 
 #endif
 recheck2:
-               nIndexVPP_Out = GetFreeSurfaceIndex(pDecConfig->pmfxVPP_Out_Surfaces, pDecConfig->nVPP_Out_SurfNum); // Find free frame surface
+           nIndexVPP_Out = GetFreeSurfaceIndex(pDecConfig->pmfxVPP_Out_Surfaces, pDecConfig->nVPP_Out_SurfNum); // Find free frame surface
 
-               if(nIndexVPP_Out == MFX_ERR_NOT_FOUND){
-                   std::cout << ">channel("<<pDecConfig->nChannel<<") >> Not able to find an avaialbe VPP output surface" << std::endl;
-                 //  return NULL;
-                   goto recheck2;
-               }
-                              
-               for (;;)
-               {
-                   // Process a frame asychronously (returns immediately) 
-                   sts = pDecConfig->pmfxVPP->RunFrameVPPAsync(pDecConfig->pmfxVPP_In_Surfaces[nIndexVPP_In], pDecConfig->pmfxVPP_Out_Surfaces[nIndexVPP_Out], NULL, &syncpVPP);
+           if(nIndexVPP_Out == MFX_ERR_NOT_FOUND){
+               std::cout << ">channel("<<pDecConfig->nChannel<<") >> Not able to find an avaialbe VPP output surface" << std::endl;
+             //  return NULL;
+               goto recheck2;
+           }
+                          
+           for (;;)
+           {
+               // Process a frame asychronously (returns immediately) 
+               sts = pDecConfig->pmfxVPP->RunFrameVPPAsync(pDecConfig->pmfxVPP_In_Surfaces[nIndexVPP_In], pDecConfig->pmfxVPP_Out_Surfaces[nIndexVPP_Out], NULL, &syncpVPP);
 
-                   if (MFX_ERR_NONE < sts && !syncpVPP) // repeat the call if warning and no output
-                   {
-                       if (MFX_WRN_DEVICE_BUSY == sts)
-                       {
-                           std::cout << std::endl << "> warning: MFX_WRN_DEVICE_BUSY" << std::endl;
-                           usleep(1000); // wait if device is busy
-                       }
-                   }
-                   else if (MFX_ERR_NONE < sts && syncpVPP)
+               if (MFX_ERR_NONE < sts && !syncpVPP) // repeat the call if warning and no output
+               {
+                   if (MFX_WRN_DEVICE_BUSY == sts)
                    {
-                       sts = MFX_ERR_NONE; // ignore warnings if output is available
-                       break;
-                   }
-                   else{
-                       break; // not a warning
+                       std::cout << std::endl << "> warning: MFX_WRN_DEVICE_BUSY" << std::endl;
+                       usleep(1000); // wait if device is busy
                    }
                }
+               else if (MFX_ERR_NONE < sts && syncpVPP)
+               {
+                   sts = MFX_ERR_NONE; // ignore warnings if output is available
+                   break;
+               }
+               else{
+                   break; // not a warning
+               }
+           }
 
-               // VPP needs more data, let decoder decode another frame as input
-               if (MFX_ERR_MORE_DATA == sts)
-                 {
-                     continue;
-                 }
-                 else if (MFX_ERR_MORE_SURFACE == sts)
-                 {
-                    // Not relevant for the illustrated workload! Therefore not handled.
-                    // Relevant for cases when VPP produces more frames at output than consumes at input. E.g. framerate conversion 30 fps -> 60 fps
-                    break;
-                 }
-                 //else
-                 // std::cout << ">> Vpp sts" << sts << std::endl;
-                 // MSDK_BREAK_ON_ERROR(sts);
-                
+           // VPP needs more data, let decoder decode another frame as input
+           if (MFX_ERR_MORE_DATA == sts)
+             {
+                 return true;
+             }
+             else if (MFX_ERR_MORE_SURFACE == sts)
+             {
+                // Not relevant for the illustrated workload! Therefore not handled.
+                // Relevant for cases when VPP produces more frames at output than consumes at input. E.g. framerate conversion 30 fps -> 60 fps
+                return false;
+             }
+             //else
+             // std::cout << ">> Vpp sts" << sts << std::endl;
+             // MSDK_BREAK_ON_ERROR(sts);
+            
   
-                 if (MFX_ERR_NONE == sts)
-                 { 
-                    sts = pDecConfig->pmfxSession->SyncOperation(syncpVPP, 60000); // Synchronize. Wait until decoded frame is ready
-                    if(FLAGS_infer == 0){
-                        continue;
-                    }
-                    vsource_frame_t *srcframe = NULL;
-                    srcframe = (vsource_frame_t*) pDecConfig->dpipe->Get();
-                    srcframe->channel  = pDecConfig->nChannel;
-                    srcframe->frameno  = pDecConfig->nFrameProcessed;
-                    mfxU32 i, j, h, w;
+             if (MFX_ERR_NONE == sts)
+             { 
+                VaTraceScope syncSpan("vpp sync", pDecConfig->nChannel, nFrame);
+                sts = pDecConfig->pmfxSession->SyncOperation(syncpVPP, 60000); // Synchronize. Wait until decoded frame is ready
+                syncSpan.End();
+                VA_TRACE("copy", pDecConfig->nChannel, nFrame);
+                VaLatencyStats::Clock::time_point copyStart;
+                if (FLAGS_pl)
+                {
+                    copyStart = VaLatencyStats::Clock::now();
+                    gLatency.Record(pDecConfig->nChannel, VaLatencyStats::STAGE_DECODE, copyStart - pipeStartTs);
+                }
+                if(FLAGS_infer == 0){
+                    return true;
+                }
+#ifndef TEST_KCF_TRACK_WITH_GPU
+                if(FLAGS_zc){
+                    InsertFrameToDetector(pDecConfig, pDecConfig->pmfxVPP_Out_Surfaces[nIndexVPP_Out]);
+                    if (FLAGS_pl)
+                        gLatency.Record(pDecConfig->nChannel, VaLatencyStats::STAGE_COPY, copyStart);
+                    // let the scheduler pick up the deadline of a new batch
+                    sem_post(&gNewtaskAvaiable);
+                    nFrame++;
+                    return true;
+                }
+#endif
+                vsource_frame_t *srcframe = NULL;
+                srcframe = (vsource_frame_t*) pDecConfig->dpipe->Get();
+                if (srcframe == NULL){
+                    // inference is behind and the pipe drops the newest frame
+                    nFrame++;
+                    return true;
+                }
+                srcframe->channel  = pDecConfig->nChannel;
+                srcframe->frameno  = pDecConfig->nFrameProcessed;
+                mfxU32 i, j, h, w;
 
-                    mfxFrameSurface1* pSurface = pDecConfig->pmfxVPP_Out_Surfaces[nIndexVPP_Out];
+                mfxFrameSurface1* pSurface = pDecConfig->pmfxVPP_Out_Surfaces[nIndexVPP_Out];
 
-                    pDecConfig->pmfxAllocator->Lock(pDecConfig->pmfxAllocator->pthis, 
-                                                      pSurface->Data.MemId, 
-                                                      &(pSurface->Data));
-                    mfxFrameInfo* pInfo = &pSurface->Info;
-                    mfxFrameData* pData = &pSurface->Data;
-                           
-                  #ifndef TEST_KCF_TRACK_WITH_GPU	
+                pDecConfig->pmfxAllocator->Lock(pDecConfig->pmfxAllocator->pthis, 
+                                                  pSurface->Data.MemId, 
+                                                  &(pSurface->Data));
+                mfxFrameInfo* pInfo = &pSurface->Info;
+                mfxFrameData* pData = &pSurface->Data;
+                       
+              #ifndef TEST_KCF_TRACK_WITH_GPU	
 
-                    mfxU8* ptr;
-                    if (pInfo->CropH > 0 && pInfo->CropW > 0)
-                    {
-                        w = pInfo->CropW;
-                        h = pInfo->CropH;
-                    }
-                    else
-                    {
-                        w = pInfo->Width;
-                        h = pInfo->Height;
-                    }
+                mfxU8* ptr;
+                if (pInfo->CropH > 0 && pInfo->CropW > 0)
+                {
+                    w = pInfo->CropW;
+                    h = pInfo->CropH;
+                }
+                else
+                {
+                    w = pInfo->Width;
+                    h = pInfo->Height;
+                }
 
-                    mfxU8 *pTemp = srcframe->imgbuf;
-                    ptr   = pData->B + (pInfo->CropX ) + (pInfo->CropY ) * pData->Pitch;
+                mfxU8 *pTemp = srcframe->imgbuf;
+                ptr   = pData->B + (pInfo->CropX ) + (pInfo->CropY ) * pData->Pitch;
 
-                    for (i = 0; i < w; i++)
-                    {
-                       memcpy(pTemp + i*w, ptr + i*pData->Pitch, w);
-                    }
+                for (i = 0; i < w; i++)
+                {
+                   memcpy(pTemp + i*w, ptr + i*pData->Pitch, w);
+                }
 
 
-                    ptr	= pData->G + (pInfo->CropX ) + (pInfo->CropY ) * pData->Pitch;
-                    pTemp = srcframe->imgbuf + w*h;
-                    for(i = 0; i < h; i++)
-                    {
-                       memcpy(pTemp  + i*w, ptr + i*pData->Pitch, w);
-                    }
+                ptr	= pData->G + (pInfo->CropX ) + (pInfo->CropY ) * pData->Pitch;
+                pTemp = srcframe->imgbuf + w*h;
+                for(i = 0; i < h; i++)
+                {
+                   memcpy(pTemp  + i*w, ptr + i*pData->Pitch, w);
+                }
 
-                    ptr	= pData->R + (pInfo->CropX ) + (pInfo->CropY ) * pData->Pitch;
-                    pTemp = srcframe->imgbuf + 2*w*h;
-                    for(i = 0; i < h; i++)
-                    {
-                        memcpy(pTemp  + i*w, ptr + i*pData->Pitch, w);
-                    }
+                ptr	= pData->R + (pInfo->CropX ) + (pInfo->CropY ) * pData->Pitch;
+                pTemp = srcframe->imgbuf + 2*w*h;
+                for(i = 0; i < h; i++)
+                {
+                    memcpy(pTemp  + i*w, ptr + i*pData->Pitch, w);
+                }
 
-                  #else
+              #else
 
-                    mfxU8* ptr;
+                mfxU8* ptr;
 
-                    if (pInfo->CropH > 0 && pInfo->CropW > 0)
-                    {
-                        w = pInfo->CropW;
-                        h = pInfo->CropH;
-                    }
-                    else
-                    {
-                        w = pInfo->Width;
-                        h = pInfo->Height;
-                    }
+                if (pInfo->CropH > 0 && pInfo->CropW > 0)
+                {
+                    w = pInfo->CropW;
+                    h = pInfo->CropH;
+                }
+                else
+                {
+                    w = pInfo->Width;
+                    h = pInfo->Height;
+                }
 
-                    ptr = MSDK_MIN( MSDK_MIN(pData->R, pData->G), pData->B);
-                    ptr = ptr + pInfo->CropX + pInfo->CropY * pData->Pitch;
-                    mfxU8 *pTemp = srcframe->imgbuf;
-                    mfxU8  *ptrB   = pTemp;
-                    mfxU8  *ptrG   = pTemp + w*h;
-                    mfxU8  *ptrR   = pTemp + 2*w*h;
-                    for(int i = 0; i < h; i++)
-                    for (int j = 0; j < w; j++)
-                    {
-                        ptrB[i*w + j] =  ptr[i*pData->Pitch + j*4 +0];
-                        ptrG[i*w + j] =  ptr[i*pData->Pitch + j*4 +1];
-                        ptrR[i*w + j] =  ptr[i*pData->Pitch + j*4 +2];
-                    }
-                 #endif
-                    // basic info
-                    srcframe->imgpts     = srcframe->imgpts;
-                    srcframe->timestamp   = pipeStartTs;
-                    //srcframe->pixelformat = MFX_FOURCC_RGBP; //yuv420p;
-                    srcframe->realwidth   = w;
-                    srcframe->realheight  = h;
-                    srcframe->realstride  = w;
-                    srcframe->realsize = w * h * 3;
-
-                    pDecConfig->pmfxAllocator->Unlock(pDecConfig->pmfxAllocator->pthis, 
-                                                          pSurface->Data.MemId, 
-                                                          &(pSurface->Data));
+                ptr = MSDK_MIN( MSDK_MIN(pData->R, pData->G), pData->B);
+                ptr = ptr + pInfo->CropX + pInfo->CropY * pData->Pitch;
+                mfxU8 *pTemp = srcframe->imgbuf;
+                mfxU8  *ptrB   = pTemp;
+                mfxU8  *ptrG   = pTemp + w*h;
+                mfxU8  *ptrR   = pTemp + 2*w*h;
+                for(int i = 0; i < h; i++)
+                for (int j = 0; j < w; j++)
+                {
+                    ptrB[i*w + j] =  ptr[i*pData->Pitch + j*4 +0];
+                    ptrG[i*w + j] =  ptr[i*pData->Pitch + j*4 +1];
+                    ptrR[i*w + j] =  ptr[i*pData->Pitch + j*4 +2];
+                }
+             #endif
+                // basic info
+                srcframe->imgpts     = srcframe->imgpts;
+                srcframe->timestamp   = pipeStartTs;
+                //srcframe->pixelformat = MFX_FOURCC_RGBP; //yuv420p;
+                srcframe->realwidth   = w;
+                srcframe->realheight  = h;
+                srcframe->realstride  = w;
+                srcframe->realsize = w * h * 3;
+
+                pDecConfig->pmfxAllocator->Unlock(pDecConfig->pmfxAllocator->pthis, 
+                                                      pSurface->Data.MemId, 
+                                                      &(pSurface->Data));
 
 				
-                    // cv::Mat frame(h, w, CV_8UC4);  
-                    // frame.data = temp_img_buffer;  
-                    //cv::Mat frame = createMat(temp_img_buffer, w, h);
-                    // cv::cvtColor(frame, srcframe->cvImg, CV_BGRA2BGR);
-                    //frame.copyTo(srcframe->cvImg);
+                // cv::Mat frame(h, w, CV_8UC4);  
+                // frame.data = temp_img_buffer;  
+                //cv::Mat frame = createMat(temp_img_buffer, w, h);
+                // cv::cvtColor(frame, srcframe->cvImg, CV_BGRA2BGR);
+                //frame.copyTo(srcframe->cvImg);
 
-                    pDecConfig->dpipe->Store(srcframe);
-                    sem_post(&gNewtaskAvaiable);
+                if (FLAGS_pl)
+                {
+                    srcframe->storeTs = VaLatencyStats::Clock::now();
+                    srcframe->copyTime = srcframe->storeTs - copyStart;
+                }
+                pDecConfig->dpipe->Store(srcframe);
+                sem_post(&gNewtaskAvaiable);
 
-                }//if(sts==)
-                
-            }//for(;;) 
-            nFrame++;
-        }    
-    }
+            }//if(sts==)
+            
+        }//for(;;) 
+        nFrame++;
+    }    
+    return true;
+}
 
+static void DecodeDone(struct DecThreadConfig *pDecConfig)
+{
     pDecConfig->tmEnd = std::chrono::high_resolution_clock::now();
+    std::cout << std::endl<< "channel("<<pDecConfig->nChannel<<") pDecoding is done\r\n"<< std::endl;
+}
 
-    if(temp_img_buffer)
+// Decoding of a channel as a chain of executor tasks, one frame per task
+static void DecodeTask(struct DecThreadConfig *pDecConfig)
+{
+    if (DecodeStep(pDecConfig))
     {
-        free(temp_img_buffer);
-        temp_img_buffer = NULL;
+        gExecutor.Submit(std::bind(DecodeTask, pDecConfig));
+    }
+    else
+    {
+        DecodeDone(pDecConfig);
+    }
+}
+
+// ================= Decoding Thread =======
+void *DecodeThreadFunc(void *arg)
+{
+    struct DecThreadConfig *pDecConfig = NULL;
+    pDecConfig= (DecThreadConfig *) arg;
+    if( NULL == pDecConfig)
+    {
+        std::cout << std::endl << "Failed Decode Thread Configuration" << std::endl;
+        return NULL;
+    }
+    std::cout << std::endl <<">channel("<<pDecConfig->nChannel<<") Initialized " << std::endl;
+    if (gPlacement)
+    {
+        gTopology.BindThreadOnNode(VaCpuTopology::ROLE_DECODE, pDecConfig->nNode);
+    }
+    if (VaTracer::IsEnabled())
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "decode %d", pDecConfig->nChannel);
+        VaTracer::SetThreadName(name);
     }
-    std::cout << std::endl<< "channel("<<pDecConfig->nChannel<<") pDecoding is done\r\n"<< std::endl;
+
+    pDecConfig->tmStart = std::chrono::high_resolution_clock::now();
+    while (DecodeStep(pDecConfig))
+    {
+    }
+    DecodeDone(pDecConfig);
 
     return (void *)0;
 
@@ -742,6 +932,22 @@ recheck2:
 
 #ifdef TEST_KCF_TRACK_WITH_GPU
 #define MAX_NUM_TRACK_OBJECT 20
+// Call func for every object of a frame, on the tracking pool if there is
+// one. Each object has its own tracker and the caller merges the results in
+// object order afterwards
+static void RunTrackers(bool parallel, int count, const std::function<void(int)> &func)
+{
+    if (parallel && count > 1 && gTrackExecutor.GetThreadCount() > 0)
+    {
+        gTrackExecutor.ParallelFor(count, func);
+        return;
+    }
+    for (int i = 0; i < count; i ++)
+    {
+        func(i);
+    }
+}
+
 // ================= Decoding Thread =======
 void *TrackerThreadFunc(void *arg)
 {
@@ -761,12 +967,27 @@ void *TrackerThreadFunc(void *arg)
         return NULL;
     }
     std::cout << std::endl <<">channel("<<pTrackerConfig->nChannel<<") Initialized " << std::endl;
+    if (gPlacement)
+    {
+        gTopology.BindThreadOnNode(VaCpuTopology::ROLE_TRACK, pTrackerConfig->nNode);
+    }
+    if (VaTracer::IsEnabled())
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "tracker %d", pTrackerConfig->nChannel);
+        VaTracer::SetThreadName(name);
+    }
+    if (gQosEnabled)
+    {
+        // trackers of the lower classes get less of the cpu under load
+        gQos.SetThreadNice(gQos.GetClass(pTrackerConfig->nChannel));
+    }
 
     bool skiptrack = false;
     String tracker_algorithm = "HOG";
     bool HOG         = true;
     bool FIXEDWINDOW = false;
-    bool MULTISCALE  =  false;
+    bool MULTISCALE  =  FLAGS_kcf_multiscale;
     bool SILENT      = true;
     bool LAB         = false;
 
@@ -785,7 +1006,13 @@ void *TrackerThreadFunc(void *arg)
     {
         ptracker[nloop] = new KCFTracker(HOG, FIXEDWINDOW, MULTISCALE, LAB);
     }
-    int nCurTrackObjects = MAX_NUM_TRACK_OBJECT;
+    // CPU trackers take the NV12 copy of the frame instead of the surface
+    bool cpuTracking = !ptracker[0].onGpu();
+    // ptracker and objectResult are indexed by the slot of the track, a tracker
+    // keeps its model over the key frames that detect its object again
+    VaTrackManager &tracks = gTracks[pTrackerConfig->nChannel];
+    tracks.Initialize(MAX_NUM_TRACK_OBJECT, (float)FLAGS_track_iou, FLAGS_track_keep);
+    int nCurTrackObjects = 0;
     int classid[MAX_NUM_TRACK_OBJECT] = {0};
     float confidence[MAX_NUM_TRACK_OBJECT] = {0.0f};
     while (grunning)
@@ -800,18 +1027,40 @@ void *TrackerThreadFunc(void *arg)
             vsource_frame_t *srcframe  = NULL;
             vector<Detector::DetctorResult> objects;
 
-            srcframe = (vsource_frame_t*)pTrackerConfig->dpipe->Load(NULL);
+            VaFrameHandle frameref(pTrackerConfig->dpipe->Load(NULL));
+            srcframe = (vsource_frame_t*)frameref.Get();
             if (srcframe == NULL)
             {
                 std::cout << std::endl <<" no more frames on the track queeu" << std::endl;
                 break;
             }
+            VaLatencyStats::Clock::time_point trackStart = VaLatencyStats::Clock::now();
             mfxFrameSurface1* pSurface = srcframe->pmfxSurface;
             mfxHDL handle;
             pTrackerConfig->pmfxAllocator->GetHDL(pTrackerConfig->pmfxAllocator->pthis, 
                                                       pSurface->Data.MemId, 
                                                       &(handle));
 
+            // The CPU trackers sample their search windows straight from an
+            // NV12 copy of the surface, the GPU trackers read the surface
+            // itself. Only the display needs the whole frame in BGR
+            cv::Mat yuvimg;
+            cv::Mat rgbimg;
+            if (cpuTracking || FLAGS_show)
+            {
+                pTrackerConfig->pmfxAllocator->Lock(pTrackerConfig->pmfxAllocator->pthis, 
+                                                      pSurface->Data.MemId, 
+                                                      &(pSurface->Data));
+                WriteRawFrameToMemory(pSurface, rawWidth, rawHeight, dest,MFX_FOURCC_NV12);
+                pSurface->Data.Locked -=1;
+                pTrackerConfig->pmfxAllocator->Unlock(pTrackerConfig->pmfxAllocator->pthis, 
+                                                      pSurface->Data.MemId, 
+                                                      &(pSurface->Data));
+                yuvimg = cv::Mat(rawHeight*3/2, rawWidth, CV_8UC1, dest);
+                if (FLAGS_show)
+                    cv::cvtColor(yuvimg, rgbimg, CV_YUV2BGR_NV12);
+            }
+
             //std::cout << std::endl <<"VASurfaceID ****: "<< *((unsigned int *)handle) << std::endl;
             Rect2d result[MAX_NUM_TRACK_OBJECT];
             if(srcframe->bROIRrefresh == true)
@@ -824,9 +1073,10 @@ void *TrackerThreadFunc(void *arg)
                 if(!gDetectResultque[pTrackerConfig->nChannel].empty()){
                     object = gDetectResultque[pTrackerConfig->nChannel].front();
                     gDetectResultque[pTrackerConfig->nChannel].pop();
-                    nCurTrackObjects = (object.boxs.size() >  MAX_NUM_TRACK_OBJECT? MAX_NUM_TRACK_OBJECT:object.boxs.size());
+                    int nDetectObjects = (object.boxs.size() >  MAX_NUM_TRACK_OBJECT? MAX_NUM_TRACK_OBJECT:object.boxs.size());
+                    gKeyframe[pTrackerConfig->nChannel].OnDetection(nDetectObjects);
                     std::cout << std::endl <<"Detection  result is ready: object.boxs.size()= " <<object.boxs.size()<< std::endl;
-                    for(int i=0; i< nCurTrackObjects; i++)
+                    for(int i=0; i< nDetectObjects; i++)
                     {
              
                         if(CLASSES[(int)(object.boxs[i].classid)][0]=='!')
@@ -834,37 +1084,56 @@ void *TrackerThreadFunc(void *arg)
                         //std::cout<<"bounding box: x="<< object.boxs[0].left<< " y="<< object.boxs[0].right << " top="<<object.boxs[0].top<< "boottm="<<object.boxs[0].bottom <<std::endl;
                     }
                     tmStart = std::chrono::high_resolution_clock::now();
+                    VA_TRACE("track init", pTrackerConfig->nChannel, srcframe->frameno);
+                    Rect2d detected[MAX_NUM_TRACK_OBJECT];
+                    for(int nloop=0; nloop< nDetectObjects; nloop++)
+                    {
+                        Rect2d boundingBox;
+                        float Hfactor = rawWidth/304.0f;
+                        float Vfactor = rawHeight/304.0f ;
+                        boundingBox.x = object.boxs[nloop].left*Hfactor;
+                        boundingBox.y = object.boxs[nloop].top*Vfactor;
+                        boundingBox.width  = (object.boxs[nloop].right  - object.boxs[nloop].left)*Hfactor;
+                        boundingBox.height = (object.boxs[nloop].bottom - object.boxs[nloop].top)*Vfactor;
+                        confidence[nloop] = object.boxs[nloop].confidence;
+                        classid[nloop] = object.boxs[nloop].classid;
+                        detected[nloop] = boundingBox;
+                    }
+                    nCurTrackObjects = tracks.Associate(detected, classid, confidence, nDetectObjects);
                     if( nCurTrackObjects == 0 /*&& object.boxs.size()>20*/){
                        skiptrack = true;
                        //std::cout << std::endl <<"no key object found, try to skip Key frame:: "<< pSurface << std::endl;
                     }else
                     {
+                        // only new tracks are trained from scratch, the ones detected
+                        // again move to the detection, the missed ones stay where they are
+                        RunTrackers(cpuTracking, nCurTrackObjects, [&](int nloop) {
+                            int slot = tracks.GetSlot(nloop);
+                            const VaTrackManager::Track &track = tracks.GetTrack(slot);
+                            if (!track.fresh) {
+                                if (track.misses == 0)
+                                    ptracker[slot].correct(track.box);
+                            } else if (cpuTracking)
+                                ptracker[slot].init(track.box, yuvimg);
+                            else
+                                ptracker[slot].init(track.box, *((unsigned int *)handle), rawWidth, rawHeight);
+                        });
+
                         for(int nloop=0; nloop< nCurTrackObjects; nloop++)
                         {
-                            Rect2d boundingBox;
-                            float Hfactor = rawWidth/304.0f;
-                            float Vfactor = rawHeight/304.0f ;
-                            boundingBox.x = object.boxs[nloop].left*Hfactor;
-                            boundingBox.y = object.boxs[nloop].top*Vfactor;
-                            boundingBox.width  = (object.boxs[nloop].right  - object.boxs[nloop].left)*Hfactor;
-                            boundingBox.height = (object.boxs[nloop].bottom - object.boxs[nloop].top)*Vfactor;
-                            confidence[nloop] = object.boxs[nloop].confidence;
-                            classid[nloop] = object.boxs[nloop].classid;
-                          
-                            ptracker[nloop].init(boundingBox, *((unsigned int *)handle), rawWidth, rawHeight);
-
-                            result[nloop] = boundingBox;
-
-                            objectResult[nloop].classid    = classid[nloop];
-                            objectResult[nloop].confidence = confidence[nloop];
-                            objectResult[nloop].left       = (int)(result[nloop].x);
-                            objectResult[nloop].top        = (int)(result[nloop].y);
-                            objectResult[nloop].right      = (int)(result[nloop].width +result[nloop].x);
-                            objectResult[nloop].bottom     = (int)(result[nloop].height+result[nloop].y);
-                            if (objectResult[nloop].left < 0) objectResult[nloop].left = 0;
-                            if (objectResult[nloop].top < 0) objectResult[nloop].top = 0;
-                            if (objectResult[nloop].right >= rawWidth) objectResult[nloop].right = rawWidth - 1;
-                            if (objectResult[nloop].bottom >= rawHeight) objectResult[nloop].bottom = rawHeight - 1;
+                            int slot = tracks.GetSlot(nloop);
+                            const VaTrackManager::Track &track = tracks.GetTrack(slot);
+                            objectResult[slot].classid    = track.classid;
+                            objectResult[slot].confidence = track.confidence;
+                            objectResult[slot].trackid    = track.id;
+                            objectResult[slot].left       = (int)(track.box.x);
+                            objectResult[slot].top        = (int)(track.box.y);
+                            objectResult[slot].right      = (int)(track.box.width +track.box.x);
+                            objectResult[slot].bottom     = (int)(track.box.height+track.box.y);
+                            if (objectResult[slot].left < 0) objectResult[slot].left = 0;
+                            if (objectResult[slot].top < 0) objectResult[slot].top = 0;
+                            if (objectResult[slot].right >= rawWidth) objectResult[slot].right = rawWidth - 1;
+                            if (objectResult[slot].bottom >= rawHeight) objectResult[slot].bottom = rawHeight - 1;
                         }
                         skiptrack = false;
                         //std::cout << std::endl <<"MIN: object.boxs.size= "<<object.boxs.size()  << std::endl;
@@ -885,20 +1154,43 @@ void *TrackerThreadFunc(void *arg)
                     //KCF_update
                     // Rect result;
                     tmStart = std::chrono::high_resolution_clock::now();
+                    VA_TRACE("track update", pTrackerConfig->nChannel, srcframe->frameno);
+                    float peakSum = 0.0f;
+                    float motion  = 0.0f;
+                    RunTrackers(cpuTracking, nCurTrackObjects, [&](int nloop) {
+                        int slot = tracks.GetSlot(nloop);
+                        if (cpuTracking)
+                            result[slot] = ptracker[slot].update(yuvimg);
+                        else
+                            result[slot] = ptracker[slot].update(*((unsigned int *)handle), rawWidth, rawHeight);
+                    });
+
                     for(int nloop=0; nloop< nCurTrackObjects; nloop++)
                     {
-                        result[nloop] = ptracker[nloop].update(*((unsigned int *)handle), rawWidth, rawHeight);
-                        objectResult[nloop].classid        = classid[nloop];
-                        objectResult[nloop].confidence     = confidence[nloop];
-                        objectResult[nloop].left           = (int)(result[nloop].x);
-                        objectResult[nloop].top            = (int)(result[nloop].y);
-                        objectResult[nloop].right          = (int)(result[nloop].width +result[nloop].x);
-                        objectResult[nloop].bottom         = (int)(result[nloop].height+result[nloop].y);
-                        if (objectResult[nloop].left < 0) objectResult[nloop].left = 0;
-                        if (objectResult[nloop].top < 0) objectResult[nloop].top = 0;
-                        if (objectResult[nloop].right >= rawWidth) objectResult[nloop].right = rawWidth - 1;
-                        if (objectResult[nloop].bottom >= rawHeight) objectResult[nloop].bottom = rawHeight - 1;
+                        int slot = tracks.GetSlot(nloop);
+                        float prevX = (objectResult[slot].left + objectResult[slot].right) / 2.0f;
+                        float prevY = (objectResult[slot].top + objectResult[slot].bottom) / 2.0f;
+                        peakSum += ptracker[slot].getPeakValue();
+                        // center shift relative to the box size
+                        float size = std::sqrt((float)(result[slot].width * result[slot].height));
+                        if (size > 0) {
+                            float dx = result[slot].x + result[slot].width / 2 - prevX;
+                            float dy = result[slot].y + result[slot].height / 2 - prevY;
+                            motion = std::max(motion, std::sqrt(dx * dx + dy * dy) / size);
+                        }
+                        // the next key frame matches its detections with these boxes
+                        tracks.SetBox(slot, result[slot]);
+                        objectResult[slot].left           = (int)(result[slot].x);
+                        objectResult[slot].top            = (int)(result[slot].y);
+                        objectResult[slot].right          = (int)(result[slot].width +result[slot].x);
+                        objectResult[slot].bottom         = (int)(result[slot].height+result[slot].y);
+                        if (objectResult[slot].left < 0) objectResult[slot].left = 0;
+                        if (objectResult[slot].top < 0) objectResult[slot].top = 0;
+                        if (objectResult[slot].right >= rawWidth) objectResult[slot].right = rawWidth - 1;
+                        if (objectResult[slot].bottom >= rawHeight) objectResult[slot].bottom = rawHeight - 1;
                     }
+                    if (nCurTrackObjects > 0)
+                        gKeyframe[pTrackerConfig->nChannel].OnTracking(peakSum / nCurTrackObjects, motion);
                     tmEnd = std::chrono::high_resolution_clock::now();
                     diffTime  = tmEnd   - tmStart;
                     std::cout<< "Generate ROI via update takes: :" << diffTime.count()*1000 <<"(ms)"<<std::endl;
@@ -906,32 +1198,13 @@ void *TrackerThreadFunc(void *arg)
             }
         }
 
-        if (FLAGS_pl){
-            struct timeval timestamp;
-            gettimeofday(&timestamp, NULL);
-            std::cout<< "Pipeline latency " << (timestamp.tv_sec - srcframe->timestamp.tv_sec) * 1000000 + timestamp.tv_usec - srcframe->timestamp.tv_usec << "(us)" << std::endl;
+        if (FLAGS_pl)
+        {
+            gLatency.Record(pTrackerConfig->nChannel, VaLatencyStats::STAGE_TRACK, trackStart);
+            gLatency.Record(pTrackerConfig->nChannel, VaLatencyStats::STAGE_TOTAL, srcframe->timestamp);
         }
 
-        // Get the Decode output surface, it is not Optimized way.
-        pTrackerConfig->pmfxAllocator->Lock(pTrackerConfig->pmfxAllocator->pthis, 
-                                              pSurface->Data.MemId, 
-                                              &(pSurface->Data));
-
 #if 1
-        WriteRawFrameToMemory(pSurface, rawWidth, rawHeight, dest,MFX_FOURCC_NV12);
-        pSurface->Data.Locked -=1;
-        pTrackerConfig->pmfxAllocator->Unlock(pTrackerConfig->pmfxAllocator->pthis, 
-                                              pSurface->Data.MemId, 
-                                              &(pSurface->Data));
-
-        //Got the NV12, now trying to conver to RGBP
-        cv::Mat yuvimg;
-        cv::Mat rgbimg;
-        rgbimg.create(rawHeight,rawWidth,CV_8UC3);
-        yuvimg.create(rawHeight*3/2, rawWidth, CV_8UC1);
-        yuvimg.data = dest;
-        cv::cvtColor(yuvimg, rgbimg, CV_YUV2BGR_I420);
-
         //cv::namedWindow( "Display window", cv::WINDOW_AUTOSIZE );
         //cv::imshow( "Display window", rgbimg );  
         //cv::waitKey(100);
@@ -951,14 +1224,17 @@ void *TrackerThreadFunc(void *arg)
 
         for(int nloop=0; nloop< nCurTrackObjects && skiptrack == false; nloop++){
         //if( objectResult[nloop].confidence > 0.3)
-        objects2[0].boxs.push_back(objectResult[nloop]);
+        objects2[0].boxs.push_back(objectResult[tracks.GetSlot(nloop)]);
+        }
+        // nobody shows the boxes without -show, and there is no image for them
+        if (FLAGS_show) {
+            pthread_mutex_lock(&mutexshow);
+            gresultque.push(objects2);
+            pthread_mutex_unlock(&mutexshow);
+            sem_post(&g_semtshow);
         }
-        pthread_mutex_lock(&mutexshow); 	
-        gresultque.push(objects2);
-        pthread_mutex_unlock(&mutexshow); 	
-        sem_post(&g_semtshow);
 #endif
-        pTrackerConfig->dpipe->Put(srcframe);
+        frameref.Reset();
 
 
        }// for (auto& dpipe : *(pScheConfig->pvdpipe)) 
@@ -992,6 +1268,116 @@ class ScheduleThreadConfig
     bool               bTerminated;
  };
 
+// Record how long the images of finished batches spent in the detector. The
+// results of the tracking build are not done yet, the tracker records their total
+static void RecordDetectLatency(const vector<Detector::DetctorResult>& objects)
+{
+    if (!FLAGS_pl)
+        return;
+    VaLatencyStats::Clock::time_point now = VaLatencyStats::Clock::now();
+    for (size_t k = 0; k < objects.size(); k++) {
+        int channel = objects[k].inputid;
+        gLatency.Record(channel, VaLatencyStats::STAGE_BATCH, objects[k].submitted - objects[k].inserted);
+        gLatency.Record(channel, VaLatencyStats::STAGE_INFER, objects[k].completed - objects[k].submitted);
+        gLatency.Record(channel, VaLatencyStats::STAGE_POSTPROC, now - objects[k].completed);
+#ifndef TEST_KCF_TRACK_WITH_GPU
+        if (objects[k].origin != VaLatencyStats::Clock::time_point())
+            gLatency.Record(channel, VaLatencyStats::STAGE_TOTAL, now - objects[k].origin);
+#endif
+    }
+}
+
+// Hand the results of a finished batch to the tracker or the display
+static void DispatchDetectResult(Detector::InsertImgStatus faceret, vector<Detector::DetctorResult>& objects)
+{
+    if (Detector::INSERTIMG_GET != faceret && Detector::INSERTIMG_PROCESSED != faceret)
+        return;
+    VA_TRACE("dispatch", -1, -1, objects.empty() ? -1 : objects[0].batchid);
+    RecordDetectLatency(objects);
+    if (gDeadline) {
+        for (size_t k = 0; k < objects.size(); k++)
+            gReadyQueue.RecordServiceTime(objects[k].completed - objects[k].submitted);
+    }
+#ifdef TEST_KCF_TRACK_WITH_GPU
+    std::cout <<" Infer:" << " done one frame : objects= "<< objects.size() << std::endl; 
+
+    for(int k=0;k<objects.size();k++){
+        // inform the queue of the channelid
+        // pthread_mutex_lock(&mutexshow);	
+        std::cout <<" Infer:" << " push detect result to Detect Result queue: "<< objects[k].channelid << " boxes=" <<objects[k].boxs.size()  <<std::endl; 
+        gDetectResultque[objects[k].channelid].push(objects[k]);
+        //pthread_mutex_unlock(&mutexshow);	
+        sem_post(&gDetectResultAvaiable[objects[k].channelid]);
+    }  
+
+#else
+    for(int k=0;k<objects.size();k++){
+        each_frame[objects[k].inputid]+=1;
+        total_frame[0]++;
+
+        if(FLAGS_pv){
+            // Enable performance dump
+            struct timeval timestamp;
+            gettimeofday(&timestamp, NULL);
+            std::cout<< "Finish inference frame " << timestamp.tv_sec * 1000000 + timestamp.tv_usec << "(us) from channelID="<<objects[k].inputid<< " frameNo=" << objects[k].frameno<<std::endl;
+        }
+    }
+    if( Detector::INSERTIMG_GET == faceret && FLAGS_show){
+        // the display draws on its own copy, the frame can go back to its pipe
+        for(int k=0;k<objects.size();k++){
+            if(objects[k].orgimg.empty() && objects[k].frame){
+                vsource_frame_t *srcframe = (vsource_frame_t*)objects[k].frame.Get();
+                objects[k].orgimg = createMat(srcframe->imgbuf, gNet_input_width, gNet_input_height);
+            }
+            objects[k].frame.Reset();
+        }
+        pthread_mutex_lock(&mutexshow); 	
+        gresultque.push(objects);
+        pthread_mutex_unlock(&mutexshow); 
+        sem_post(&g_semtshow);
+
+        pthread_mutex_lock(&mutexshow); 
+        while(gresultque.size()>=2 && grunning){  //only cache 2 batch
+            pthread_mutex_unlock(&mutexshow); 	
+            usleep(1*1000); //sleep 2ms to recheck
+            pthread_mutex_lock(&mutexshow); 
+        }
+        pthread_mutex_unlock(&mutexshow); 
+    }
+        
+#endif
+}
+
+// Copy the planes of a decoded frame into the next batch slot of the detector.
+// The frame is only held on to when the display needs its pixels again
+static Detector::InsertImgStatus InsertFrame(Detector& detector, const VaFrameHandle& frameref, vector<Detector::DetctorResult>& objects)
+{
+    vsource_frame_t *srcframe = (vsource_frame_t*)frameref.Get();
+    VaTraceScope span("insert", srcframe->channel, srcframe->frameno);
+    Detector::PlanarSlot planar;
+    IDtype *dst = detector.InsertPlanar(planar, srcframe->channel, srcframe->frameno, 0,
+                                        FLAGS_show ? frameref : VaFrameHandle(), srcframe->timestamp);
+    if (dst == NULL)
+        return Detector::INSERTIMG_NULL;
+    span.SetBatch(planar.batch);
+    VaLatencyStats::Clock::time_point copyStart;
+    if (FLAGS_pl)
+        copyStart = VaLatencyStats::Clock::now();
+
+    // imgbuf holds the B, G, R planes, the blob takes them the way createMat() and the split did
+    int planesize = gNet_input_width * gNet_input_height;
+    for (int c = 0; c < 3; c++)
+    {
+        memcpy(dst + c * planesize, srcframe->imgbuf + (2 - c) * planesize, planesize);
+    }
+    // both copies of the frame, out of the surface and into the blob
+    if (FLAGS_pl)
+        gLatency.Record(srcframe->channel, VaLatencyStats::STAGE_COPY,
+                        srcframe->copyTime + (VaLatencyStats::Clock::now() - copyStart));
+    detector.CommitPlanar(planar);
+    return detector.FetchResults(objects);
+}
+
 void *ScheduleThreadFunc(void *arg)
 {
     std::cout <<" Schedue Func thread called" << std::endl;
@@ -1010,101 +1396,137 @@ void *ScheduleThreadFunc(void *arg)
         std::cout << std::endl << "Failed Inference Thread Configuration" << std::endl;
         return NULL;
     }
+    if (gPlacement)
+    {
+        gTopology.BindThreadOnNode(VaCpuTopology::ROLE_PREPROCESS,
+                                   gTopology.GetNodes(VaCpuTopology::ROLE_PREPROCESS)[0]);
+    }
+    VaTracer::SetThreadName("scheduler");
     pScheConfig->totalInferNum =0;
     
 #ifndef ENABLE_WORKLOAD_BALANCE
- while (grunning)
-   {
-        // wake-up when a new task avaiable
-        sem_wait(&gNewtaskAvaiable);
-        for (auto& dualpipe : *(pScheConfig->pvdpipe)) 
-        {
-             vsource_frame_t *srcframe  = NULL;
-             srcframe = (vsource_frame_t*)dualpipe->Load(NULL);
-             if( srcframe == NULL ) {
-                 continue;
-             }
-                
-             pScheConfig->totalInferNum++;
-             fpsCount++;
-             if(fpsCount == 1){
-                 staticsStart = std::chrono::high_resolution_clock::now();
-             }else if(fpsCount == 100){
-                 staticsEnd = std::chrono::high_resolution_clock::now();
-
-                 chrono::duration<double> diffTime  = staticsEnd   - staticsStart;
-                 double fps = (100*1000/(diffTime.count()*1000.0));
-                 total_fps = fps;
-                 std::cout<< "Schedule FPS:" << fps <<"(f/s)"<<std::endl;
-                 fpsCount = 0;
-             }
-       
-             //cv::Mat frame = srcframe->cvImg;
-             cv::Mat frame = createMat(srcframe->imgbuf, gNet_input_width, gNet_input_height);
-             dualpipe->Put(srcframe);
-
+    // hand one frame on to the detector
+    auto ScheduleFrame = [&](VaFrameHandle &frameref) {
+        vsource_frame_t *srcframe  = (vsource_frame_t*)frameref.Get();
+        VA_TRACE("schedule", srcframe->channel, srcframe->frameno);
+
+        pScheConfig->totalInferNum++;
+        fpsCount++;
+        if(fpsCount == 1){
+            staticsStart = std::chrono::high_resolution_clock::now();
+        }else if(fpsCount == 100){
+            staticsEnd = std::chrono::high_resolution_clock::now();
+
+            chrono::duration<double> diffTime  = staticsEnd   - staticsStart;
+            double fps = (100*1000/(diffTime.count()*1000.0));
+            total_fps = fps;
+            std::cout<< "Schedule FPS:" << fps <<"(f/s)"<<std::endl;
+            fpsCount = 0;
+        }
 
-             std::chrono::high_resolution_clock::time_point staticsStart3, staticsEnd3;
-             staticsStart3 = std::chrono::high_resolution_clock::now();
+        if (FLAGS_pl)
+            gLatency.Record(srcframe->channel, VaLatencyStats::STAGE_QUEUE, srcframe->storeTs);
 
-             if(FLAGS_pv){
-                 // Enable performance dump
-                   struct timeval timestamp;
-                   gettimeofday(&timestamp, NULL);
-                   std::cout<< "submit inference frame " << timestamp.tv_sec * 1000000 + timestamp.tv_usec << "(us) from channelID="<<srcframe->channel<< " frameNo=" << srcframe->frameno<<std::endl;
-             }
-             faceret = gDetector[0].InsertImage(frame, objects, srcframe->channel, srcframe->frameno);
-             staticsEnd3 = std::chrono::high_resolution_clock::now();
-             std::chrono::duration<double> diffTime3  = staticsEnd3   - staticsStart3;
-             //std::cout <<" Infer:" << diffTime3.count()*1000.0<<"ms"<<std::endl;	
-             if (Detector::INSERTIMG_GET == faceret ||Detector::INSERTIMG_PROCESSED == faceret)     {   //aSync call, you must use the ret image
-#ifdef TEST_KCF_TRACK_WITH_GPU
-                std::cout <<" Infer:" << " done one frame : objects= "<< objects.size() << std::endl; 
+        std::chrono::high_resolution_clock::time_point staticsStart3, staticsEnd3;
+        staticsStart3 = std::chrono::high_resolution_clock::now();
 
-                for(int k=0;k<objects.size();k++){
-                    // inform the queue of the channelid
-                    // pthread_mutex_lock(&mutexshow);	
-                    std::cout <<" Infer:" << " push detect result to Detect Result queue: "<< objects[k].channelid << " boxes=" <<objects[k].boxs.size()  <<std::endl; 
-                    gDetectResultque[objects[k].channelid].push(objects[k]);
-                    //pthread_mutex_unlock(&mutexshow);	
-                    sem_post(&gDetectResultAvaiable[objects[k].channelid]);
-                }  
+        if(FLAGS_pv){
+            // Enable performance dump
+              struct timeval timestamp;
+              gettimeofday(&timestamp, NULL);
+              std::cout<< "submit inference frame " << timestamp.tv_sec * 1000000 + timestamp.tv_usec << "(us) from channelID="<<srcframe->channel<< " frameNo=" << srcframe->frameno<<std::endl;
+        }
+        faceret = InsertFrame(gDetector[0], frameref, objects);
+        staticsEnd3 = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> diffTime3  = staticsEnd3   - staticsStart3;
+        //std::cout <<" Infer:" << diffTime3.count()*1000.0<<"ms"<<std::endl;	
+        DispatchDetectResult(faceret, objects);
+    };
 
-#else
-                 for(int k=0;k<objects.size();k++){
-                     each_frame[objects[k].inputid]+=1;
-                     total_frame[0]++;
-
-                     if(FLAGS_pv){
-                         // Enable performance dump
-                         struct timeval timestamp;
-                         gettimeofday(&timestamp, NULL);
-                         std::cout<< "Finish inference frame " << timestamp.tv_sec * 1000000 + timestamp.tv_usec << "(us) from channelID="<<objects[k].inputid<< " frameNo=" << objects[k].frameno<<std::endl;
-                    }
-                 }
-                 if (FLAGS_pl){
-                     struct timeval timestamp;
-                     gettimeofday(&timestamp, NULL);
-                     std::cout<< "Pipeline latency " << (timestamp.tv_sec - srcframe->timestamp.tv_sec) * 1000000 + timestamp.tv_usec - srcframe->timestamp.tv_usec << "(us)" << std::endl;
-                 }
-                 if( Detector::INSERTIMG_GET == faceret && FLAGS_show){
-                     pthread_mutex_lock(&mutexshow); 	
-                     gresultque.push(objects);
-                     pthread_mutex_unlock(&mutexshow); 
-                     sem_post(&g_semtshow);
-
-                     pthread_mutex_lock(&mutexshow); 
-                     while(gresultque.size()>=2 && grunning){  //only cache 2 batch
-                         pthread_mutex_unlock(&mutexshow); 	
-                         usleep(1*1000); //sleep 2ms to recheck
-                         pthread_mutex_lock(&mutexshow); 
-                     }
-                     pthread_mutex_unlock(&mutexshow); 
+ while (grunning)
+   {
+        // wake-up when a new task avaiable, or when the oldest frame of the
+        // pending batch reaches its deadline
+        timespec deadline;
+        if (gDetector[0].GetBatchDeadline(deadline))
+        {
+            if (sem_timedwait(&gNewtaskAvaiable, &deadline) != 0 && errno == ETIMEDOUT)
+            {
+                faceret = gDetector[0].FlushBatch(objects);
+                DispatchDetectResult(faceret, objects);
+                continue;
+            }
+        }
+        else
+        {
+            sem_wait(&gNewtaskAvaiable);
+        }
+        // a completed infer request posts the semaphore as well
+        faceret = gDetector[0].FetchResults(objects);
+        DispatchDetectResult(faceret, objects);
+        if (gDeadline) {
+            // everything that arrived goes into the ready queue, which feeds
+            // the detector earliest deadline first while it has a free request
+            for (auto& dualpipe : *(pScheConfig->pvdpipe)) {
+                for (;;) {
+                    VaFrameHandle frameref(dualpipe->LoadNoWait());
+                    if (!frameref)
+                        break;
+                    vsource_frame_t *srcframe = (vsource_frame_t*)frameref.Get();
+                    gReadyQueue.Push(srcframe->channel, srcframe->timestamp, std::move(frameref));
+                }
+            }
+            VaDeadlineQueue::Clock::time_point now = VaDeadlineQueue::Clock::now();
+            VaFrameHandle frameref;
+            int nChannel;
+            // an idle detector takes the head frame anyway, else nothing would
+            // bring down an estimate that makes every frame late
+            bool idle = gDetector[0].IsIdle();
+            while (gDetector[0].CanInsert() && gReadyQueue.Pop(frameref, nChannel, now, idle)) {
+                ScheduleFrame(frameref);
+                frameref.Reset();
+                now = VaDeadlineQueue::Clock::now();
+                idle = false;
+            }
+            gReadyQueue.DropLate(now);
+        }
+        else if (gQosEnabled) {
+            // one queue per class, batch slots are shared by class weight
+            for (auto& dualpipe : *(pScheConfig->pvdpipe)) {
+                for (;;) {
+                    VaFrameHandle frameref(dualpipe->LoadNoWait());
+                    if (!frameref)
+                        break;
+                    vsource_frame_t *srcframe = (vsource_frame_t*)frameref.Get();
+                    gQos.Push(srcframe->channel, std::move(frameref));
+                }
+            }
+            VaFrameHandle frameref;
+            int nChannel;
+            while (gDetector[0].CanInsert() && gQos.Pop(frameref, nChannel)) {
+                ScheduleFrame(frameref);
+                frameref.Reset();
+            }
+        }
+        else {
+            // every stored frame posted the semaphore once, so an empty channel
+            // is skipped instead of holding up the others
+            for (auto& dualpipe : *(pScheConfig->pvdpipe)) 
+            {
+                 VaFrameHandle frameref(dualpipe->LoadNoWait());
+                 if( !frameref ) {
+                     continue;
                  }
-                
-#endif 
-            }//if (Detector::INSERTIMG_GET 
-       }// for (auto& dpipe : *(pScheConfig->pvdpipe)) 
+                 ScheduleFrame(frameref);
+            }// for (auto& dpipe : *(pScheConfig->pvdpipe)) 
+        }
+
+        // frames trickle in slower than the deadline, don't let the partial batch wait
+        if (gDetector[0].BatchExpired())
+        {
+            faceret = gDetector[0].FlushBatch(objects);
+            DispatchDetectResult(faceret, objects);
+        }
    }//while
 #else
     while (grunning)
@@ -1121,6 +1543,8 @@ void *ScheduleThreadFunc(void *arg)
             {
                 continue;
             }
+            if (FLAGS_pl)
+                gLatency.Record(srcframe->channel, VaLatencyStats::STAGE_QUEUE, srcframe->storeTs);
             infer_task_t task;
             task.dpipe   = dualpipe;
             task.dbuffer = srcframe;
@@ -1259,7 +1683,10 @@ void *InferThreadFunc(void *arg)
 
     Detector::InsertImgStatus faceret=Detector::INSERTIMG_NULL;
     int fpsCount = 0;
-    set_cpu(pInferConfig->nChannel);
+    if (gPlacement)
+        gTopology.BindThread(VaCpuTopology::ROLE_INFER, pInferConfig->nChannel);
+    else
+        set_cpu(pInferConfig->nChannel);
     
     std::cout <<" InferThreadFunc called : channelID " << pInferConfig->nChannel << std::endl;
     while (grunning)
@@ -1296,11 +1723,16 @@ void *InferThreadFunc(void *arg)
             // Maybe this can be moved to scheduler.
             //cv::Mat frame = srcframe->cvImg; 
             cv::Mat frame = createMat(srcframe->imgbuf, gNet_input_width, gNet_input_height);
-            task.dpipe->Put(srcframe);
+            // adopt the reference of the task, the buffer goes back to the pipe after the insertion
+            VaFrameHandle frameref(srcframe);
             vector<Detector::DetctorResult> objects;
-            faceret = gDetector[pInferConfig->nChannel].InsertImage(frame,objects,srcframe->channel, srcframe->frameno);	
+            VaTraceScope insertSpan("InsertImage", srcframe->channel, srcframe->frameno);
+            faceret = gDetector[pInferConfig->nChannel].InsertImage(frame,objects,srcframe->channel, srcframe->frameno, 0, VaFrameHandle(), srcframe->timestamp);	
+            frameref.Reset();
+            insertSpan.End();
 	
             if (Detector::INSERTIMG_GET == faceret ||Detector::INSERTIMG_PROCESSED == faceret)     {  //aSync call, you must use the ret image
+                RecordDetectLatency(objects);
                 for(int k=0;k<objects.size();k++){
                     each_frame[objects[k].inputid]+=1;
                     total_frame[pInferConfig->nChannel]++;	
@@ -1385,6 +1817,127 @@ void dualpipe_buffer_init(void *buffer)
     vsource_frame_init(0, (vsource_frame_t *)buffer);
 }
 
+// Split the cores between the pipeline stages as -placement asks, -1 for an invalid value
+static int SetupPlacement()
+{
+    int weights[VaCpuTopology::ROLE_NUM] = {0};
+    if (FLAGS_placement == "off")
+    {
+        return 0;
+    }
+    if (FLAGS_placement == "auto")
+    {
+        weights[VaCpuTopology::ROLE_DECODE]     = 2;
+        weights[VaCpuTopology::ROLE_PREPROCESS] = 1;
+        // the CPU plugin runs its OpenMP team on the inference cores
+        weights[VaCpuTopology::ROLE_INFER]      = (FLAGS_d.find("CPU") != std::string::npos) ? 4 : 1;
+#ifdef TEST_KCF_TRACK_WITH_GPU
+        weights[VaCpuTopology::ROLE_TRACK]      = 2;
+#endif
+    }
+    else
+    {
+        char tail = 0;
+        if (sscanf(FLAGS_placement.c_str(), "%d:%d:%d:%d%c", &weights[0], &weights[1],
+                   &weights[2], &weights[3], &tail) != 4)
+        {
+            return -1;
+        }
+        for (int i = 0; i < VaCpuTopology::ROLE_NUM; i ++)
+        {
+            if (weights[i] < 0)
+            {
+                return -1;
+            }
+        }
+    }
+
+    if (gTopology.Load() != 0)
+    {
+        std::cout << " cpu topology is not available, threads are not placed" << std::endl;
+        return 0;
+    }
+    gTopology.Partition(weights);
+    gTopology.Print();
+    gPlacement = true;
+    return 0;
+}
+
+// NUMA node channel is decoded on, channels take turns over the decoding nodes
+static int ChannelNode(int channel)
+{
+    if (!gPlacement)
+    {
+        return 0;
+    }
+    std::vector<int> nodes = gTopology.GetNodes(VaCpuTopology::ROLE_DECODE);
+    return nodes[channel % nodes.size()];
+}
+
+// Decoding worker the first task of a channel goes to, one on the node of its
+// frames, -1 to leave it to the executor
+static int ChannelWorker(int channel)
+{
+    if (!gPlacement)
+    {
+        return -1;
+    }
+    const std::vector<int> &cpus = gTopology.GetCpus(VaCpuTopology::ROLE_DECODE);
+    int node = ChannelNode(channel);
+    std::vector<int> workers;
+    for (int i = 0; i < gExecutor.GetThreadCount(); i ++)
+    {
+        if (gTopology.GetCpuNode(cpus[i % cpus.size()]) == node)
+        {
+            workers.push_back(i);
+        }
+    }
+    if (workers.empty())
+    {
+        return -1;
+    }
+    int nodes = (int)gTopology.GetNodes(VaCpuTopology::ROLE_DECODE).size();
+    return workers[(channel / nodes) % workers.size()];
+}
+
+// Load a detector from a thread bound to the inference cores, the request and
+// OpenMP threads the plugin starts inherit that affinity
+static int LoadDetector(Detector &detector, std::string device, const std::string &model,
+                        const std::string &weights, int batch, int nireq)
+{
+    if (!gPlacement)
+    {
+        return detector.Load(device, model, weights, batch, nireq);
+    }
+    if (device.find("CPU") != std::string::npos)
+    {
+        // one OpenMP thread per inference core; IE's own binding would pin
+        // them to the first cores of the machine instead
+        detector.AddPluginConfig(PluginConfigParams::KEY_CPU_THREADS_NUM,
+                                 std::to_string(gTopology.GetCoreCount(VaCpuTopology::ROLE_INFER)));
+        detector.AddPluginConfig(PluginConfigParams::KEY_CPU_BIND_THREAD, PluginConfigParams::NO);
+    }
+    int ret = -1;
+    gTopology.RunBound(gTopology.GetCpus(VaCpuTopology::ROLE_INFER), [&]() {
+        ret = detector.Load(device, model, weights, batch, nireq);
+    });
+    return ret;
+}
+
+// Create a frame pipe with the backend selected by -pipe
+VaDualPipe *CreateDualPipe()
+{
+    if (FLAGS_pipe == "spsc")
+    {
+        return new VaRingPipe(VaRingPipe::RING_SPSC);
+    }
+    else if (FLAGS_pipe == "mpmc")
+    {
+        return new VaRingPipe(VaRingPipe::RING_MPMC);
+    }
+    return new VaDualPipe();
+}
+
 int main(int argc, char *argv[])
 {
     bool bret = false;
@@ -1392,6 +1945,7 @@ int main(int argc, char *argv[])
     float normalize_factor = 1.0;
     VaDualPipe *dpipe[NUM_OF_CHANNELS];
     VaDualPipe *dKCFpipe[NUM_OF_CHANNELS];
+    VaFrameArena *frameArena[NUM_OF_CHANNELS];
 
     std::vector<pthread_t>    vScheduleThreads;
     std::vector<pthread_t>    vInferThreads;
@@ -1429,6 +1983,163 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    if (FLAGS_pipe.compare("mutex") && FLAGS_pipe.compare("spsc") && FLAGS_pipe.compare("mpmc")) {
+        std::cout << " [error] Unknown frame pipe backend " << FLAGS_pipe << std::endl;
+        App_ShowUsage();
+        return 1;
+    }
+
+    if (FLAGS_overflow.compare("block") && FLAGS_overflow.compare("drop_oldest") && FLAGS_overflow.compare("drop_newest")) {
+        std::cout << " [error] Unknown overflow policy " << FLAGS_overflow << std::endl;
+        App_ShowUsage();
+        return 1;
+    }
+
+#ifdef TEST_KCF_TRACK_WITH_GPU
+    // the tracker waits for the result of every key frame, no frame may be dropped
+    if (FLAGS_overflow != "block") {
+        std::cout << " [error] -overflow " << FLAGS_overflow << " is not supported by this build, only block" << std::endl;
+        return 1;
+    }
+#endif
+
+    if (FLAGS_overflow == "drop_oldest" && FLAGS_pipe == "spsc") {
+        std::cout << " [error] drop_oldest recycles queued frames from the decoding thread, use -pipe mpmc or mutex" << std::endl;
+        return 1;
+    }
+
+    if (FLAGS_pipe_depth <= 0) {
+        std::cout << " [error] Invalid pipe depth " << FLAGS_pipe_depth << std::endl;
+        return 1;
+    }
+
+    if (FLAGS_zc) {
+#if defined(TEST_KCF_TRACK_WITH_GPU) || defined(ENABLE_WORKLOAD_BALANCE)
+        std::cout << " [error] -zc is not supported by this build" << std::endl;
+        return 1;
+#endif
+        if (FLAGS_show) {
+            std::cout << " [error] -zc keeps no copy of the frames to display, it can not be used with -show" << std::endl;
+            return 1;
+        }
+    }
+
+    if (FLAGS_nireq <= 0) {
+        std::cout << " [error] Invalid number of infer requests " << FLAGS_nireq << std::endl;
+        return 1;
+    }
+
+    if (FLAGS_pl_interval < 0) {
+        std::cout << " [error] Invalid latency report interval " << FLAGS_pl_interval << std::endl;
+        return 1;
+    }
+    if (VaRateGovernor::ParseMode(FLAGS_fps_mode) < 0) {
+        std::cout << " [error] Unknown -fps_mode " << FLAGS_fps_mode << std::endl;
+        return 1;
+    }
+    if (FLAGS_fps_burst < 1) {
+        std::cout << " [error] -fps_burst must be at least 1" << std::endl;
+        return 1;
+    }
+    if (FLAGS_kf_min < 1 || FLAGS_kf_max < FLAGS_kf_min) {
+        std::cout << " [error] -kf_min must be at least 1 and -kf_max at least -kf_min" << std::endl;
+        return 1;
+    }
+    if (KCFTracker::parseBackend(FLAGS_kcf_backend) < 0) {
+        std::cout << " [error] Unknown -kcf_backend " << FLAGS_kcf_backend << std::endl;
+        return 1;
+    }
+    if (VaKcfSampler::ParseFilter(FLAGS_kcf_sampler) < 0) {
+        std::cout << " [error] Unknown -kcf_sampler " << FLAGS_kcf_sampler << std::endl;
+        return 1;
+    }
+    if (FLAGS_kcf_train_interval < 1) {
+        std::cout << " [error] -kcf_train_interval must be at least 1" << std::endl;
+        return 1;
+    }
+    if (FLAGS_kcf_workers < -1) {
+        std::cout << " [error] -kcf_workers takes a thread count, 0 or -1" << std::endl;
+        return 1;
+    }
+    if (FLAGS_track_iou <= 0 || FLAGS_track_iou > 1) {
+        std::cout << " [error] -track_iou must be above 0 and at most 1" << std::endl;
+        return 1;
+    }
+    if (FLAGS_track_keep < 0) {
+        std::cout << " [error] -track_keep must be at least 0" << std::endl;
+        return 1;
+    }
+
+    if (!FLAGS_deadline.empty()) {
+        std::vector<int> budgets;
+        if (!VaDeadlineQueue::ParseBudgets(FLAGS_deadline, FLAGS_c, budgets)) {
+            std::cout << " [error] -deadline takes a latency budget in ms, or a comma separated list of them" << std::endl;
+            return 1;
+        }
+#if defined(ENABLE_WORKLOAD_BALANCE) || defined(TEST_KCF_TRACK_WITH_GPU)
+        // balancing bypasses the scheduler queue, and the KCF tracker waits for
+        // the result of every key frame so none may be skipped
+        std::cout << " [error] -deadline is not supported by this build" << std::endl;
+        return 1;
+#endif
+        if (FLAGS_zc) {
+            std::cout << " [error] -deadline schedules the frame pipes, it can not be used with -zc" << std::endl;
+            return 1;
+        }
+        gReadyQueue.Initialize(budgets);
+        gDeadline = true;
+    }
+
+    if (!FLAGS_qos.empty()) {
+        std::vector<int> classOf, weights;
+        if (!VaQosScheduler::ParseList(FLAGS_qos, FLAGS_c, classOf)) {
+            std::cout << " [error] -qos takes a comma separated list of channel classes" << std::endl;
+            return 1;
+        }
+        int nClasses = *std::max_element(classOf.begin(), classOf.end()) + 1;
+        if (!VaQosScheduler::ParseList(FLAGS_qos_weights, nClasses, weights) ||
+            *std::min_element(weights.begin(), weights.end()) < 1) {
+            std::cout << " [error] -qos_weights takes a comma separated list of class weights of at least 1" << std::endl;
+            return 1;
+        }
+        weights.resize(nClasses);
+#ifdef ENABLE_WORKLOAD_BALANCE
+        std::cout << " [error] -qos is not supported by this build" << std::endl;
+        return 1;
+#endif
+        if (FLAGS_zc || gDeadline) {
+            std::cout << " [error] -qos can not be used with -zc or -deadline" << std::endl;
+            return 1;
+        }
+        // twice what the infer requests hold may wait, beyond that the lowest class sheds.
+        // The KCF tracker waits for the result of every key frame, nothing is shed there
+        int nLimit = FLAGS_batch * FLAGS_nireq * 2;
+#ifdef TEST_KCF_TRACK_WITH_GPU
+        nLimit = 0;
+#endif
+        gQos.Initialize(classOf, weights, nLimit);
+        gQosEnabled = true;
+    }
+
+    if (FLAGS_pl)
+        gLatency.Initialize(FLAGS_c);
+
+    if (!FLAGS_trace.empty()) {
+        VaTracer::Enable(FLAGS_trace);
+        // kill -USR1 writes the trace so far, the run goes on
+        struct sigaction sigUsr1Handler;
+        sigUsr1Handler.sa_handler = sigusr1_handler;
+        sigemptyset(&sigUsr1Handler.sa_mask);
+        sigUsr1Handler.sa_flags = SA_RESTART;
+        sigaction(SIGUSR1, &sigUsr1Handler, NULL);
+    }
+
+    if (SetupPlacement() != 0) {
+        std::cout << " [error] Invalid thread placement " << FLAGS_placement << std::endl;
+        App_ShowUsage();
+        return 1;
+    }
+
     // prepare video input
     std::cout << std::endl;
 
@@ -1468,18 +2179,24 @@ int main(int argc, char *argv[])
         std::string binFileName = fileNameNoExt(FLAGS_m) + ".bin";
         if(nLoop==0){
             std::string device = FLAGS_d;
-            ret = gDetector[nLoop].Load(device, FLAGS_m, binFileName, FLAGS_batch);
+            gDetector[nLoop].EnableDynamicBatch(FLAGS_dyn_batch);
+            ret = LoadDetector(gDetector[nLoop], device, FLAGS_m, binFileName, FLAGS_batch, FLAGS_nireq);
             if(ret < 0){
                 std::cout << "Failed to initialize object detector model" << std::endl;
                 return 1;
             }
+            gDetector[nLoop].SetBatchTimeout(FLAGS_batch_timeout);
+#ifndef ENABLE_WORKLOAD_BALANCE
+            // completed requests wake up the scheduler to hand their results on
+            gDetector[nLoop].SetResultCallback([]() { sem_post(&gNewtaskAvaiable); });
+#endif
 #ifdef TEST_KCF_TRACK_WITH_GPU
             gDetector[nLoop].SetMode(false);
 #endif
         }else{
             std::string device = "CPU";
             //gDetector[nLoop].Load(device, FLAGS_m, binFileName, FLAGS_batch);
-            ret = gDetector[nLoop].Load(device, "../../test_content/IR/SSD_mobilenet/MobileNetSSD_deploy_32.xml", "../../test_content/IR/SSD_mobilenet/MobileNetSSD_deploy_32.bin",NUM_OF_CPU_BATCH);
+            ret = LoadDetector(gDetector[nLoop], device, "../../test_content/IR/SSD_mobilenet/MobileNetSSD_deploy_32.xml", "../../test_content/IR/SSD_mobilenet/MobileNetSSD_deploy_32.bin", NUM_OF_CPU_BATCH, 2);
 #ifdef TEST_KCF_TRACK_WITH_GPU            
             gDetector[nLoop].SetMode(false);
 #endif
@@ -1546,13 +2263,41 @@ int main(int argc, char *argv[])
         // Initialize dbuffer between decoding thread and inference thread.
         // 4 buffer for each dpipe buffer
         char szBuffer[256]={0};
+        // all frame buffers of the channel come from one region
+        size_t nFrameFootprint = VaDualPipe::BufferFootprint(sizeof(vsource_frame_t) + gNet_input_width*gNet_input_height*4);
+        size_t nArenaSize = FLAGS_pipe_depth * nFrameFootprint;
+#ifdef TEST_KCF_TRACK_WITH_GPU
+        nArenaSize += 20 * nFrameFootprint;
+#endif
+        frameArena[nLoop] = new VaFrameArena();
+        if (frameArena[nLoop]->Initialize(nArenaSize, FLAGS_hugepages) != 0) {
+            std::cout<<"create frame arena failed .\n"<<std::endl;
+            return 1;
+        }
         sprintf(szBuffer, "SharedInferBuf%d", nLoop);
-        dpipe[nLoop] = new VaDualPipe();
+        dpipe[nLoop] = CreateDualPipe();
         if( dpipe[nLoop] == NULL ) {
             std::cout<<"create dst-pipeline failed .\n"<<std::endl;
             return 1;
         }
-        dpipe[nLoop]->Initialize(100, sizeof(vsource_frame_t) + gNet_input_width*gNet_input_height*4, dualpipe_buffer_init);
+        dpipe[nLoop]->SetArena(frameArena[nLoop]);
+        // the buffers are touched first, and so placed, on the node the
+        // channel gets decoded on
+        int node = ChannelNode(nLoop);
+        if (gPlacement)
+            gTopology.RunOnNode(node, [&]() {
+                dpipe[nLoop]->Initialize(FLAGS_pipe_depth, sizeof(vsource_frame_t) + gNet_input_width*gNet_input_height*4, dualpipe_buffer_init);
+            });
+        else
+            dpipe[nLoop]->Initialize(FLAGS_pipe_depth, sizeof(vsource_frame_t) + gNet_input_width*gNet_input_height*4, dualpipe_buffer_init);
+#ifndef TEST_KCF_TRACK_WITH_GPU
+        // the tracker waits for the result of every key frame, so it can
+        // only run with the blocking policy
+        if (FLAGS_overflow == "drop_oldest")
+            dpipe[nLoop]->SetOverflowPolicy(VaDualPipe::OVERFLOW_DROP_OLDEST);
+        else if (FLAGS_overflow == "drop_newest")
+            dpipe[nLoop]->SetOverflowPolicy(VaDualPipe::OVERFLOW_DROP_NEWEST);
+#endif
 	
         vdpipe.push_back(dpipe[nLoop]);
 
@@ -1561,16 +2306,24 @@ int main(int argc, char *argv[])
         // 20 buffer for each dpipe buffer
         memset(szBuffer, 0, 256);
         sprintf(szBuffer, "SharedKCFBuf%d", nLoop);
-        dKCFpipe[nLoop] = new VaDualPipe();
+        dKCFpipe[nLoop] = CreateDualPipe();
         if( dKCFpipe[nLoop] == NULL ) {
             std::cout<<"create dst-pipeline failed .\n"<<std::endl;
             return 1;
         }
-        dKCFpipe[nLoop]->Initialize(20, sizeof(vsource_frame_t) + gNet_input_width*gNet_input_height*4, dualpipe_buffer_init);
+        dKCFpipe[nLoop]->SetArena(frameArena[nLoop]);
+        if (gPlacement)
+            gTopology.RunOnNode(node, [&]() {
+                dKCFpipe[nLoop]->Initialize(20, sizeof(vsource_frame_t) + gNet_input_width*gNet_input_height*4, dualpipe_buffer_init);
+            });
+        else
+            dKCFpipe[nLoop]->Initialize(20, sizeof(vsource_frame_t) + gNet_input_width*gNet_input_height*4, dualpipe_buffer_init);
       
 		//TODO: need to track it?
         //vdpipe.push_back(dpipe[nLoop]);
 #endif
+        sprintf(szBuffer, "channel(%d) frame arena", nLoop);
+        frameArena[nLoop]->Print(szBuffer);
     }
    
 
@@ -1605,6 +2358,28 @@ int main(int argc, char *argv[])
     std::cout << "channels of stream:"<<FLAGS_c << std::endl;
     std::cout << " FPS of each inference workload:"<<FLAGS_fps << std::endl; 
 
+    // channels multiplex onto a pool sized to the machine instead of a thread each
+    if (FLAGS_workers >= 0) {
+        int nWorkers = FLAGS_workers;
+        // worker i runs on the i-th decoding cpu
+        if (gPlacement && nWorkers == 0)
+            nWorkers = (int)gTopology.GetCpus(VaCpuTopology::ROLE_DECODE).size();
+        gExecutor.SetWorkerInit([](int index) {
+            if (gPlacement)
+                gTopology.BindThread(VaCpuTopology::ROLE_DECODE, index);
+            if (VaTracer::IsEnabled()) {
+                char name[32];
+                snprintf(name, sizeof(name), "decode worker %d", index);
+                VaTracer::SetThreadName(name);
+            }
+        });
+        if (gExecutor.Start(nWorkers) != 0) {
+            std::cout << "Failed to start the decoding workers" << std::endl;
+            return 1;
+        }
+        std::cout << " decoding workers:" << gExecutor.GetThreadCount() << std::endl;
+    }
+
     for(int nLoop=0; nLoop< FLAGS_c; nLoop++)
     {
         // =================================================================
@@ -1632,6 +2407,44 @@ int main(int argc, char *argv[])
             std::cout << "\t. Failed to initialize decode session" << std::endl;
             goto exit_here;
         }
+#ifdef TEST_KCF_TRACK_WITH_GPU
+        // the trackers get the GPU if the VA display of the first session has a CM device
+        if (nLoop == 0) {
+            if (KCFTracker::selectBackend((KCFTracker::Backend)KCFTracker::parseBackend(FLAGS_kcf_backend)) < 0) {
+                std::cout << "\t. No CM device or KCF kernels for -kcf_backend gpu" << std::endl;
+                goto exit_here;
+            }
+            std::cout << "\t. KCF tracking on the " << KCFTracker::backendName(KCFTracker::getBackend()) << std::endl;
+            if (KCFTracker::getBackend() == KCFTracker::BACKEND_CPU) {
+                VaKcfSampler::Filter filter = (VaKcfSampler::Filter)VaKcfSampler::ParseFilter(FLAGS_kcf_sampler);
+                KCFTracker::setSampler(filter);
+                std::cout << "\t. KCF search windows sampled " << VaKcfSampler::FilterName(filter) << std::endl;
+            }
+            KCFTracker::setTrainInterval(FLAGS_kcf_train_interval);
+            KCFTracker::setReuseFeatures(FLAGS_kcf_reuse_features);
+            // the GPU trackers share one CM device and queue, they stay on the channel thread
+            if (KCFTracker::getBackend() == KCFTracker::BACKEND_CPU && FLAGS_kcf_workers >= 0) {
+                int nWorkers = FLAGS_kcf_workers;
+                if (gPlacement && nWorkers == 0)
+                    nWorkers = (int)gTopology.GetCpus(VaCpuTopology::ROLE_TRACK).size();
+                gTrackExecutor.SetWorkerInit([](int index) {
+                    if (gPlacement)
+                        gTopology.BindThread(VaCpuTopology::ROLE_TRACK, index);
+                    if (VaTracer::IsEnabled()) {
+                        char name[32];
+                        snprintf(name, sizeof(name), "track worker %d", index);
+                        VaTracer::SetThreadName(name);
+                    }
+                });
+                if (gTrackExecutor.Start(nWorkers) != 0)
+                    std::cout << "\t. Failed to start the tracking workers, objects are tracked one after another" << std::endl;
+                else {
+                    std::cout << "\t. tracking workers:" << gTrackExecutor.GetThreadCount() << std::endl;
+                    KCFTracker::setExecutor(&gTrackExecutor);
+                }
+            }
+        }
+#endif
 
         MFXVideoDECODE *pmfxDEC = new MFXVideoDECODE(mfxSession[nLoop]);
         vpMFXDec.push_back(pmfxDEC);
@@ -1674,6 +2487,14 @@ int main(int argc, char *argv[])
         
         sts = pmfxDEC->DecodeHeader(&mfxBS[nLoop], &DecParams);
         MSDK_IGNORE_MFX_STS(sts, MFX_WRN_PARTIAL_ACCELERATION);
+
+        // streams without timing info are taken as 30 fps
+        double sourceFps = 30;
+        if (DecParams.mfx.FrameInfo.FrameRateExtN > 0 && DecParams.mfx.FrameInfo.FrameRateExtD > 0)
+            sourceFps = (double)DecParams.mfx.FrameInfo.FrameRateExtN / DecParams.mfx.FrameInfo.FrameRateExtD;
+        gGovernor[nLoop].Initialize((VaRateGovernor::Mode)VaRateGovernor::ParseMode(FLAGS_fps_mode),
+                                    FLAGS_fps, sourceFps, FLAGS_fps_burst);
+        gKeyframe[nLoop].Initialize(FLAGS_kf_min, FLAGS_kf_max);
         
         std::cout << "\t. Done preparing video parameters." << std::endl;
 
@@ -1973,6 +2794,7 @@ int main(int argc, char *argv[])
         pDecThreadConfig->pmfxSession            = &mfxSession[nLoop];
         pDecThreadConfig->pmfxAllocator          = &mfxAllocator[nLoop];
         pDecThreadConfig->nChannel               = nLoop;
+        pDecThreadConfig->nNode                  = ChannelNode(nLoop);
         pDecThreadConfig->nFPS                   = 1;//30/pDecThreadConfig->nFPS;
         pDecThreadConfig->bStartCount            = false;
         pDecThreadConfig->nFrameProcessed        = 0;
@@ -1983,9 +2805,17 @@ int main(int argc, char *argv[])
         vpDecThradConfig.push_back(pDecThreadConfig);
 
         pthread_t threadid;
-        pthread_create(&threadid, NULL, DecodeThreadFunc, (void *)(pDecThreadConfig));
-
-        vDecThreads.push_back(threadid) ; 
+        if (FLAGS_workers >= 0)
+        {
+            std::cout << std::endl <<">channel("<<nLoop<<") Initialized " << std::endl;
+            pDecThreadConfig->tmStart = std::chrono::high_resolution_clock::now();
+            gExecutor.Submit(std::bind(DecodeTask, pDecThreadConfig), ChannelWorker(nLoop));
+        }
+        else
+        {
+            pthread_create(&threadid, NULL, DecodeThreadFunc, (void *)(pDecThreadConfig));
+            vDecThreads.push_back(threadid) ; 
+        }
 #ifdef TEST_KCF_TRACK_WITH_GPU
         //Create a KCF Tracking Thread for each channel 
         TrackerThreadConfig *pTrackerThreadConfig = new TrackerThreadConfig();
@@ -2002,6 +2832,7 @@ int main(int argc, char *argv[])
         pTrackerThreadConfig->pmfxSession            = &mfxSession[nLoop];
         pTrackerThreadConfig->pmfxAllocator          = &mfxAllocator[nLoop];
         pTrackerThreadConfig->nChannel               = nLoop;
+        pTrackerThreadConfig->nNode                  = ChannelNode(nLoop);
         pTrackerThreadConfig->dpipe                  = dKCFpipe[nLoop];
         pTrackerThreadConfig->width                   = DecParams.mfx.FrameInfo.CropW;
         pTrackerThreadConfig->height                  = DecParams.mfx.FrameInfo.CropH;
@@ -2094,12 +2925,41 @@ int main(int argc, char *argv[])
     for (auto& th : vDecThreads) {
         pthread_join(th,NULL);
     }
+    if (FLAGS_workers >= 0) {
+        gExecutor.Shutdown();
+    }
  
     std::cout<<" All thread is termined " <<std::endl;
+    gLatency.Report(false);
+    VaTracer::Dump();
     // Report performance counts
     {
+        if (gDeadline)
+            gReadyQueue.Print();
+        if (gQosEnabled)
+            gQos.Print();
        //TODO: add summary
-
+        for (auto& pDecThrConf : vpDecThradConfig) {
+            unsigned long nDropped = pDecThrConf->dpipe->GetDroppedFrames();
+            if (nDropped > 0)
+                std::cout << "channel(" << pDecThrConf->nChannel << ") dropped " << nDropped << " frames in total" << std::endl;
+            VaRateGovernor &governor = gGovernor[pDecThrConf->nChannel];
+#ifndef TEST_KCF_TRACK_WITH_GPU
+            if (governor.GetSkipped() > 0)
+                std::cout << "channel(" << pDecThrConf->nChannel << ") kept " << governor.GetAdmitted()
+                          << " frames, skipped " << governor.GetSkipped() << " over -fps " << FLAGS_fps << std::endl;
+#else
+            VaKeyframePolicy &keyframe = gKeyframe[pDecThrConf->nChannel];
+            std::cout << "channel(" << pDecThrConf->nChannel << ") detected " << keyframe.GetKeyFrames() << " of "
+                      << keyframe.GetFrames() << " frames, detection interval at exit " << keyframe.GetInterval() << std::endl;
+            if (keyframe.GetPostponed() > 0)
+                std::cout << "channel(" << pDecThrConf->nChannel << ") postponed " << keyframe.GetPostponed()
+                          << " key frames over -fps " << FLAGS_fps << std::endl;
+            VaTrackManager &tracks = gTracks[pDecThrConf->nChannel];
+            std::cout << "channel(" << pDecThrConf->nChannel << ") started " << tracks.GetStarted() << " tracks, kept "
+                      << tracks.GetMatched() << " over a key frame, retired " << tracks.GetRetired() << std::endl;
+#endif
+        }
     }
 
 exit_here:
@@ -2150,14 +3010,43 @@ void App_ShowUsage()
     std::cout << "\t\t-l <path>    " << labels_message << std::endl;
     std::cout << "\t\t-d <device>  " << target_device_message << std::endl;
     std::cout << "\t\t-c <steams>  " << channels_message << std::endl;
+    std::cout << "\t\t-fps <val>   " << fps_message << std::endl;
+    std::cout << "\t\t-fps_mode <val> " << fps_mode_message << std::endl;
+    std::cout << "\t\t-fps_burst <val> " << fps_burst_message << std::endl;
+    std::cout << "\t\t-fps_track   " << fps_track_message << std::endl;
+    std::cout << "\t\t-kf_min <val> " << kf_min_message << std::endl;
+    std::cout << "\t\t-kf_max <val> " << kf_max_message << std::endl;
+    std::cout << "\t\t-kcf_backend <val> " << kcf_backend_message << std::endl;
+    std::cout << "\t\t-kcf_sampler <val> " << kcf_sampler_message << std::endl;
+    std::cout << "\t\t-kcf_train_interval <val> " << kcf_train_interval_message << std::endl;
+    std::cout << "\t\t-kcf_reuse_features " << kcf_reuse_features_message << std::endl;
+    std::cout << "\t\t-kcf_workers <val> " << kcf_workers_message << std::endl;
+    std::cout << "\t\t-kcf_multiscale " << kcf_multiscale_message << std::endl;
+    std::cout << "\t\t-track_iou <val> " << track_iou_message << std::endl;
+    std::cout << "\t\t-track_keep <val> " << track_keep_message << std::endl;
+    std::cout << "\t\t-deadline <ms> " << deadline_message << std::endl;
+    std::cout << "\t\t-qos <list>  " << qos_message << std::endl;
+    std::cout << "\t\t-qos_weights <list> " << qos_weights_message << std::endl;
     std::cout << "\t\t-show        " << show_message << std::endl;
     std::cout << "\t\t-batch <val> " << batch_message << std::endl;
+    std::cout << "\t\t-batch_timeout <ms> " << batch_timeout_message << std::endl;
+    std::cout << "\t\t-dyn_batch   " << dyn_batch_message << std::endl;
+    std::cout << "\t\t-nireq <val> " << nireq_message << std::endl;
     std::cout << "\t\t-dec_postproc <val>     " << dec_postproc_message << std::endl;
     std::cout << "\t\t-pi     " << performance_inference_message<< std::endl;
     std::cout << "\t\t-pd     " << performance_decode_message << std::endl;
     std::cout << "\t\t-pl     " << pipeline_latency_message << std::endl;
+    std::cout << "\t\t-pl_interval <sec> " << pipeline_latency_interval_message << std::endl;
+    std::cout << "\t\t-trace <path> " << trace_message << std::endl;
     std::cout << "\t\t-pv     " << perf_details_message << std::endl;
     std::cout << "\t\t-infer  <val>    " << inference_message << std::endl;
+    std::cout << "\t\t-pipe <val>   " << pipe_message << std::endl;
+    std::cout << "\t\t-overflow <val>   " << overflow_message << std::endl;
+    std::cout << "\t\t-pipe_depth <val> " << pipe_depth_message << std::endl;
+    std::cout << "\t\t-zc          " << zc_message << std::endl;
+    std::cout << "\t\t-workers <val> " << workers_message << std::endl;
+    std::cout << "\t\t-placement <val> " << placement_message << std::endl;
+    std::cout << "\t\t-hugepages   " << hugepages_message << std::endl;
   
 }
 
@@ -2248,15 +3137,9 @@ mfxStatus WriteRawFrameToMemory(mfxFrameSurface1* pSurface, int dest_w, int dest
         h = pInfo->CropH / 2;
         w = pInfo->CropW;
 
+        // the UV plane stays interleaved, dest is NV12 like the surface
         for (i = 0; i < h; i++)
-            for (j = 0; j < w; j += 2)
-                memcpy(dest+ipos++, pData->UV + (pInfo->CropY * pData->Pitch / 2 + pInfo->CropX) + i * pData->Pitch + j, 1);
-
-        for (i = 0; i < h; i++)
-            for (j = 1; j < w; j += 2)
-                memcpy(dest+ipos++, pData->UV + (pInfo->CropY * pData->Pitch / 2 + pInfo->CropX)+ i * pData->Pitch + j, 1);
-
-
+            memcpy(dest + ipos + i * w, pData->UV + (pInfo->CropY * pData->Pitch / 2 + pInfo->CropX) + i * pData->Pitch, w);
     }
 
     return sts;
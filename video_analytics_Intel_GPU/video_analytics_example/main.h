@@ -71,17 +71,59 @@ static const char performance_inference_message[] = "Enables inference performan
 /// @brief message for performance decode
 static const char performance_decode_message[] = "Enables decode performance report";
 /// @brief message for performance decode
-static const char pipeline_latency_message[] = "Enables pipeline latency report";
+static const char pipeline_latency_message[] = "Enables per-stage latency histograms (decode, copy, queue wait, batch wait, inference, post-process, track, display), reported every -pl_interval seconds and at exit";
+/// @brief message for span tracing
+static const char trace_message[] = "Record decode, copy, schedule, inference and tracking spans of every thread and write them as Chrome trace JSON to this file at exit and on SIGUSR1. Default - disabled";
+/// @brief message for latency report interval
+static const char pipeline_latency_interval_message[] = "Seconds between two latency reports of -pl, 0 - only at exit. Default - 10";
 /// @brief message for performance counters
 static const char threshold_message[] = "confidence threshold for bounding boxes 0-1";
 /// @brief message for batch size
 static const char batch_message[] = "Batch size";
+/// @brief message for batch deadline
+static const char batch_timeout_message[] = "Submit a partial batch when its oldest frame waited this long (ms), 0 - wait for a full batch. Default - 10";
+/// @brief message for dynamic batch
+static const char dyn_batch_message[] = "Run partial batches with IE dynamic batch instead of padding them. Default - disable";
+/// @brief message for infer request pool
+static const char nireq_message[] = "Number of infer requests in flight. Default - 4";
 /// @brief message for frames count
 static const char frames_message[] = "Number of frames from stream to process";
 /// @brief message for channels of streams
 static const char channels_message[] = "Number of channels of streams to process";
 /// @brief message for frame rate of inference
-static const char fps_message[] = "Number of frame rates of inference for each stream";
+static const char fps_message[] = "Number of frame rates of inference for each stream, frames above it are not inferred, 0 infers all. Default - 30";
+/// @brief message for inference rate governor mode
+static const char fps_mode_message[] = "How frames are picked for -fps: uniform (every n-th frame by the stream frame rate), bucket (token bucket on the wall clock, see -fps_burst). Default - uniform";
+/// @brief message for token bucket burst
+static const char fps_burst_message[] = "Frames -fps_mode bucket lets through back to back. Default - 4";
+/// @brief message for tracking skipped frames
+static const char fps_track_message[] = "Hand frames skipped by -fps to the KCF tracker only instead of dropping them. Default - enable";
+/// @brief message for shortest detection interval
+static const char kf_min_message[] = "KCF tracking build: fewest frames from one detection to the next, used while tracking is unsure. Default - 2";
+/// @brief message for longest detection interval
+static const char kf_max_message[] = "KCF tracking build: most frames from one detection to the next, reached on quiet scenes. -kf_min 6 -kf_max 6 detects every 6th frame. Default - 24";
+/// @brief message for KCF backend
+static const char kcf_backend_message[] = "KCF tracking build: where the trackers run, auto, gpu or cpu. auto takes the GPU when a CM device and the kernels are found. Default - auto";
+/// @brief message for KCF CPU sampler
+static const char kcf_sampler_message[] = "KCF tracking build, CPU backend: filter the search window is cropped and scaled out of the NV12 frame with, bilinear or avs. avs takes the coefficients of the GPU sampler, for features closer to the GPU backend. Default - bilinear";
+/// @brief message for KCF training interval
+static const char kcf_train_interval_message[] = "KCF tracking build: most frames between two model updates of a tracker whose correlation peak is high and steady, the update blends the frames skipped at once. 1 - update every frame. Default - 1";
+/// @brief message for KCF feature reuse
+static const char kcf_reuse_features_message[] = "KCF tracking build: a model update takes the features of the detection instead of extracting them again when the target moved less than a cell, whatever -kcf_train_interval. Default - enable";
+/// @brief message for KCF tracking workers
+static const char kcf_workers_message[] = "KCF tracking build, CPU backend: threads of a pool shared by all channels that track the objects of a frame in parallel, 0 - one per online cpu (per tracking cpu with -placement), -1 - track them one after another on the channel thread. Default - 0";
+/// @brief message for KCF multi-scale search
+static const char kcf_multiscale_message[] = "KCF tracking build: search every tracker at a smaller and a bigger scale too, so the boxes follow objects coming closer or going away. The CPU backend searches the three scales in parallel on the -kcf_workers pool. Default - disable";
+/// @brief message for track association overlap
+static const char track_iou_message[] = "KCF tracking build: overlap from which a detection of a key frame continues a tracked object of its class, which keeps its id and trained model. Boxes of about the same size whose centres are close continue it too. Default - 0.3";
+/// @brief message for tracks missed by the detection
+static const char track_keep_message[] = "KCF tracking build: key frames a tracked object lives on without a detection, 0 - drop it on the first key frame that misses it. Default - 0";
+/// @brief message for deadline scheduling
+static const char deadline_message[] = "Latency budget in ms from decoding to the inference result, one for all channels or a comma separated list per channel. Frames are inferred earliest deadline first and frames that would miss it are skipped. Default - disabled";
+/// @brief message for priority classes
+static const char qos_message[] = "Priority class of every channel, 0 the highest, as a comma separated list whose last entry repeats, e.g. 0,0,1,2. Inference slots are shared by class weight, under overload the lowest class sheds frames first. Default - disabled";
+/// @brief message for priority class weights
+static const char qos_weights_message[] = "Weight of every -qos class in inference slots and tracker cpu time, the last entry repeats. Default - 4,2,1";
 /// @brief message for show result
 static const char show_message[] = "Show inference result in display GRID, maxium is 5 for now";
 /// @brief message for show result
@@ -92,6 +134,20 @@ static const char decode_message[] = "enable decode (true/false). Default - enab
 static const char inference_message[] = "enable inference (1/0). Default - enable";
 /// @brief message for performance details
 static const char perf_details_message[] = "enable performance details. Default - disable";
+/// @brief message for frame pipe backend
+static const char pipe_message[] = "Frame pipe backend (mutex, spsc, mpmc). spsc makes only the decode to scheduler ring single producer single consumer. Default - mpmc";
+/// @brief message for frame pipe overflow policy
+static const char overflow_message[] = "What decoding does when inference falls behind (block, drop_oldest, drop_newest). The KCF tracking build only supports block. Default - block";
+/// @brief message for frame pipe depth
+static const char pipe_depth_message[] = "Number of frame buffers between decoding and inference for each stream. Default - 100";
+/// @brief message for zero-copy ingest
+static const char zc_message[] = "Decoding writes frames straight into the inference input blob, bypassing the frame pipes. Not with -show. Default - disable";
+/// @brief message for decoding workers
+static const char workers_message[] = "Decode the channels as tasks of a work-stealing pool with this many threads, 0 - one per online cpu (per decoding cpu with -placement), -1 - a thread per channel. Default - 0";
+/// @brief message for thread placement
+static const char placement_message[] = "Pin decoding, preprocessing, inference and tracking to their own cores (auto, off, or core weights d:p:i:t like 2:1:4:0). Only the cpus the process may run on are used. Default - off";
+/// @brief message for huge page frame buffers
+static const char hugepages_message[] = "Back the frame buffers of each stream with 2 MB huge pages (hugetlb, else transparent huge pages). Default - enable";
 
 
 /// @brief message for verbose
@@ -126,12 +182,50 @@ DEFINE_bool(pc, false, performance_counter_message);
 DEFINE_double(thresh, .8, threshold_message);
 /// \brief Batch size
 DEFINE_int32(batch, 1, batch_message);
+/// \brief Deadline of a partial batch
+DEFINE_int32(batch_timeout, 10, batch_timeout_message);
+/// \brief Dynamic batch for partial batches
+DEFINE_bool(dyn_batch, false, dyn_batch_message);
+/// \brief Infer request pool size
+DEFINE_int32(nireq, 4, nireq_message);
 /// \brief Frames count
 DEFINE_int32(fr, 256, frames_message);
 /// \brief Channels of streams
 DEFINE_int32(c, 1, channels_message);
 /// \brief Frame rate of inference for each stream
 DEFINE_int32(fps, 30, fps_message);
+/// \brief Inference rate governor mode
+DEFINE_string(fps_mode, "uniform", fps_mode_message);
+/// \brief Token bucket burst
+DEFINE_int32(fps_burst, 4, fps_burst_message);
+/// \brief Track frames skipped by the rate governor
+DEFINE_bool(fps_track, true, fps_track_message);
+/// \brief Shortest detection interval
+DEFINE_int32(kf_min, 2, kf_min_message);
+/// \brief Longest detection interval
+DEFINE_int32(kf_max, 24, kf_max_message);
+/// \brief KCF tracker backend
+DEFINE_string(kcf_backend, "auto", kcf_backend_message);
+/// \brief Search window filter of the CPU trackers
+DEFINE_string(kcf_sampler, "bilinear", kcf_sampler_message);
+/// \brief Frames between model updates of locked targets
+DEFINE_int32(kcf_train_interval, 1, kcf_train_interval_message);
+/// \brief Model updates on the features of the detection
+DEFINE_bool(kcf_reuse_features, true, kcf_reuse_features_message);
+/// \brief Threads tracking objects in parallel
+DEFINE_int32(kcf_workers, 0, kcf_workers_message);
+/// \brief Multi-scale search of the trackers
+DEFINE_bool(kcf_multiscale, false, kcf_multiscale_message);
+/// \brief Overlap matching a detection with a track
+DEFINE_double(track_iou, 0.3, track_iou_message);
+/// \brief Key frames a track survives without a detection
+DEFINE_int32(track_keep, 0, track_keep_message);
+/// \brief Per-channel latency budget
+DEFINE_string(deadline, "", deadline_message);
+/// \brief Priority class of every channel
+DEFINE_string(qos, "", qos_message);
+/// \brief Weights of the priority classes
+DEFINE_string(qos_weights, "4,2,1", qos_weights_message);
 /// \brief Show final result
 DEFINE_bool(show, false, show_message);
 /// \brief Enable inference performance
@@ -140,10 +234,28 @@ DEFINE_bool(pi, false, performance_inference_message);
 DEFINE_bool(pd, false, performance_decode_message);
 /// \brief Enable pipeline latency report
 DEFINE_bool(pl, false, pipeline_latency_message);
+/// \brief Latency report interval
+DEFINE_int32(pl_interval, 10, pipeline_latency_interval_message);
+/// \brief Span tracing
+DEFINE_string(trace, "", trace_message);
 /// \brief Enable inference
 DEFINE_int32(infer, 1, inference_message);
 /// \brief Enable inference perf details
 DEFINE_bool(pv, false, perf_details_message);
+/// \brief Frame pipe backend
+DEFINE_string(pipe, "mpmc", pipe_message);
+/// \brief Frame pipe overflow policy
+DEFINE_string(overflow, "block", overflow_message);
+/// \brief Frame pipe depth
+DEFINE_int32(pipe_depth, 100, pipe_depth_message);
+/// \brief Zero-copy ingest
+DEFINE_bool(zc, false, zc_message);
+/// \brief Decoding worker threads
+DEFINE_int32(workers, 0, workers_message);
+/// \brief Thread placement
+DEFINE_string(placement, "off", placement_message);
+/// \brief Huge page frame buffers
+DEFINE_bool(hugepages, true, hugepages_message);
 
 
 /// \brief Verbose
@@ -171,7 +283,9 @@ typedef struct vsource_frame_s {
 	bool bROIRrefresh;
     int linesize[VIDEO_SOURCE_MAX_STRIDE];
 
-    struct timeval timestamp;
+    std::chrono::steady_clock::time_point timestamp; // decoding of the frame started, with -pl
+    std::chrono::steady_clock::time_point storeTs;   // handed to the pipe
+    std::chrono::steady_clock::duration copyTime;    // spent copying it out of the VPP surface
     int maxstride;
     int imgbufsize;
     cv::Mat       cvImg;
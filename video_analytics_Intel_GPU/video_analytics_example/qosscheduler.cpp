@@ -0,0 +1,192 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+
+/*
+// brief Priority classes of streams
+*/
+
+#include "qosscheduler.h"
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+// CFS gives a thread about 1.25 times the cpu of one a nice level above it
+#define QOS_NICE_STEP 1.25
+#define QOS_NICE_MAX  19
+
+VaQosScheduler::VaQosScheduler():
+    m_counters(NULL),
+    m_current(0),
+    m_queued(0),
+    m_limit(0)
+{
+}
+
+VaQosScheduler::~VaQosScheduler()
+{
+    delete [] m_counters;
+}
+
+bool VaQosScheduler::ParseList(const std::string &list, int count, std::vector<int> &values)
+{
+    values.clear();
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        char *end = NULL;
+        long value = strtol(item.c_str(), &end, 10);
+        if (item.empty() || *end != '\0' || value < 0)
+        {
+            return false;
+        }
+        values.push_back((int)value);
+    }
+    if (values.empty())
+    {
+        return false;
+    }
+    values.resize(std::max(count, (int)values.size()), values.back());
+    return true;
+}
+
+void VaQosScheduler::Initialize(const std::vector<int> &classOf, const std::vector<int> &weights, int limit)
+{
+    m_classOf = classOf;
+    m_weights = weights;
+    int nclasses = (int)weights.size();
+    m_queues.assign(nclasses, std::deque<Item>());
+    m_deficit.assign(nclasses, 0);
+    delete [] m_counters;
+    m_counters = new Counters[nclasses];
+    for (int i = 0; i < nclasses; i ++)
+    {
+        m_counters[i].served.store(0, std::memory_order_relaxed);
+        m_counters[i].shed.store(0, std::memory_order_relaxed);
+    }
+    m_current = 0;
+    m_queued = 0;
+    m_limit = limit;
+    m_start = Clock::now();
+}
+
+void VaQosScheduler::Increment(std::atomic<uint64_t> &counter)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void VaQosScheduler::Push(int channel, VaFrameHandle &&frame)
+{
+    Item item;
+    item.channel = channel;
+    item.frame = std::move(frame);
+    m_queues[m_classOf[channel]].push_back(std::move(item));
+    m_queued ++;
+    if (m_limit > 0 && m_queued > m_limit)
+    {
+        Shed();
+    }
+}
+
+void VaQosScheduler::Shed()
+{
+    for (int cls = (int)m_queues.size() - 1; cls >= 0; cls --)
+    {
+        if (!m_queues[cls].empty())
+        {
+            // dropping the handle releases the frame back to its pipe
+            m_queues[cls].pop_front();
+            m_queued --;
+            Increment(m_counters[cls].shed);
+            return;
+        }
+    }
+}
+
+bool VaQosScheduler::Pop(VaFrameHandle &frame, int &channel)
+{
+    if (m_queued == 0)
+    {
+        return false;
+    }
+    int nclasses = (int)m_queues.size();
+    for (;;)
+    {
+        std::deque<Item> &queue = m_queues[m_current];
+        if (queue.empty())
+        {
+            // an idle class does not save up slots
+            m_deficit[m_current] = 0;
+        }
+        else if (m_deficit[m_current] > 0)
+        {
+            m_deficit[m_current] --;
+            channel = queue.front().channel;
+            frame = std::move(queue.front().frame);
+            queue.pop_front();
+            m_queued --;
+            Increment(m_counters[m_current].served);
+            return true;
+        }
+        m_current = (m_current + 1) % nclasses;
+        if (!m_queues[m_current].empty())
+        {
+            m_deficit[m_current] += m_weights[m_current];
+        }
+    }
+}
+
+uint64_t VaQosScheduler::GetServed(int cls) const
+{
+    return m_counters[cls].served.load(std::memory_order_relaxed);
+}
+
+uint64_t VaQosScheduler::GetShed(int cls) const
+{
+    return m_counters[cls].shed.load(std::memory_order_relaxed);
+}
+
+int VaQosScheduler::GetNice(int cls) const
+{
+    int heaviest = *std::max_element(m_weights.begin(), m_weights.end());
+    double steps = log((double)heaviest / m_weights[cls]) / log(QOS_NICE_STEP);
+    return std::min((int)(steps + 0.5), QOS_NICE_MAX);
+}
+
+int VaQosScheduler::SetThreadNice(int cls) const
+{
+    // on Linux the nice level is per thread, PRIO_PROCESS with a tid sets just that one
+    return setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), GetNice(cls));
+}
+
+void VaQosScheduler::Print() const
+{
+    double seconds = std::chrono::duration<double>(Clock::now() - m_start).count();
+    std::cout << " priority classes:" << std::endl;
+    for (int cls = 0; cls < GetClassCount(); cls ++)
+    {
+        int channels = (int)std::count(m_classOf.begin(), m_classOf.end(), cls);
+        std::cout << "   class " << cls << " weight " << m_weights[cls] << ", " << channels << " channels: inferred "
+                  << GetServed(cls) << " frames (" << (seconds > 0 ? GetServed(cls) / seconds : 0)
+                  << " f/s), shed " << GetShed(cls) << std::endl;
+    }
+}
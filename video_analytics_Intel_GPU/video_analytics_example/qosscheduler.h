@@ -0,0 +1,93 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+
+/*
+// brief Priority classes of streams
+*/
+
+#ifndef _QOSSCHEDULER_H_
+#define _QOSSCHEDULER_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+#include "dualpipe.h"
+
+// Ready queue of the scheduler with a FIFO per priority class, class 0 being
+// the most important. Frames leave by deficit round robin, so every class
+// with frames waiting gets inference slots in proportion to its weight and
+// a busy class can not starve the others. Once more frames are queued than
+// the limit, the oldest frame of the least important class is shed first.
+// Meant for one thread, only the counters may be read from others.
+class VaQosScheduler
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    VaQosScheduler();
+    ~VaQosScheduler();
+    // classOf has the class of every channel, weights one entry per class.
+    // limit is the most frames queued at once, 0 never sheds
+    void Initialize(const std::vector<int> &classOf, const std::vector<int> &weights, int limit);
+    void Push(int channel, VaFrameHandle &&frame);
+    // Next frame by weighted round robin, false if nothing is queued
+    bool Pop(VaFrameHandle &frame, int &channel);
+
+    int GetClassCount() const { return (int)m_weights.size(); }
+    int GetClass(int channel) const { return m_classOf[channel]; }
+    uint64_t GetServed(int cls) const;
+    uint64_t GetShed(int cls) const;
+    // Nice level for threads working for a class, so that CFS shares the cpu
+    // between the classes by about their weights
+    int GetNice(int cls) const;
+    // Set the nice level of the calling thread for a class
+    int SetThreadNice(int cls) const;
+    void Print() const;
+
+    // "0,1,1,2": one class per channel, the last one repeats
+    static bool ParseList(const std::string &list, int count, std::vector<int> &values);
+
+protected:
+    struct Item
+    {
+        int channel;
+        VaFrameHandle frame;
+    };
+    struct Counters
+    {
+        std::atomic<uint64_t> served;
+        std::atomic<uint64_t> shed;
+    };
+
+    void Shed();
+    static void Increment(std::atomic<uint64_t> &counter);
+
+    std::vector<int> m_classOf;
+    std::vector<int> m_weights;
+    std::vector<std::deque<Item> > m_queues;
+    std::vector<int> m_deficit;
+    Counters *m_counters;
+    int m_current;
+    int m_queued;
+    int m_limit;
+    Clock::time_point m_start;
+};
+
+#endif
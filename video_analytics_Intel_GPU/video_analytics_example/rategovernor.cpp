@@ -0,0 +1,134 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+
+/*
+// brief Per-stream inference rate governor
+*/
+
+#include "rategovernor.h"
+#include <algorithm>
+
+VaRateGovernor::VaRateGovernor():
+    m_mode(RATE_OFF),
+    m_rate(0),
+    m_step(1.0),
+    m_credit(1.0),
+    m_burst(1.0),
+    m_tokens(1.0),
+    m_available(true),
+    m_admitted(0),
+    m_skipped(0)
+{
+}
+
+int VaRateGovernor::ParseMode(const std::string &name)
+{
+    if (name == "uniform")
+    {
+        return RATE_UNIFORM;
+    }
+    if (name == "bucket")
+    {
+        return RATE_TOKEN_BUCKET;
+    }
+    return -1;
+}
+
+void VaRateGovernor::Initialize(Mode mode, double rate, double sourceRate, int burst)
+{
+    m_mode = mode;
+    m_rate = rate;
+    if (rate <= 0)
+    {
+        m_mode = RATE_OFF;
+    }
+
+    m_step = 1.0;
+    if (m_mode == RATE_UNIFORM)
+    {
+        if (sourceRate <= 0 || rate >= sourceRate)
+        {
+            m_mode = RATE_OFF;
+        }
+        else
+        {
+            m_step = rate / sourceRate;
+        }
+    }
+    // the first frame of a stream is always inferred
+    m_credit = 1.0;
+
+    m_burst = std::max(burst, 1);
+    m_tokens = m_burst;
+    m_last = Clock::now();
+
+    m_admitted.store(0, std::memory_order_relaxed);
+    m_skipped.store(0, std::memory_order_relaxed);
+}
+
+bool VaRateGovernor::Admit()
+{
+    bool admit = Available();
+    Commit(admit);
+    return admit;
+}
+
+bool VaRateGovernor::Available()
+{
+    m_available = true;
+    if (m_mode == RATE_UNIFORM)
+    {
+        // the sum of n steps may come out a hair below n
+        m_available = (m_credit >= 1.0 - 1e-9);
+    }
+    else if (m_mode == RATE_TOKEN_BUCKET)
+    {
+        Clock::time_point now = Clock::now();
+        double elapsed = std::chrono::duration<double>(now - m_last).count();
+        m_last = now;
+        m_tokens = std::min(m_burst, m_tokens + elapsed * m_rate);
+        m_available = (m_tokens >= 1.0);
+    }
+    return m_available;
+}
+
+void VaRateGovernor::Commit(bool inferred)
+{
+    inferred = inferred && m_available;
+    if (m_mode == RATE_UNIFORM)
+    {
+        if (inferred)
+        {
+            m_credit -= 1.0;
+        }
+        // credit not spent is kept for one frame, so the frames inferred stay
+        // evenly spaced instead of bunching up after a long pause
+        m_credit = std::min(m_credit + m_step, 1.0 + m_step);
+    }
+    else if (m_mode == RATE_TOKEN_BUCKET && inferred)
+    {
+        m_tokens -= 1.0;
+    }
+
+    // only the decoding thread writes, the reporter just reads. Frames the
+    // caller passed on by itself are neither kept nor skipped
+    if (inferred || !m_available)
+    {
+        std::atomic<uint64_t> &count = inferred ? m_admitted : m_skipped;
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+}
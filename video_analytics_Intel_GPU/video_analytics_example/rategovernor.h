@@ -0,0 +1,85 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+
+/*
+// brief Per-stream inference rate governor
+*/
+
+#ifndef _RATEGOVERNOR_H_
+#define _RATEGOVERNOR_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+// Decides for every decoded frame of a stream whether it goes to inference,
+// so that a stream is inferred at no more than the requested rate.
+//  - uniform: keeps every n-th frame of the stream by its own frame rate, so
+//    the inferred frames are evenly spaced in stream time however fast the
+//    stream is decoded
+//  - bucket: a token bucket refilled at the requested rate in wall clock time
+//    that lets up to burst frames through back to back, e.g. after a stall
+// Admit() is called by whoever decodes the stream, one thread at a time. A
+// caller that may still decide against inferring a frame the governor would
+// let through, like the KCF key frame policy, asks Available() and reports
+// with Commit() instead, so that only the frames inferred are charged.
+class VaRateGovernor
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    enum Mode
+    {
+        RATE_OFF          = 0,
+        RATE_UNIFORM      = 1,
+        RATE_TOKEN_BUCKET = 2
+    };
+
+    VaRateGovernor();
+    // rate <= 0 admits every frame, so does a uniform rate at or above sourceRate
+    void Initialize(Mode mode, double rate, double sourceRate, int burst);
+    // true if the next frame of the stream is to be inferred
+    bool Admit();
+    // true if the next frame of the stream may be inferred, charges nothing
+    bool Available();
+    // once per frame after Available(): inferred takes the frame off the rate
+    void Commit(bool inferred);
+
+    uint64_t GetAdmitted() const { return m_admitted.load(std::memory_order_relaxed); }
+    uint64_t GetSkipped() const { return m_skipped.load(std::memory_order_relaxed); }
+
+    // "uniform" or "bucket", -1 for anything else
+    static int ParseMode(const std::string &name);
+
+protected:
+    Mode m_mode;
+    double m_rate;
+    // uniform: frames to infer per decoded frame, and how far the next one is
+    double m_step;
+    double m_credit;
+    // bucket
+    double m_burst;
+    double m_tokens;
+    Clock::time_point m_last;
+    bool m_available;
+
+    std::atomic<uint64_t> m_admitted;
+    std::atomic<uint64_t> m_skipped;
+};
+
+#endif
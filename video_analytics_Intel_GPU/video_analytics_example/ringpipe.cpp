@@ -0,0 +1,339 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+/*
+// brief Lock-free ring buffer backend of VaDualPipe
+*/
+
+#include "ringpipe.h"
+#include <malloc.h>
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+// number of polls before a blocked caller goes to sleep in the kernel
+#define RING_SPIN_COUNT 64
+
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+VaFutexEvent::VaFutexEvent():
+    m_seq(0),
+    m_waiters(0)
+{
+}
+
+int VaFutexEvent::Prepare()
+{
+    m_waiters.fetch_add(1, std::memory_order_seq_cst);
+    return m_seq.load(std::memory_order_seq_cst);
+}
+
+void VaFutexEvent::Cancel()
+{
+    m_waiters.fetch_sub(1, std::memory_order_relaxed);
+}
+
+bool VaFutexEvent::Wait(int key, const timespec *abstime)
+{
+    // FUTEX_WAIT_BITSET takes an absolute timeout, CLOCK_REALTIME matches
+    // what pthread_cond_timedwait() used for VaDualPipe::Load()
+    long ret = syscall(SYS_futex, reinterpret_cast<int *>(&m_seq),
+                       FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG | FUTEX_CLOCK_REALTIME,
+                       key, abstime, NULL, FUTEX_BITSET_MATCH_ANY);
+    bool timeout = (ret == -1 && errno == ETIMEDOUT);
+    m_waiters.fetch_sub(1, std::memory_order_relaxed);
+    return !timeout;
+}
+
+void VaFutexEvent::Notify()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_waiters.load(std::memory_order_relaxed) > 0)
+    {
+        m_seq.fetch_add(1, std::memory_order_seq_cst);
+        syscall(SYS_futex, reinterpret_cast<int *>(&m_seq),
+                FUTEX_WAKE | FUTEX_PRIVATE_FLAG, 1, NULL, NULL, 0);
+    }
+}
+
+VaRingQueue::VaRingQueue():
+    m_cells(NULL),
+    m_mask(0),
+    m_multi(false),
+    m_tail(0),
+    m_headCache(0),
+    m_head(0),
+    m_tailCache(0)
+{
+}
+
+VaRingQueue::~VaRingQueue()
+{
+    free(m_cells);
+}
+
+int VaRingQueue::Initialize(int capacity, bool multi)
+{
+    size_t size = 1;
+    while (size < (size_t)capacity)
+    {
+        size <<= 1;
+    }
+
+    m_cells = (Cell *)memalign(VA_CACHELINE_SIZE, size * sizeof(Cell));
+    if (m_cells == NULL)
+    {
+        fprintf(stderr, "Error in ring allocation\n");
+        return -1;
+    }
+    for (size_t i = 0; i < size; i ++)
+    {
+        m_cells[i].seq.store(i, std::memory_order_relaxed);
+        m_cells[i].data = NULL;
+    }
+    m_mask = size - 1;
+    m_multi = multi;
+    m_head.store(0, std::memory_order_relaxed);
+    m_tail.store(0, std::memory_order_relaxed);
+    m_headCache = 0;
+    m_tailCache = 0;
+    return 0;
+}
+
+bool VaRingQueue::Push(void *buffer)
+{
+    return m_multi ? PushMulti(buffer) : PushSingle(buffer);
+}
+
+void *VaRingQueue::Pop()
+{
+    return m_multi ? PopMulti() : PopSingle();
+}
+
+bool VaRingQueue::Empty() const
+{
+    return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+}
+
+bool VaRingQueue::PushSingle(void *buffer)
+{
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_headCache > m_mask)
+    {
+        m_headCache = m_head.load(std::memory_order_acquire);
+        if (tail - m_headCache > m_mask)
+        {
+            return false;
+        }
+    }
+    m_cells[tail & m_mask].data = buffer;
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+void *VaRingQueue::PopSingle()
+{
+    size_t head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tailCache)
+    {
+        m_tailCache = m_tail.load(std::memory_order_acquire);
+        if (head == m_tailCache)
+        {
+            return NULL;
+        }
+    }
+    void *buffer = m_cells[head & m_mask].data;
+    m_head.store(head + 1, std::memory_order_release);
+    return buffer;
+}
+
+bool VaRingQueue::PushMulti(void *buffer)
+{
+    Cell *cell;
+    size_t pos = m_tail.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        cell = &m_cells[pos & m_mask];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+        if (dif == 0)
+        {
+            if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (dif < 0)
+        {
+            return false;
+        }
+        else
+        {
+            pos = m_tail.load(std::memory_order_relaxed);
+        }
+    }
+    cell->data = buffer;
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+void *VaRingQueue::PopMulti()
+{
+    Cell *cell;
+    size_t pos = m_head.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        cell = &m_cells[pos & m_mask];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (dif == 0)
+        {
+            if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (dif < 0)
+        {
+            return NULL;
+        }
+        else
+        {
+            pos = m_head.load(std::memory_order_relaxed);
+        }
+    }
+    void *buffer = cell->data;
+    cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+    return buffer;
+}
+
+VaRingPipe::VaRingPipe(RingMode mode):
+    m_mode(mode)
+{
+}
+
+VaRingPipe::~VaRingPipe()
+{
+    // every buffer belongs to this pipe wherever it currently sits
+    for (size_t i = 0; i < m_buffers.size(); i ++)
+    {
+        FreeBuffer(m_buffers[i]);
+    }
+    m_buffers.clear();
+}
+
+int VaRingPipe::Initialize(int nframe, int maxframesize, bufferInitFunc init)
+{
+    // the last handle of a frame may be released by the display or the
+    // inference completion as well as the scheduler, so the free ring has
+    // several producers in every mode
+    bool multi = (m_mode == RING_MPMC);
+    if (m_inRing.Initialize(nframe, true) != 0 || m_outRing.Initialize(nframe, multi) != 0)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < nframe; i ++)
+    {
+        void *data = AllocBuffer(maxframesize, init);
+        if (data == NULL)
+        {
+            return -1;
+        }
+        m_buffers.push_back(data);
+        m_inRing.Push(data);
+    }
+    return 0;
+}
+
+void *VaRingPipe::WaitPop(VaRingQueue &ring, VaFutexEvent &event, const timespec *abstime)
+{
+    void *buffer = NULL;
+    for (int i = 0; i < RING_SPIN_COUNT; i ++)
+    {
+        buffer = ring.Pop();
+        if (buffer != NULL)
+        {
+            return buffer;
+        }
+        cpu_relax();
+    }
+
+    for (;;)
+    {
+        int key = event.Prepare();
+        buffer = ring.Pop();
+        if (buffer != NULL)
+        {
+            event.Cancel();
+            return buffer;
+        }
+        if (!event.Wait(key, abstime))
+        {
+            // one last try, the producer may have raced with the timeout
+            return ring.Pop();
+        }
+        buffer = ring.Pop();
+        if (buffer != NULL)
+        {
+            return buffer;
+        }
+    }
+}
+
+void VaRingPipe::PushNotify(VaRingQueue &ring, VaFutexEvent &event, void *buffer)
+{
+    // rings are sized for all buffers of the pipe, so this only spins if a
+    // foreign buffer was handed in
+    while (!ring.Push(buffer))
+    {
+        sched_yield();
+    }
+    event.Notify();
+}
+
+void *VaRingPipe::GetFree(bool wait)
+{
+    return wait ? WaitPop(m_inRing, m_inEvent, NULL) : m_inRing.Pop();
+}
+
+void VaRingPipe::Recycle(void *buffer)
+{
+    PushNotify(m_inRing, m_inEvent, buffer);
+}
+
+void *VaRingPipe::Load(const timespec *abstime)
+{
+    return WaitPop(m_outRing, m_outEvent, abstime);
+}
+
+void *VaRingPipe::LoadNoWait()
+{
+    return m_outRing.Pop();
+}
+
+void VaRingPipe::Store(void *buffer)
+{
+    PushNotify(m_outRing, m_outEvent, buffer);
+}
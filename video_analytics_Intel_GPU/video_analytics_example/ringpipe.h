@@ -0,0 +1,125 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+/*
+// brief Lock-free ring buffer backend of VaDualPipe
+*/
+
+#ifndef _RINGPIPE_H_
+#define _RINGPIPE_H_
+
+#include "dualpipe.h"
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+
+#define VA_CACHELINE_SIZE 64
+
+// Futex based event count. A waiter calls Prepare(), re-checks its condition
+// and then calls Wait() with the returned key; Notify() only enters the kernel
+// when somebody is actually waiting.
+class VaFutexEvent
+{
+public:
+    VaFutexEvent();
+    int Prepare();
+    void Cancel();
+    // returns false on timeout
+    bool Wait(int key, const timespec *abstime);
+    void Notify();
+
+protected:
+    std::atomic<int> m_seq;
+    std::atomic<int> m_waiters;
+};
+
+// Bounded lock-free queue of buffer pointers, capacity is rounded up to a
+// power of two. SPSC mode only uses the head/tail counters; MPMC mode adds a
+// sequence number per cell so several threads may push or pop concurrently.
+class VaRingQueue
+{
+public:
+    VaRingQueue();
+    ~VaRingQueue();
+    int Initialize(int capacity, bool multi);
+    bool Push(void *buffer);
+    void *Pop();
+    bool Empty() const;
+
+protected:
+    struct Cell
+    {
+        std::atomic<size_t> seq;
+        void *data;
+    };
+
+    bool PushSingle(void *buffer);
+    void *PopSingle();
+    bool PushMulti(void *buffer);
+    void *PopMulti();
+
+    Cell *m_cells;
+    size_t m_mask;
+    bool m_multi;
+
+    // producer and consumer counters live on separate cache lines
+    char m_pad0[VA_CACHELINE_SIZE];
+    std::atomic<size_t> m_tail;
+    size_t m_headCache;
+    char m_pad1[VA_CACHELINE_SIZE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+    std::atomic<size_t> m_head;
+    size_t m_tailCache;
+    char m_pad2[VA_CACHELINE_SIZE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+};
+
+// Same Get/Put/Load/Store contract as VaDualPipe, but both directions are
+// bounded lock-free rings and blocked callers sleep on a futex instead of
+// polling. The free ring is always MPMC, as whichever thread drops the last
+// VaFrameHandle of a frame returns it. RING_SPSC only makes the out ring
+// (decode -> scheduler) single producer single consumer, RING_MPMC is needed
+// when several threads store or load frames. OVERFLOW_DROP_OLDEST makes the
+// producer pop the out ring as well, so it needs RING_MPMC.
+class VaRingPipe : public VaDualPipe
+{
+public:
+    enum RingMode
+    {
+        RING_SPSC = 0,
+        RING_MPMC = 1
+    };
+
+    VaRingPipe(RingMode mode = RING_MPMC);
+    virtual ~VaRingPipe();
+    virtual int Initialize(int nframe, int maxframesize, bufferInitFunc init = NULL);
+    virtual void *Load(const timespec *abstime);
+    virtual void *LoadNoWait();
+    virtual void Store(void *buffer);
+
+protected:
+    virtual void *GetFree(bool wait);
+    virtual void Recycle(void *buffer);
+    void *WaitPop(VaRingQueue &ring, VaFutexEvent &event, const timespec *abstime);
+    void PushNotify(VaRingQueue &ring, VaFutexEvent &event, void *buffer);
+
+    RingMode m_mode;
+    VaRingQueue m_inRing;
+    VaRingQueue m_outRing;
+    VaFutexEvent m_inEvent;
+    VaFutexEvent m_outEvent;
+    std::vector<void *> m_buffers;
+};
+
+#endif
@@ -0,0 +1,254 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+/*
+// brief Work-stealing task executor
+*/
+
+#include "taskexecutor.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <memory>
+
+// worker the calling thread belongs to, NULL outside of any pool
+static thread_local void *s_currentWorker = NULL;
+
+VaTaskExecutor::VaTaskExecutor():
+    m_next(0),
+    m_running(false),
+    m_pending(0),
+    m_active(0)
+{
+}
+
+VaTaskExecutor::~VaTaskExecutor()
+{
+    if (!m_workers.empty())
+    {
+        Shutdown();
+    }
+}
+
+int VaTaskExecutor::Start(int nthreads)
+{
+    if (nthreads <= 0)
+    {
+        nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if (nthreads <= 0)
+        {
+            nthreads = 1;
+        }
+    }
+
+    m_running = true;
+    for (int i = 0; i < nthreads; i ++)
+    {
+        Worker *worker = new Worker();
+        worker->owner = this;
+        worker->index = i;
+        m_workers.push_back(worker);
+    }
+    for (int i = 0; i < nthreads; i ++)
+    {
+        if (pthread_create(&m_workers[i]->thread, NULL, WorkerFunc, m_workers[i]) != 0)
+        {
+            fprintf(stderr, "Error in worker thread creation\n");
+            // only keep the workers that run
+            for (int j = i; j < nthreads; j ++)
+            {
+                delete m_workers[j];
+            }
+            m_workers.resize(i);
+            return (i > 0) ? 0 : -1;
+        }
+    }
+    return 0;
+}
+
+void VaTaskExecutor::Shutdown()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_doneCond.wait(lock, [this]() { return m_active == 0; });
+        m_running = false;
+    }
+    m_cond.notify_all();
+
+    // workers look into each other's queues until they all left
+    for (size_t i = 0; i < m_workers.size(); i ++)
+    {
+        pthread_join(m_workers[i]->thread, NULL);
+    }
+    for (size_t i = 0; i < m_workers.size(); i ++)
+    {
+        delete m_workers[i];
+    }
+    m_workers.clear();
+}
+
+void VaTaskExecutor::Submit(const Task &task, int index)
+{
+    Worker *worker = (Worker *)s_currentWorker;
+    if (index >= 0)
+    {
+        worker = m_workers[index % m_workers.size()];
+    }
+    else if (worker == NULL || worker->owner != this)
+    {
+        worker = m_workers[m_next.fetch_add(1, std::memory_order_relaxed) % m_workers.size()];
+    }
+
+    // count the task first, so it can not finish before it was counted
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending ++;
+        m_active ++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->tasks.push_back(task);
+    }
+    m_cond.notify_one();
+}
+
+void VaTaskExecutor::ParallelFor(int count, const std::function<void(int)> &func)
+{
+    struct Loop
+    {
+        std::atomic<int> next;
+        int done;
+        std::mutex mutex;
+        std::condition_variable cond;
+    };
+    // a helper may only get to run after the loop is over, it then finds no
+    // index left and only touches the shared counters
+    std::shared_ptr<Loop> loop = std::make_shared<Loop>();
+    loop->next = 0;
+    loop->done = 0;
+    Task run = [loop, count, &func]() {
+        int finished = 0;
+        for (int i = loop->next.fetch_add(1); i < count; i = loop->next.fetch_add(1))
+        {
+            func(i);
+            finished ++;
+        }
+        if (finished > 0)
+        {
+            std::lock_guard<std::mutex> lock(loop->mutex);
+            loop->done += finished;
+            if (loop->done == count)
+            {
+                loop->cond.notify_all();
+            }
+        }
+    };
+
+    int helpers = std::min(count - 1, GetThreadCount());
+    for (int i = 0; i < helpers; i ++)
+    {
+        Submit(run);
+    }
+    run();
+
+    std::unique_lock<std::mutex> lock(loop->mutex);
+    loop->cond.wait(lock, [&loop, count]() { return loop->done >= count; });
+}
+
+int VaTaskExecutor::CurrentWorker()
+{
+    Worker *worker = (Worker *)s_currentWorker;
+    return (worker != NULL) ? worker->index : -1;
+}
+
+bool VaTaskExecutor::PopLocal(Worker *worker, Task &task)
+{
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    if (worker->tasks.empty())
+    {
+        return false;
+    }
+    task = std::move(worker->tasks.front());
+    worker->tasks.pop_front();
+    return true;
+}
+
+bool VaTaskExecutor::Steal(Worker *thief, Task &task)
+{
+    size_t count = m_workers.size();
+    for (size_t i = 1; i < count; i ++)
+    {
+        Worker *victim = m_workers[(thief->index + i) % count];
+        std::lock_guard<std::mutex> lock(victim->mutex);
+        if (!victim->tasks.empty())
+        {
+            task = std::move(victim->tasks.back());
+            victim->tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool VaTaskExecutor::TakeTask(Worker *worker, Task &task)
+{
+    if (!PopLocal(worker, task) && !Steal(worker, task))
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pending --;
+    return true;
+}
+
+void *VaTaskExecutor::WorkerFunc(void *arg)
+{
+    Worker *worker = (Worker *)arg;
+    VaTaskExecutor *executor = worker->owner;
+    s_currentWorker = worker;
+    if (executor->m_workerInit)
+    {
+        executor->m_workerInit(worker->index);
+    }
+
+    for (;;)
+    {
+        Task task;
+        if (!executor->TakeTask(worker, task))
+        {
+            std::unique_lock<std::mutex> lock(executor->m_mutex);
+            executor->m_cond.wait(lock, [executor]() {
+                return executor->m_pending > 0 || !executor->m_running;
+            });
+            if (!executor->m_running && executor->m_pending <= 0)
+            {
+                break;
+            }
+            continue;
+        }
+
+        task();
+
+        std::lock_guard<std::mutex> lock(executor->m_mutex);
+        if (-- executor->m_active == 0)
+        {
+            executor->m_doneCond.notify_all();
+        }
+    }
+
+    s_currentWorker = NULL;
+    return NULL;
+}
@@ -0,0 +1,90 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+/*
+// brief Work-stealing task executor
+*/
+
+#ifndef _TASKEXECUTOR_H_
+#define _TASKEXECUTOR_H_
+
+#include <pthread.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+// Fixed pool of worker threads, each with its own task queue. A task submitted
+// from a worker goes to the queue of that worker, other threads spread their
+// tasks round robin. A worker runs its own queue oldest first, so a channel
+// that resubmits itself takes turns with the other channels of the queue, and
+// an idle worker steals the newest task of a busy one.
+class VaTaskExecutor
+{
+public:
+    typedef std::function<void()> Task;
+    typedef std::function<void(int)> WorkerInit;
+
+    VaTaskExecutor();
+    ~VaTaskExecutor();
+    // Called by every worker with its index before it runs any task, e.g. to
+    // pin it to a cpu. Set it before Start()
+    void SetWorkerInit(const WorkerInit &init) { m_workerInit = init; }
+    // nthreads <= 0 starts a worker per online cpu
+    int Start(int nthreads);
+    // Wait until no task is queued or running, then stop the workers
+    void Shutdown();
+    // worker >= 0 queues the task on that worker instead of the default one
+    void Submit(const Task &task, int worker = -1);
+    int GetThreadCount() const { return (int)m_workers.size(); }
+    // Run func(0) .. func(count - 1) on the pool and wait for all of them. The
+    // calling thread takes indices too and only waits for the ones already
+    // running elsewhere, so a worker may call it from a task of its own
+    void ParallelFor(int count, const std::function<void(int)> &func);
+    // Index of the calling worker, -1 for threads outside the pool
+    static int CurrentWorker();
+
+protected:
+    struct Worker
+    {
+        VaTaskExecutor *owner;
+        int index;
+        pthread_t thread;
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    static void *WorkerFunc(void *arg);
+    bool PopLocal(Worker *worker, Task &task);
+    bool Steal(Worker *thief, Task &task);
+    bool TakeTask(Worker *worker, Task &task);
+
+    std::vector<Worker *> m_workers;
+    WorkerInit m_workerInit;
+    std::atomic<unsigned> m_next;
+    bool m_running;
+    // queued tasks, idle workers sleep on m_cond until one shows up
+    int m_pending;
+    // queued plus running tasks, Shutdown() waits for it to drop to 0
+    int m_active;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::condition_variable m_doneCond;
+};
+
+#endif
@@ -0,0 +1,214 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+/*
+// brief Pipeline spans in Chrome trace event format
+*/
+
+#include "tracing.h"
+#include <malloc.h>
+#include <stdio.h>
+#include <string.h>
+#include <new>
+#include <mutex>
+#include <vector>
+
+// One span. The writer bumps seq to odd before and to even after filling in
+// the fields, so a dump running at the same time can tell a torn copy
+struct TraceEvent
+{
+    std::atomic<uint64_t> seq;
+    std::atomic<const char *> name;
+    std::atomic<int64_t> begin;   // ns since the trace epoch
+    std::atomic<int64_t> duration;
+    std::atomic<int> channel;
+    std::atomic<int> frame;
+    std::atomic<int> batch;
+} __attribute__((aligned(64)));
+
+struct TraceThread
+{
+    int tid;
+    char name[32];
+    std::atomic<uint64_t> head;   // events recorded so far
+    TraceEvent events[VA_TRACE_EVENTS_PER_THREAD];
+};
+
+bool VaTracer::s_enabled = false;
+std::atomic<bool> VaTracer::s_dumpRequested(false);
+
+static std::string s_path;
+static VaTracer::Clock::time_point s_epoch;
+static std::mutex s_mutex;
+// every thread that recorded, kept after it exits
+static std::vector<TraceThread *> s_threads;
+static thread_local TraceThread *s_threadBuffer = NULL;
+
+void VaTracer::Enable(const std::string &path)
+{
+    s_path = path;
+    s_epoch = Clock::now();
+    s_enabled = true;
+}
+
+static TraceThread *CurrentThread()
+{
+    if (s_threadBuffer != NULL)
+    {
+        return s_threadBuffer;
+    }
+    // plain new does not honour the cache line alignment before C++17
+    void *memory = memalign(64, sizeof(TraceThread));
+    if (memory == NULL)
+    {
+        return NULL;
+    }
+    TraceThread *buffer = new (memory) TraceThread();
+    buffer->head.store(0, std::memory_order_relaxed);
+    for (int i = 0; i < VA_TRACE_EVENTS_PER_THREAD; i ++)
+    {
+        buffer->events[i].seq.store(0, std::memory_order_relaxed);
+    }
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        buffer->tid = (int)s_threads.size() + 1;
+        snprintf(buffer->name, sizeof(buffer->name), "thread %d", buffer->tid);
+        s_threads.push_back(buffer);
+    }
+    s_threadBuffer = buffer;
+    return buffer;
+}
+
+void VaTracer::SetThreadName(const char *name)
+{
+    if (!s_enabled)
+    {
+        return;
+    }
+    TraceThread *buffer = CurrentThread();
+    if (buffer == NULL)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(s_mutex);
+    snprintf(buffer->name, sizeof(buffer->name), "%s", name);
+}
+
+void VaTracer::Record(const char *name, Clock::time_point begin, Clock::time_point end,
+                      int channel, int frame, int batch)
+{
+    TraceThread *buffer = CurrentThread();
+    if (buffer == NULL)
+    {
+        return;
+    }
+    uint64_t n = buffer->head.load(std::memory_order_relaxed);
+    TraceEvent &event = buffer->events[n % VA_TRACE_EVENTS_PER_THREAD];
+
+    event.seq.store(2 * n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    event.name.store(name, std::memory_order_relaxed);
+    event.begin.store(std::chrono::duration_cast<std::chrono::nanoseconds>(begin - s_epoch).count(),
+                      std::memory_order_relaxed);
+    event.duration.store(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count(),
+                         std::memory_order_relaxed);
+    event.channel.store(channel, std::memory_order_relaxed);
+    event.frame.store(frame, std::memory_order_relaxed);
+    event.batch.store(batch, std::memory_order_relaxed);
+    event.seq.store(2 * n + 2, std::memory_order_release);
+    buffer->head.store(n + 1, std::memory_order_release);
+}
+
+int VaTracer::Dump()
+{
+    if (!s_enabled)
+    {
+        return 0;
+    }
+    FILE *file = fopen(s_path.c_str(), "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error in opening trace file %s\n", s_path.c_str());
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    unsigned long nEvents = 0;
+    for (size_t t = 0; t < s_threads.size(); t ++)
+    {
+        TraceThread *buffer = s_threads[t];
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", buffer->tid, buffer->name);
+        first = false;
+
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t n = (head > VA_TRACE_EVENTS_PER_THREAD) ? head - VA_TRACE_EVENTS_PER_THREAD : 0;
+        for (; n < head; n ++)
+        {
+            TraceEvent &event = buffer->events[n % VA_TRACE_EVENTS_PER_THREAD];
+            uint64_t seq = event.seq.load(std::memory_order_acquire);
+            if (seq != 2 * n + 2)
+            {
+                continue;   // being written, or already overwritten
+            }
+            const char *name = event.name.load(std::memory_order_relaxed);
+            int64_t begin = event.begin.load(std::memory_order_relaxed);
+            int64_t duration = event.duration.load(std::memory_order_relaxed);
+            int channel = event.channel.load(std::memory_order_relaxed);
+            int frame = event.frame.load(std::memory_order_relaxed);
+            int batch = event.batch.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (event.seq.load(std::memory_order_relaxed) != seq)
+            {
+                continue;
+            }
+
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+                    name, buffer->tid, begin / 1000.0, duration / 1000.0);
+            const char *sep = "";
+            if (channel >= 0)
+            {
+                fprintf(file, "\"channel\":%d", channel);
+                sep = ",";
+            }
+            if (frame >= 0)
+            {
+                fprintf(file, "%s\"frame\":%d", sep, frame);
+                sep = ",";
+            }
+            if (batch >= 0)
+            {
+                fprintf(file, "%s\"batch\":%d", sep, batch);
+            }
+            fprintf(file, "}}");
+            nEvents ++;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    printf("Trace of %lu spans written to %s\n", nEvents, s_path.c_str());
+    return 0;
+}
+
+void VaTracer::DumpIfRequested()
+{
+    if (s_dumpRequested.exchange(false, std::memory_order_relaxed))
+    {
+        Dump();
+    }
+}
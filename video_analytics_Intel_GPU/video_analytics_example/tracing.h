@@ -0,0 +1,109 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+/*
+// brief Pipeline spans in Chrome trace event format
+*/
+
+#ifndef _TRACING_H_
+#define _TRACING_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+// Events kept per thread, older spans are overwritten once a thread recorded more
+#define VA_TRACE_EVENTS_PER_THREAD 32768
+
+// Records spans into a ring per thread and writes them out as Chrome
+// trace_event JSON, to be opened in chrome://tracing or ui.perfetto.dev.
+// Until Enable() is called a span costs one load of a flag.
+class VaTracer
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    // Call before the threads that record start
+    static void Enable(const std::string &path);
+    static bool IsEnabled() { return s_enabled; }
+
+    // Name the calling thread in the trace
+    static void SetThreadName(const char *name);
+    // name has to be a string literal, or live as long as the tracer
+    static void Record(const char *name, Clock::time_point begin, Clock::time_point end,
+                       int channel, int frame, int batch);
+
+    // Write the spans recorded so far to the path given to Enable(), may run
+    // while other threads keep recording
+    static int Dump();
+    // Async-signal-safe, DumpIfRequested() then does the work
+    static void RequestDump() { s_dumpRequested.store(true, std::memory_order_relaxed); }
+    static void DumpIfRequested();
+
+protected:
+    static bool s_enabled;
+    static std::atomic<bool> s_dumpRequested;
+};
+
+// Span from construction to destruction of the scope. Channel, frame and
+// batch may be filled in while it runs, -1 leaves them out
+class VaTraceScope
+{
+public:
+    VaTraceScope(const char *name, int channel = -1, int frame = -1, int batch = -1):
+        m_name(NULL)
+    {
+        if (VaTracer::IsEnabled())
+        {
+            m_name = name;
+            m_channel = channel;
+            m_frame = frame;
+            m_batch = batch;
+            m_begin = VaTracer::Clock::now();
+        }
+    }
+    ~VaTraceScope() { End(); }
+    // End the span before the scope does
+    void End()
+    {
+        if (m_name != NULL)
+        {
+            VaTracer::Record(m_name, m_begin, VaTracer::Clock::now(), m_channel, m_frame, m_batch);
+            m_name = NULL;
+        }
+    }
+    void SetChannel(int channel) { m_channel = channel; }
+    void SetFrame(int frame) { m_frame = frame; }
+    void SetBatch(int batch) { m_batch = batch; }
+
+protected:
+    VaTraceScope(const VaTraceScope &);
+    VaTraceScope &operator=(const VaTraceScope &);
+
+    const char *m_name;
+    int m_channel;
+    int m_frame;
+    int m_batch;
+    VaTracer::Clock::time_point m_begin;
+};
+
+#define VA_TRACE_CONCAT2(a, b) a##b
+#define VA_TRACE_CONCAT(a, b) VA_TRACE_CONCAT2(a, b)
+// Trace the rest of the enclosing scope: VA_TRACE("decode", channel, frame)
+#define VA_TRACE(...) VaTraceScope VA_TRACE_CONCAT(vaTraceScope, __LINE__)(__VA_ARGS__)
+
+#endif
@@ -30,6 +30,11 @@ public:
     virtual void init(const cv::Rect &roi, unsigned int vaSurfaceID, int width, int height) = 0;
     virtual cv::Rect  update( unsigned int vaSurfaceID, int width, int height)=0;
 
+    // Same on a frame in system memory, either BGR (CV_8UC3) or NV12 (CV_8UC1,
+    // the Y plane followed by the interleaved UV plane, height*3/2 rows)
+    virtual void init(const cv::Rect &roi, const cv::Mat &frame) = 0;
+    virtual cv::Rect  update(const cv::Mat &frame) = 0;
+
 
 protected:
     cv::Rect_<float> _roi;
@@ -0,0 +1,197 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+
+
+/*
+// brief Association of the detections of a key frame with the tracked objects
+*/
+
+#include "trackmanager.h"
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+
+// boxes that overlap less still match when their centres are this share of the
+// track size apart at most
+#define TRACK_MAX_SHIFT       0.5f
+// and when one is at most this many times the area of the other
+#define TRACK_MAX_AREA_RATIO  2.0f
+
+struct TrackPair
+{
+    float cost;
+    int slot;
+    int detection;
+};
+
+static bool ComparePairs(const TrackPair &a, const TrackPair &b)
+{
+    return a.cost < b.cost;
+}
+
+VaTrackManager::VaTrackManager():
+    m_minIou(0.3f),
+    m_maxMisses(0),
+    m_nextId(1),
+    m_started(0),
+    m_matched(0),
+    m_retired(0)
+{
+}
+
+void VaTrackManager::Initialize(int maxTracks, float minIou, int maxMisses)
+{
+    Track track = {0, 0, 0.0f, cv::Rect2d(), 0, false};
+    m_tracks.assign(std::max(maxTracks, 1), track);
+    m_live.clear();
+    m_minIou = minIou;
+    m_maxMisses = std::max(maxMisses, 0);
+    m_nextId = 1;
+}
+
+void VaTrackManager::Retire(int slot)
+{
+    m_tracks[slot].id = 0;
+    m_retired.store(m_retired.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+int VaTrackManager::Associate(const cv::Rect2d *boxes, const int *classes, const float *confidences, int count)
+{
+    int slots = (int)m_tracks.size();
+    std::vector<TrackPair> pairs;
+    for (int s = 0; s < slots; s ++)
+    {
+        const Track &track = m_tracks[s];
+        if (track.id == 0)
+        {
+            continue;
+        }
+        double trackArea = track.box.area();
+        for (int d = 0; d < count; d ++)
+        {
+            if (classes[d] != track.classid)
+            {
+                continue;
+            }
+            double area = boxes[d].area();
+            double inter = (track.box & boxes[d]).area();
+            float iou = (inter > 0) ? (float)(inter / (trackArea + area - inter)) : 0.0f;
+            double size = sqrt(std::max(trackArea, area));
+            double dx = (boxes[d].x + boxes[d].width / 2) - (track.box.x + track.box.width / 2);
+            double dy = (boxes[d].y + boxes[d].height / 2) - (track.box.y + track.box.height / 2);
+            float shift = (size > 0) ? (float)(sqrt(dx * dx + dy * dy) / size) : 0.0f;
+            float ratio = (trackArea > 0 && area > 0) ? (float)std::max(trackArea / area, area / trackArea) : FLT_MAX;
+            if (iou < m_minIou && (shift > TRACK_MAX_SHIFT || ratio > TRACK_MAX_AREA_RATIO))
+            {
+                continue;
+            }
+            TrackPair pair = {(1.0f - iou) + shift, s, d};
+            pairs.push_back(pair);
+        }
+    }
+    // greedy assignment, as good as the optimal one for the few well
+    // separated objects of a frame
+    std::sort(pairs.begin(), pairs.end(), ComparePairs);
+
+    std::vector<int> detSlot(count, -1);
+    std::vector<bool> matched(slots, false);
+    for (size_t i = 0; i < pairs.size(); i ++)
+    {
+        const TrackPair &pair = pairs[i];
+        if (matched[pair.slot] || detSlot[pair.detection] >= 0)
+        {
+            continue;
+        }
+        matched[pair.slot] = true;
+        detSlot[pair.detection] = pair.slot;
+    }
+
+    for (int s = 0; s < slots; s ++)
+    {
+        Track &track = m_tracks[s];
+        track.fresh = false;
+        if (track.id == 0)
+        {
+            continue;
+        }
+        if (matched[s])
+        {
+            track.misses = 0;
+            m_matched.store(m_matched.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+        else if (++ track.misses > m_maxMisses)
+        {
+            Retire(s);
+        }
+    }
+
+    for (int d = 0; d < count; d ++)
+    {
+        int slot = detSlot[d];
+        if (slot < 0)
+        {
+            // a free slot, else the track that missed the most key frames
+            for (int s = 0; s < slots; s ++)
+            {
+                const Track &track = m_tracks[s];
+                if (track.id == 0)
+                {
+                    slot = s;
+                    break;
+                }
+                if (track.misses > 0 && (slot < 0 || track.misses > m_tracks[slot].misses))
+                {
+                    slot = s;
+                }
+            }
+            if (slot < 0)
+            {
+                continue;
+            }
+            if (m_tracks[slot].id != 0)
+            {
+                Retire(slot);
+            }
+            m_tracks[slot].id = m_nextId ++;
+            m_tracks[slot].misses = 0;
+            m_tracks[slot].fresh = true;
+            m_started.store(m_started.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            detSlot[d] = slot;
+        }
+        Track &track = m_tracks[slot];
+        track.classid = classes[d];
+        track.confidence = confidences[d];
+        track.box = boxes[d];
+    }
+
+    m_live.clear();
+    for (int d = 0; d < count; d ++)
+    {
+        if (detSlot[d] >= 0)
+        {
+            m_live.push_back(detSlot[d]);
+        }
+    }
+    for (int s = 0; s < slots; s ++)
+    {
+        if (m_tracks[s].id != 0 && m_tracks[s].misses > 0)
+        {
+            m_live.push_back(s);
+        }
+    }
+    return (int)m_live.size();
+}
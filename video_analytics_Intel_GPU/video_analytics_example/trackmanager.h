@@ -0,0 +1,87 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+
+
+/*
+// brief Association of the detections of a key frame with the tracked objects
+*/
+
+#ifndef _TRACKMANAGER_H_
+#define _TRACKMANAGER_H_
+
+#include <opencv2/opencv.hpp>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+// Keeps the tracked objects of a stream, and their ids, from one key frame to
+// the next. Every track lives in a slot, the index of its tracker, as long as
+// it lives. On a key frame Associate() pairs the detections with the tracks
+// greedily, the pairs of the same class that overlap most and whose centres
+// are closest first: a matched track keeps its slot, id and trained model and
+// only moves to the detected box, a detection left over starts a new track in
+// a free slot, and a track left over is retired once it missed more key frames
+// than allowed. The tracker thread of the stream owns it, the counters may be
+// read from anywhere.
+class VaTrackManager
+{
+public:
+    struct Track
+    {
+        int id;             // stable over the life of the track, 0 for a free slot
+        int classid;
+        float confidence;   // of the last detection
+        cv::Rect2d box;     // of the last detection or tracker update
+        int misses;         // key frames in a row without a detection
+        bool fresh;         // started on the last key frame, the tracker needs init()
+    };
+
+    VaTrackManager();
+    // maxTracks slots, minIou the overlap that matches a detection with a track
+    // anyway, maxMisses key frames a track survives without a detection
+    void Initialize(int maxTracks, float minIou, int maxMisses);
+
+    // Key frame: match count detections with the tracks and start and retire
+    // tracks. Returns the number of live tracks
+    int Associate(const cv::Rect2d *boxes, const int *classes, const float *confidences, int count);
+    // Tracker side: where the tracker of a slot found its object
+    void SetBox(int slot, const cv::Rect2d &box) { m_tracks[slot].box = box; }
+
+    // Live tracks, the ones of the detections first in detection order, then
+    // the ones that missed the last key frame
+    int GetCount() const { return (int)m_live.size(); }
+    int GetSlot(int i) const { return m_live[i]; }
+    const Track &GetTrack(int slot) const { return m_tracks[slot]; }
+
+    uint64_t GetStarted() const { return m_started.load(std::memory_order_relaxed); }
+    uint64_t GetMatched() const { return m_matched.load(std::memory_order_relaxed); }
+    uint64_t GetRetired() const { return m_retired.load(std::memory_order_relaxed); }
+
+protected:
+    void Retire(int slot);
+
+    float m_minIou;
+    int m_maxMisses;
+    int m_nextId;
+    std::vector<Track> m_tracks;
+    std::vector<int> m_live;
+    std::atomic<uint64_t> m_started;
+    std::atomic<uint64_t> m_matched;
+    std::atomic<uint64_t> m_retired;
+};
+
+#endif
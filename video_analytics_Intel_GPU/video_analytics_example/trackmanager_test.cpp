@@ -0,0 +1,224 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+
+/*
+// brief Checks of the VaTrackManager association rules
+//
+// Plays short key frame sequences through the track manager and checks
+// which tracks keep their id, slot and model, which start fresh and which
+// are retired. Returns the number of failed checks.
+//
+// usage: trackmanager_test
+*/
+
+#include "trackmanager.h"
+#include <stdio.h>
+
+static int g_failed = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) \
+        { \
+            printf("  failed: %s (line %d)\n", #cond, __LINE__); \
+            g_failed ++; \
+        } \
+    } while (0)
+
+struct Detection
+{
+    cv::Rect2d box;
+    int classid;
+};
+
+// One key frame, returns the number of live tracks
+static int KeyFrame(VaTrackManager &tracks, const Detection *detections, int count)
+{
+    cv::Rect2d boxes[8];
+    int classes[8];
+    float confidences[8];
+    for (int i = 0; i < count; i ++)
+    {
+        boxes[i] = detections[i].box;
+        classes[i] = detections[i].classid;
+        confidences[i] = 0.9f;
+    }
+    return tracks.Associate(boxes, classes, confidences, count);
+}
+
+// Track of the i-th detection of the last key frame
+static const VaTrackManager::Track &TrackOf(const VaTrackManager &tracks, int i)
+{
+    return tracks.GetTrack(tracks.GetSlot(i));
+}
+
+// Slot of the live track with an id, -1 if there is none
+static int SlotOf(const VaTrackManager &tracks, int id)
+{
+    for (int i = 0; i < tracks.GetCount(); i ++)
+    {
+        if (tracks.GetTrack(tracks.GetSlot(i)).id == id)
+        {
+            return tracks.GetSlot(i);
+        }
+    }
+    return -1;
+}
+
+static void TestMatchByIou()
+{
+    printf("match by overlap\n");
+    VaTrackManager tracks;
+    tracks.Initialize(4, 0.3f, 0);
+    Detection first[2] = {{cv::Rect2d(0, 0, 50, 50), 1}, {cv::Rect2d(200, 0, 50, 50), 1}};
+    CHECK(KeyFrame(tracks, first, 2) == 2);
+    int idA = TrackOf(tracks, 0).id;
+    int idB = TrackOf(tracks, 1).id;
+    CHECK(idA > 0 && idB > 0 && idA != idB);
+    CHECK(TrackOf(tracks, 0).fresh && TrackOf(tracks, 1).fresh);
+
+    // both moved by 10 pixels, IoU 0.67, and come in the other order
+    Detection second[2] = {{cv::Rect2d(210, 0, 50, 50), 1}, {cv::Rect2d(10, 0, 50, 50), 1}};
+    CHECK(KeyFrame(tracks, second, 2) == 2);
+    CHECK(TrackOf(tracks, 0).id == idB && TrackOf(tracks, 1).id == idA);
+    CHECK(!TrackOf(tracks, 0).fresh && !TrackOf(tracks, 1).fresh);
+    CHECK(TrackOf(tracks, 1).box.x == 10);
+    CHECK(tracks.GetStarted() == 2 && tracks.GetMatched() == 2 && tracks.GetRetired() == 0);
+}
+
+static void TestMatchByShift()
+{
+    printf("match by centre shift\n");
+    VaTrackManager tracks;
+    // an overlap the shifted boxes never reach
+    tracks.Initialize(4, 0.9f, 0);
+    Detection first[1] = {{cv::Rect2d(0, 0, 20, 20), 1}};
+    KeyFrame(tracks, first, 1);
+    int id = TrackOf(tracks, 0).id;
+
+    // IoU 0.54, centres 0.3 of the size apart
+    Detection near[1] = {{cv::Rect2d(6, 0, 20, 20), 1}};
+    CHECK(KeyFrame(tracks, near, 1) == 1);
+    CHECK(TrackOf(tracks, 0).id == id && !TrackOf(tracks, 0).fresh);
+
+    // centres 0.6 of the size apart
+    Detection far[1] = {{cv::Rect2d(18, 0, 20, 20), 1}};
+    CHECK(KeyFrame(tracks, far, 1) == 1);
+    CHECK(TrackOf(tracks, 0).id != id && TrackOf(tracks, 0).fresh);
+
+    // close, but four times the area
+    id = TrackOf(tracks, 0).id;
+    Detection grown[1] = {{cv::Rect2d(8, -10, 40, 40), 1}};
+    CHECK(KeyFrame(tracks, grown, 1) == 1);
+    CHECK(TrackOf(tracks, 0).id != id);
+}
+
+static void TestClassMismatch()
+{
+    printf("class mismatch\n");
+    VaTrackManager tracks;
+    tracks.Initialize(4, 0.3f, 0);
+    Detection first[1] = {{cv::Rect2d(0, 0, 50, 50), 1}};
+    KeyFrame(tracks, first, 1);
+    int id = TrackOf(tracks, 0).id;
+
+    Detection other[1] = {{cv::Rect2d(0, 0, 50, 50), 2}};
+    CHECK(KeyFrame(tracks, other, 1) == 1);
+    CHECK(TrackOf(tracks, 0).id != id && TrackOf(tracks, 0).fresh);
+    CHECK(TrackOf(tracks, 0).classid == 2);
+    CHECK(tracks.GetRetired() == 1);
+}
+
+static void TestEviction()
+{
+    printf("eviction of the track with the most misses\n");
+    VaTrackManager tracks;
+    tracks.Initialize(3, 0.3f, 5);
+    Detection a = {cv::Rect2d(0, 0, 50, 50), 1};
+    Detection b = {cv::Rect2d(100, 0, 50, 50), 1};
+    Detection c = {cv::Rect2d(200, 0, 50, 50), 1};
+    Detection d = {cv::Rect2d(300, 0, 50, 50), 1};
+    Detection frame1[3] = {a, b, c};
+    KeyFrame(tracks, frame1, 3);
+    int idA = TrackOf(tracks, 0).id;
+    int idB = TrackOf(tracks, 1).id;
+    int idC = TrackOf(tracks, 2).id;
+    int slotB = tracks.GetSlot(1);
+
+    Detection frame2[2] = {a, c};
+    // the missed track is still alive, after the detected ones
+    CHECK(KeyFrame(tracks, frame2, 2) == 3);
+    CHECK(TrackOf(tracks, 2).id == idB && TrackOf(tracks, 2).misses == 1);
+
+    Detection frame3[1] = {a};
+    CHECK(KeyFrame(tracks, frame3, 1) == 3);
+
+    // all slots taken, b missed two key frames and c one
+    Detection frame4[2] = {a, d};
+    CHECK(KeyFrame(tracks, frame4, 2) == 3);
+    CHECK(TrackOf(tracks, 0).id == idA);
+    CHECK(TrackOf(tracks, 1).fresh && tracks.GetSlot(1) == slotB);
+    CHECK(SlotOf(tracks, idB) < 0);
+    CHECK(SlotOf(tracks, idC) >= 0 && tracks.GetTrack(SlotOf(tracks, idC)).misses == 2);
+    CHECK(tracks.GetRetired() == 1);
+
+    // with every slot held by a detected track, a new detection is dropped
+    Detection frame5[4] = {a, c, d, {cv::Rect2d(400, 0, 50, 50), 1}};
+    CHECK(KeyFrame(tracks, frame5, 4) == 3);
+}
+
+static void TestRetirement()
+{
+    printf("retirement after the kept key frames\n");
+    VaTrackManager tracks;
+    tracks.Initialize(4, 0.3f, 1);
+    Detection first[1] = {{cv::Rect2d(0, 0, 50, 50), 1}};
+    KeyFrame(tracks, first, 1);
+    int id = TrackOf(tracks, 0).id;
+
+    // tracked on, the next key frame compares with where the tracker went
+    tracks.SetBox(tracks.GetSlot(0), cv::Rect2d(100, 0, 50, 50));
+    CHECK(KeyFrame(tracks, NULL, 0) == 1);
+    CHECK(TrackOf(tracks, 0).id == id && TrackOf(tracks, 0).misses == 1);
+    CHECK(KeyFrame(tracks, NULL, 0) == 0);
+    CHECK(tracks.GetRetired() == 1);
+
+    // ids are not handed out again
+    Detection again[1] = {{cv::Rect2d(100, 0, 50, 50), 1}};
+    KeyFrame(tracks, again, 1);
+    CHECK(TrackOf(tracks, 0).id > id);
+
+    // a track detected again within -track_keep comes back with its id
+    VaTrackManager kept;
+    kept.Initialize(4, 0.3f, 1);
+    KeyFrame(kept, first, 1);
+    id = TrackOf(kept, 0).id;
+    KeyFrame(kept, NULL, 0);
+    CHECK(KeyFrame(kept, first, 1) == 1);
+    CHECK(TrackOf(kept, 0).id == id && TrackOf(kept, 0).misses == 0 && !TrackOf(kept, 0).fresh);
+}
+
+int main()
+{
+    TestMatchByIou();
+    TestMatchByShift();
+    TestClassMismatch();
+    TestEviction();
+    TestRetirement();
+    printf("%d failed\n", g_failed);
+    return g_failed;
+}